@@ -0,0 +1,328 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_BSR_MATRIX__H__
+#define __DJS_BSR_MATRIX__H__
+
+#include <CSRMatrix.h>
+
+namespace SparseMatrix
+{
+
+/*
+ * Count the R x C blocks holding the non-zeros of A (the storage BSR
+ * would need is R * C times that).
+ *
+ */
+inline int64_t CountBlocks (CSRMatrix_t &A, int R, int C)
+{
+	int blockRows = (A.rows () + R - 1) / R;
+	int blockColumns = (A.columns () + C - 1) / C;
+	int64_t *rowPtr = A.RowPtr ();
+	int *colIdx = A.ColIdx ();
+	int64_t blocks = 0;
+
+#pragma omp parallel reduction(+:blocks)
+	{
+		std::vector<int> seen (blockColumns, -1);
+
+#pragma omp for schedule(static)
+		for (int I = 0; I < blockRows; ++I)
+			for (int i = I * R; i < I * R + R && i < A.rows (); ++i)
+				for (int64_t k = rowPtr[i]; k < rowPtr[i + 1]; ++k)
+				{
+					int J = colIdx[k] / C;
+
+					if (seen[J] != I)
+					{
+						seen[J] = I;
+						++blocks;
+					}
+				}
+	}
+
+	return blocks;
+}
+
+/*
+ * Block compressed sparse row with R x C register blocks.
+ *
+ * Matrices from systems of PDEs (several unknowns per node) are made of
+ * small dense blocks.  Storing the blocks rather than the elements needs
+ * one column index per block instead of per non-zero, and the fixed size
+ * block product is fully unrolled: R partial sums stay in registers and
+ * each x element is loaded once per block rather than once per row.
+ *
+ * A block is stored column major, element (r, c) of block b is at
+ * bs_values[b * R * C + c * R + r].
+ *
+ */
+
+template<int R, int C> class BSRMatrix_t : public SparseOperator_t
+{
+	int			bs_rows;
+	int			bs_columns;
+	int64_t		bs_nnz;
+	int			bs_blockRows;
+	int64_t		*bs_blockPtr;	// blocks of block row I
+	int			*bs_blockCol;
+	double		*bs_values;
+
+	// not copyable, share by reference
+	BSRMatrix_t (const BSRMatrix_t &);
+	BSRMatrix_t &operator= (const BSRMatrix_t &);
+
+public:
+
+	BSRMatrix_t (CSRMatrix_t &A) :
+		bs_rows (A.rows ()),
+		bs_columns (A.columns ()),
+		bs_nnz (A.nnz ()),
+		bs_blockRows ((A.rows () + R - 1) / R)
+	{
+		int blockColumns = (bs_columns + C - 1) / C;
+		int64_t *rowPtr = A.RowPtr ();
+		int *colIdx = A.ColIdx ();
+		double *values = A.Values ();
+
+		bs_blockPtr = new int64_t [bs_blockRows + 1];
+		bs_blockPtr[0] = 0;
+
+		// (i) blocks per block row
+#pragma omp parallel
+		{
+			std::vector<int> seen (blockColumns, -1);
+
+#pragma omp for schedule(static)
+			for (int I = 0; I < bs_blockRows; ++I)
+			{
+				int64_t count = 0;
+
+				for (int i = I * R; i < I * R + R && i < bs_rows; ++i)
+					for (int64_t k = rowPtr[i]; k < rowPtr[i + 1]; ++k)
+						if (seen[colIdx[k] / C] != I)
+						{
+							seen[colIdx[k] / C] = I;
+							++count;
+						}
+
+				bs_blockPtr[I + 1] = count;
+			}
+		}
+
+		for (int I = 0; I < bs_blockRows; ++I)
+			bs_blockPtr[I + 1] += bs_blockPtr[I];
+
+		bs_blockCol = new int [bs_blockPtr[bs_blockRows]];
+		bs_values = new double [bs_blockPtr[bs_blockRows] * R * C];
+
+		// (ii) sorted block columns, then scatter the elements
+#pragma omp parallel
+		{
+			std::vector<int64_t> slot (blockColumns, -1);
+
+#pragma omp for schedule(static)
+			for (int I = 0; I < bs_blockRows; ++I)
+			{
+				int64_t first = bs_blockPtr[I];
+				int64_t n = first;
+
+				for (int i = I * R; i < I * R + R && i < bs_rows; ++i)
+					for (int64_t k = rowPtr[i]; k < rowPtr[i + 1]; ++k)
+					{
+						int J = colIdx[k] / C;
+
+						if (slot[J] < first)
+						{
+							slot[J] = first;	// mark as seen for this block row
+							bs_blockCol[n++] = J;
+						}
+					}
+
+				std::sort (bs_blockCol + first, bs_blockCol + n);
+
+				for (int64_t b = first; b < n; ++b)
+					slot[bs_blockCol[b]] = b;
+
+				memset (bs_values + first * R * C, 0, (n - first) * R * C * sizeof (double));
+
+				for (int i = I * R; i < I * R + R && i < bs_rows; ++i)
+					for (int64_t k = rowPtr[i]; k < rowPtr[i + 1]; ++k)
+					{
+						int j = colIdx[k];
+						int64_t b = slot[j / C];
+
+						bs_values[b * R * C + (j % C) * R + (i - I * R)] = values[k];
+					}
+			}
+		}
+	}
+
+	~BSRMatrix_t (void)
+	{
+		delete [] bs_blockPtr;
+		delete [] bs_blockCol;
+		delete [] bs_values;
+	}
+
+	int rows (void)
+	{
+		return bs_rows;
+	}
+
+	int columns (void)
+	{
+		return bs_columns;
+	}
+
+	int64_t nnz (void)
+	{
+		return bs_nnz;
+	}
+
+	const char *Format (void)
+	{
+		return "BSR";
+	}
+
+	/*
+	 * New values from A, which has the structure this was built from
+	 * (see CSRMatrix_t::SetValues).  The blocks are found by a binary
+	 * search of their block row.
+	 *
+	 */
+	void Update (CSRMatrix_t &A)
+	{
+		int64_t *rowPtr = A.RowPtr ();
+		int *colIdx = A.ColIdx ();
+		double *values = A.Values ();
+
+		if (A.rows () != bs_rows || A.nnz () != bs_nnz)
+			throw ("BSR: structure changed");
+
+#pragma omp parallel for schedule(static) if(bs_nnz >= __CSR_PARALLEL)
+		for (int I = 0; I < bs_blockRows; ++I)
+		{
+			int *first = bs_blockCol + bs_blockPtr[I];
+			int *last = bs_blockCol + bs_blockPtr[I + 1];
+
+			for (int i = I * R; i < I * R + R && i < bs_rows; ++i)
+				for (int64_t k = rowPtr[i]; k < rowPtr[i + 1]; ++k)
+				{
+					int j = colIdx[k];
+					int64_t b = std::lower_bound (first, last, j / C) - bs_blockCol;
+
+					bs_values[b * R * C + (j % C) * R + (i - I * R)] = values[k];
+				}
+		}
+	}
+
+	// stored entries (with explicit zeros) per non-zero
+	double Fill (void)
+	{
+		return (bs_nnz ? (double) bs_blockPtr[bs_blockRows] * R * C / bs_nnz : 1.0);
+	}
+
+	void Multiply (double alpha, const double *x, double beta, double *y)
+	{
+		const int64_t * __restrict blockPtr = bs_blockPtr;
+		const int * __restrict blockCol = bs_blockCol;
+		const double * __restrict values = bs_values;
+		int fullColumns = bs_columns / C;	// block columns inside x
+
+#pragma omp parallel for schedule(static) if(bs_nnz >= __CSR_PARALLEL)
+		for (int I = 0; I < bs_blockRows; ++I)
+		{
+			double sum[R];
+
+			for (int r = 0; r < R; ++r)
+				sum[r] = 0;
+
+			for (int64_t b = blockPtr[I]; b < blockPtr[I + 1]; ++b)
+			{
+				const double * __restrict block = values + b * R * C;
+				const double * __restrict xs = x + (int64_t) blockCol[b] * C;
+				int width = (blockCol[b] < fullColumns ? C : bs_columns % C);
+
+				if (width == C)
+				{
+					for (int c = 0; c < C; ++c)
+						for (int r = 0; r < R; ++r)
+							sum[r] += block[c * R + r] * xs[c];
+				}
+				else
+				{
+					for (int c = 0; c < width; ++c)
+						for (int r = 0; r < R; ++r)
+							sum[r] += block[c * R + r] * xs[c];
+				}
+			}
+
+			for (int r = 0; r < R && I * R + r < bs_rows; ++r)
+			{
+				int row = I * R + r;
+
+				if (beta == 0)
+					y[row] = alpha * sum[r];
+				else
+					y[row] = alpha * sum[r] + beta * y[row];
+			}
+		}
+	}
+
+	void MultiplyTranspose (double alpha, const double *x, double beta, double *y)
+	{
+		for (int j = 0; j < bs_columns; ++j)
+			y[j] = (beta == 0 ? 0 : beta * y[j]);
+
+		for (int I = 0; I < bs_blockRows; ++I)
+		{
+			int height = std::min (R, bs_rows - I * R);
+
+			for (int64_t b = bs_blockPtr[I]; b < bs_blockPtr[I + 1]; ++b)
+			{
+				const double *block = bs_values + b * R * C;
+				int J = bs_blockCol[b] * C;
+				int width = std::min (C, bs_columns - J);
+
+				for (int c = 0; c < width; ++c)
+				{
+					double sum = 0;
+
+					for (int r = 0; r < height; ++r)
+						sum += block[c * R + r] * x[I * R + r];
+
+					y[J + c] += alpha * sum;
+				}
+			}
+		}
+	}
+};
+
+};
+
+#endif // header inclusion
@@ -0,0 +1,292 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_BICGSTAB__H__
+#define __DJS_BICGSTAB__H__
+
+#include <math.h>
+
+#include <Krylov.h>
+
+/*
+ * BiCGSTAB (van der Vorst 1992, Saad algorithm 7.7, Iterative Methods
+ * for Sparse Linear Systems) for non-symmetric A, any storage format,
+ * right preconditioned by M if given: the residual is the true one.
+ *
+ * Unlike GMRES the memory does not grow with the iteration, there are
+ * eight vectors of A's dimension whatever it takes to converge.  An
+ * iteration is two products with A (and two applications of M).
+ *
+ * Iteration stops when |r| <= tolerance |b| or after the maximum number
+ * of iterations.  Should the shadow residual become orthogonal to r
+ * (ρ = 0, a breakdown of the underlying Lanczos process) the iteration
+ * starts over with r as the shadow.  It also starts over, from the true
+ * residual, if the recurred one claims convergence that b - Ax does not
+ * bear out.
+ *
+ */
+
+class BiCGSTAB_t
+{
+	Mo_t			&bs_A;
+	Mp_t			*bs_M;
+	double			bs_tolerance;
+	int				bs_maxIterations;
+	int				bs_iterations;
+	int				bs_replaced;
+	double			bs_residual;		// |r| / |b| on return
+	SolverStats_t	bs_stats;
+
+	void precondition (const double *r, double *z)
+	{
+		double start = SolverStats_t::Now ();
+
+		bs_M->Apply (r, z);
+
+		bs_stats.ss_precondition += SolverStats_t::Now () - start;
+		++bs_stats.ss_applies;
+	}
+
+	void multiply (const double *x, double *y)
+	{
+		bs_A.Multiply (1.0, x, 0.0, y);
+		++bs_stats.ss_matvecs;
+	}
+
+public:
+
+	BiCGSTAB_t (Mo_t &A) :
+		bs_A (A),
+		bs_M (0),
+		bs_tolerance (1e-8),
+		bs_maxIterations (A.rows ()),
+		bs_iterations (0),
+		bs_replaced (0),
+		bs_residual (0)
+	{
+		if (A.rows () != A.columns ())
+			throw ("BiCGSTAB: matrix not square");
+	}
+
+	BiCGSTAB_t (Mo_t &A, Mp_t &M) :
+		bs_A (A),
+		bs_M (&M),
+		bs_tolerance (1e-8),
+		bs_maxIterations (A.rows ()),
+		bs_iterations (0),
+		bs_replaced (0),
+		bs_residual (0)
+	{
+		if (A.rows () != A.columns () || M.rows () != A.rows ())
+			throw ("BiCGSTAB: dimension mismatch");
+	}
+
+	~BiCGSTAB_t (void)
+	{
+	}
+
+	// relative: stop when |r| <= relative |b|
+	void SetTolerance (double relative)
+	{
+		bs_tolerance = relative;
+	}
+
+	void SetMaxIterations (int iterations)
+	{
+		bs_maxIterations = iterations;
+	}
+
+	int GetIterations (void) const
+	{
+		return bs_iterations;
+	}
+
+	int GetReplacements (void) const
+	{
+		return bs_replaced;
+	}
+
+	double GetResidual (void) const
+	{
+		return bs_residual;
+	}
+
+	SolverStats_t GetStats (void) const
+	{
+		return bs_stats;
+	}
+
+	bool Solve (Md_t &b, Md_t &x);
+};
+
+/*
+ * x holds the initial guess and on return the solution.  Returns true
+ * if the tolerance was met (by the true residual).
+ *
+ */
+bool
+BiCGSTAB_t::Solve (Md_t &b, Md_t &x)
+{
+	int n = bs_A.rows ();
+
+	assert (b.rows () == n && x.rows () == n);
+	assert (b.columns () == 1 && x.columns () == 1);
+
+	double start = SolverStats_t::Now ();
+	Md_t R (n, 1);
+	Md_t Shadow (n, 1);
+	Md_t P (n, 1, 0.0);
+	Md_t V (n, 1, 0.0);
+	Md_t T (n, 1);
+	Md_t Ph (n, 1);
+	Md_t Sh (n, 1);
+	double *r = R.raw ();
+	double *shadow = Shadow.raw ();
+	double *p = P.raw ();
+	double *v = V.raw ();
+	double *t = T.raw ();
+	double *ph = (bs_M ? Ph.raw () : p);
+	double *sh = (bs_M ? Sh.raw () : r);	// s is kept in r
+	double *xp;
+	double bnorm = sqrt (Kernels::Dot (b.raw (), b.raw (), n));
+	double halt = bs_tolerance * bnorm;
+	double rho = 1;
+
+	bs_stats = SolverStats_t ();
+
+	x.copy ();	// written in place, x may share with b or the guess
+	xp = x.raw ();
+	double alpha = 1;
+	double omega = 1;
+
+	// r = b - Ax
+	multiply (xp, r);
+	Kernels::Xpby (b.raw (), -1.0, r, n);
+
+	double rr = Kernels::Dot (r, r, n);
+	bool recurred = false;
+
+	Kernels::Copy (r, shadow, n);
+	bs_iterations = 0;
+	bs_replaced = 0;
+
+	while (bs_iterations < bs_maxIterations)
+	{
+		double rhoNext;
+
+		if (sqrt (rr) <= halt)
+		{
+			if (!recurred)
+				break;
+
+			multiply (xp, r);
+			Kernels::Xpby (b.raw (), -1.0, r, n);
+			rr = Kernels::Dot (r, r, n);
+			recurred = false;
+
+			if (sqrt (rr) <= halt)
+				break;
+
+			++bs_replaced;
+			rhoNext = 0;	// start over from the true r
+		}
+		else
+			rhoNext = Kernels::Dot (shadow, r, n);
+
+		++bs_iterations;
+
+		if (rhoNext == 0)
+		{
+			// breakdown, start over from r
+			Kernels::Copy (r, shadow, n);
+			Kernels::Scale (0.0, p, n);
+			Kernels::Scale (0.0, v, n);
+			rho = alpha = omega = 1;
+			rhoNext = rr;
+		}
+
+		double beta = (rhoNext / rho) * (alpha / omega);
+
+		rho = rhoNext;
+		Kernels::Direction (r, beta, omega, v, p, n);
+
+		if (bs_M)
+			precondition (p, ph);
+
+		multiply (ph, v);
+
+		double sv = Kernels::Dot (shadow, v, n);
+
+		if (sv == 0)
+			break;
+
+		alpha = rho / sv;
+
+		// s = r - αv
+		Kernels::Axpy (-alpha, v, r, n);
+		Kernels::Axpy (alpha, ph, xp, n);
+		recurred = true;
+
+		rr = Kernels::Dot (r, r, n);
+		if (sqrt (rr) <= halt)
+			continue;
+
+		if (bs_M)
+			precondition (r, sh);
+
+		multiply (sh, t);
+
+		double tt = Kernels::Dot (t, t, n);
+
+		omega = (tt > 0 ? Kernels::Dot (t, r, n) / tt : 0);
+		if (omega == 0)
+			break;	// stagnation, t is orthogonal to s
+
+		Kernels::Axpy (omega, sh, xp, n);
+		Kernels::Axpy (-omega, t, r, n);
+
+		rr = Kernels::Dot (r, r, n);
+	}
+
+	// the limit can fall on a recurred r, report the true one
+	if (recurred)
+	{
+		multiply (xp, r);
+		Kernels::Xpby (b.raw (), -1.0, r, n);
+		rr = Kernels::Dot (r, r, n);
+	}
+
+	double rnorm = sqrt (rr);
+
+	bs_residual = (bnorm > 0 ? rnorm / bnorm : rnorm);
+	bs_stats.ss_iterations = bs_stats.ss_steps = bs_iterations;
+	bs_stats.ss_total = SolverStats_t::Now () - start;
+
+	return (rnorm <= halt);
+}
+
+#endif // header inclusion
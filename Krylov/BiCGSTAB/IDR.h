@@ -0,0 +1,389 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_IDR__H__
+#define __DJS_IDR__H__
+
+#include <math.h>
+
+#include <random>
+#include <vector>
+
+#include <Krylov.h>
+
+// seeds the shadow space
+#define __IDR_SEED		2
+
+/*
+ * IDR(s) with biorthogonalisation (van Gijzen and Sonneveld, ACM TOMS
+ * 38(1), 2011, algorithm 913) for non-symmetric A, any storage format,
+ * right preconditioned by M if given.
+ *
+ * The residuals are forced into a sequence of shrinking subspaces, each
+ * orthogonal to the s columns of a random shadow P.  It needs at most
+ * n + n/s products with A, so for s > 1 it typically beats BiCGSTAB
+ * (which is IDR(1)), and s = 4 is usually enough.  Memory is 3s + 4
+ * vectors, independent of the iteration count.
+ *
+ * A cycle is s steps in the subspace and one dimension reduction step
+ * (the "polynomial" step, ω minimising |r|), each one product with A.
+ *
+ * |r| can peak well above |b| before it falls, and the recurred r then
+ * drifts from b - Ax by rounding in proportion to the peak.  So the true
+ * residual is checked before declaring convergence, and if it falls short
+ * it replaces r and the iteration starts over from there.
+ *
+ */
+
+class IDR_t
+{
+	Mo_t			&id_A;
+	Mp_t			*id_M;
+	int				id_s;
+	double			id_tolerance;
+	int				id_maxIterations;	// steps, products with A
+	int				id_iterations;
+	int				id_replaced;
+	double			id_residual;		// |r| / |b| on return
+	SolverStats_t	id_stats;
+	Md_t			id_P;				// the shadow space, fixed
+
+	void precondition (const double *r, double *z)
+	{
+		double start = SolverStats_t::Now ();
+
+		id_M->Apply (r, z);
+
+		id_stats.ss_precondition += SolverStats_t::Now () - start;
+		++id_stats.ss_applies;
+	}
+
+	void multiply (const double *x, double *y)
+	{
+		id_A.Multiply (1.0, x, 0.0, y);
+		++id_stats.ss_matvecs;
+	}
+
+	/*
+	 * The shadow space, random and orthonormal.  Drawn once from a
+	 * private generator with a fixed seed: every solve takes the same
+	 * path and the caller's rand () is left alone.
+	 *
+	 */
+	void init (void)
+	{
+		int n = id_A.rows ();
+		int s = id_s;
+
+		if (s < 1 || s >= n)
+			throw ("IDR: require 1 <= s < n");
+
+		std::mt19937 generator (__IDR_SEED);
+		std::uniform_real_distribution<double> uniform (-1.0, 1.0);
+		std::vector<double> c (s);
+
+		id_P = Md_t (n, s);
+
+		double *Pp = id_P.raw ();
+		int ld = id_P.stride ();
+
+		for (int j = 0; j < s; ++j)
+		{
+			double *pj = Pp + (int64_t) j * ld;
+
+			for (int i = 0; i < n; ++i)
+				pj[i] = uniform (generator);
+
+			for (int pass = 0; pass < 2 && j > 0; ++pass)
+			{
+				Kernels::Project (Pp, ld, j, pj, c.data (), n);
+				Kernels::Subtract (Pp, ld, j, c.data (), pj, n);
+			}
+
+			Kernels::Scale (1.0 / sqrt (Kernels::Dot (pj, pj, n)), pj, n);
+		}
+	}
+
+public:
+
+	IDR_t (Mo_t &A, int s = 4) :
+		id_A (A),
+		id_M (0),
+		id_s (s),
+		id_tolerance (1e-8),
+		id_maxIterations (2 * A.rows ()),
+		id_iterations (0),
+		id_replaced (0),
+		id_residual (0)
+	{
+		if (A.rows () != A.columns ())
+			throw ("IDR: matrix not square");
+
+		init ();
+	}
+
+	IDR_t (Mo_t &A, Mp_t &M, int s = 4) :
+		id_A (A),
+		id_M (&M),
+		id_s (s),
+		id_tolerance (1e-8),
+		id_maxIterations (2 * A.rows ()),
+		id_iterations (0),
+		id_replaced (0),
+		id_residual (0)
+	{
+		if (A.rows () != A.columns () || M.rows () != A.rows ())
+			throw ("IDR: dimension mismatch");
+
+		init ();
+	}
+
+	~IDR_t (void)
+	{
+	}
+
+	// relative: stop when |r| <= relative |b|
+	void SetTolerance (double relative)
+	{
+		id_tolerance = relative;
+	}
+
+	void SetMaxIterations (int iterations)
+	{
+		id_maxIterations = iterations;
+	}
+
+	int GetIterations (void) const
+	{
+		return id_iterations;
+	}
+
+	int GetReplacements (void) const
+	{
+		return id_replaced;
+	}
+
+	double GetResidual (void) const
+	{
+		return id_residual;
+	}
+
+	SolverStats_t GetStats (void) const
+	{
+		return id_stats;
+	}
+
+	bool Solve (Md_t &b, Md_t &x);
+};
+
+/*
+ * x holds the initial guess and on return the solution.  Returns true
+ * if the tolerance was met (by the true residual).
+ *
+ * In the paper's notation: G = AU, Pᵀ G is lower triangular (M below,
+ * here Ms) and f = Pᵀr.
+ *
+ */
+bool
+IDR_t::Solve (Md_t &b, Md_t &x)
+{
+	int n = id_A.rows ();
+	int s = id_s;
+
+	assert (b.rows () == n && x.rows () == n);
+	assert (b.columns () == 1 && x.columns () == 1);
+
+	double start = SolverStats_t::Now ();
+	Md_t R (n, 1);
+	Md_t G (n, s, 0.0, true);
+	Md_t U (n, s, 0.0, true);
+	Md_t V (n, 1);
+	Md_t Z (n, 1);
+	Md_t T (n, 1);
+	Md_t Ms (s, s, 1.0);
+	Md_t F (s, 1);
+	Md_t C (s, 1);
+	double *r = R.raw ();
+	double *Pp = id_P.raw ();
+	double *Gp = G.raw ();
+	double *Up = U.raw ();
+	double *v = V.raw ();
+	double *z = (id_M ? Z.raw () : v);
+	double *t = T.raw ();
+	double *f = F.raw ();
+	double *c = C.raw ();
+	double *xp;
+	int ld = n;	// P, G and U
+	double bnorm = sqrt (Kernels::Dot (b.raw (), b.raw (), n));
+	double halt = id_tolerance * bnorm;
+	double omega = 1;
+
+	id_stats = SolverStats_t ();
+
+	x.copy ();	// written in place, x may share with b or the guess
+	xp = x.raw ();
+
+	// r = b - Ax
+	multiply (xp, r);
+	Kernels::Xpby (b.raw (), -1.0, r, n);
+
+	double rnorm = sqrt (Kernels::Dot (r, r, n));
+	bool recurred = false;
+
+	id_iterations = 0;
+	id_replaced = 0;
+
+	while (id_iterations < id_maxIterations)
+	{
+		if (rnorm <= halt)
+		{
+			if (!recurred)
+				break;
+
+			multiply (xp, r);
+			Kernels::Xpby (b.raw (), -1.0, r, n);
+			rnorm = sqrt (Kernels::Dot (r, r, n));
+			recurred = false;
+
+			if (rnorm <= halt)
+				break;
+
+			// start over, G and U belong to the old r
+			Kernels::Scale (0.0, Gp, n * s);
+			Kernels::Scale (0.0, Up, n * s);
+			Ms = Md_t (s, s, 1.0);
+			omega = 1;
+			++id_replaced;
+		}
+
+		Kernels::Project (Pp, ld, s, r, f, n);
+
+		for (int k = 0; k < s && rnorm > halt; ++k)
+		{
+			double *gk = Gp + (int64_t) k * ld;
+			double *uk = Up + (int64_t) k * ld;
+
+			// Ms(k:s, k:s) c = f(k:s), lower triangular
+			for (int i = k; i < s; ++i)
+			{
+				double sum = f[i];
+
+				for (int j = k; j < i; ++j)
+					sum -= Ms (i, j) * c[j - k];
+
+				c[i - k] = sum / Ms (i, i);
+			}
+
+			// v = r - G(:, k:s) c, z = M⁻¹v
+			Kernels::Copy (r, v, n);
+			Kernels::Subtract (gk, ld, s - k, c, v, n);
+
+			if (id_M)
+				precondition (v, z);
+
+			// uk = ωz + U(:, k:s) c, built in z since uk is in the sum
+			Kernels::Scale (omega, z, n);
+
+			for (int j = k; j < s; ++j)
+				Kernels::Axpy (c[j - k], Up + (int64_t) j * ld, z, n);
+
+			Kernels::Copy (z, uk, n);
+			multiply (uk, gk);
+
+			// biorthogonalise gk against the first k columns of P
+			for (int i = 0; i < k; ++i)
+			{
+				double alpha = Kernels::Dot (Pp + (int64_t) i * ld, gk, n) / Ms (i, i);
+
+				Kernels::Axpy (-alpha, Gp + (int64_t) i * ld, gk, n);
+				Kernels::Axpy (-alpha, Up + (int64_t) i * ld, uk, n);
+			}
+
+			Kernels::Project (Pp + (int64_t) k * ld, ld, s - k, gk, c, n);
+
+			for (int i = k; i < s; ++i)
+				Ms (i, k) = c[i - k];
+
+			++id_iterations;
+
+			if (Ms (k, k) == 0)
+				break;	// breakdown, P is orthogonal to gk
+
+			double beta = f[k] / Ms (k, k);
+
+			Kernels::Axpy (-beta, gk, r, n);
+			Kernels::Axpy (beta, uk, xp, n);
+			recurred = true;
+			rnorm = sqrt (Kernels::Dot (r, r, n));
+
+			for (int i = k + 1; i < s; ++i)
+				f[i] -= beta * Ms (i, k);
+		}
+
+		if (rnorm <= halt)
+			continue;
+
+		// dimension reduction, into the next subspace
+		if (id_M)
+			precondition (r, z);
+		else
+			Kernels::Copy (r, z, n);
+
+		multiply (z, t);
+
+		double tt = Kernels::Dot (t, t, n);
+		double tr = Kernels::Dot (t, r, n);
+
+		if (tr == 0 || tt == 0)
+			break;	// stagnation, t is orthogonal to r
+
+		omega = tr / tt;
+
+		Kernels::Axpy (-omega, t, r, n);
+		Kernels::Axpy (omega, z, xp, n);
+		rnorm = sqrt (Kernels::Dot (r, r, n));
+
+		++id_iterations;
+		++id_stats.ss_iterations;
+	}
+
+	// the limit can fall on a recurred r, report the true one
+	if (recurred)
+	{
+		multiply (xp, r);
+		Kernels::Xpby (b.raw (), -1.0, r, n);
+		rnorm = sqrt (Kernels::Dot (r, r, n));
+	}
+
+	id_residual = (bnorm > 0 ? rnorm / bnorm : rnorm);
+	id_stats.ss_steps = id_iterations;
+	id_stats.ss_total = SolverStats_t::Now () - start;
+
+	return (rnorm <= halt);
+}
+
+#endif // header inclusion
@@ -32,10 +32,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <float.h>
 
 #include <ConjugateGradient.h> // defines typedef Matrix_t<double> Md_t
+#include <PCG.h>
+#include <PipelinedCG.h>
+#include <Relaxation.h>
 
 int __DIM = 1000;
 
 void run ();
+void sparse ();
+void operators ();
 Md_t BuildPDM (void);
 
 int main (int argc, char *argv[])
@@ -72,6 +77,8 @@ int main (int argc, char *argv[])
 	srand (seed);
 
 	run ();
+	sparse ();
+	operators ();
 
 	return 0;
 }
@@ -95,7 +102,10 @@ void run ()
 	assert (__b.equal_eps (b, 1e-8));
 
 	ConjugateGrad_t CG (A, b);
+
+	clock_t start = clock ();
 	CG.Compute ();
+	clock_t end = clock ();
 
 	Md_t _x = CG.Answer ();
 
@@ -103,6 +113,10 @@ void run ()
 		(A * _x - b).vec_magnitude (),
 		(A * _x - b).vec_magnitude () / b.vec_magnitude (),
 		(_x - x).vec_magnitude () / x.vec_magnitude ());
+
+	printf ("CG:\t%d steps, %.4f s (cpu)\n",
+		CG.cg_step,
+		(double) (end - start) / CLOCKS_PER_SEC);
 }
 
 /*
@@ -126,3 +140,349 @@ Md_t BuildPDM (void)
 	return A;
 }
 
+
+/*
+ * PCG on a sparse SPD matrix too large to hold densely: a 5 point
+ * Laplacian with the rows scaled (so Jacobi has something to do), with
+ * each preconditioner.
+ *
+ */
+void sparse ()
+{
+	int side = 300;
+	int n = side * side;
+	SparseMatrix::Triplets_t T (n, n);
+	std::vector<double> scale (n);
+
+	for (int i = 0; i < n; ++i)
+		scale[i] = 1 + rand () % 100;
+
+	for (int r = 0; r < side; ++r)
+		for (int c = 0; c < side; ++c)
+		{
+			int i = r * side + c;
+			int neighbour[] = {i - side, i + side, i - 1, i + 1};
+			bool inside[] = {r > 0, r < side - 1, c > 0, c < side - 1};
+
+			T.Add (i, i, 4 * scale[i]);
+
+			// D^½ L D^½ keeps the matrix symmetric
+			for (int k = 0; k < 4; ++k)
+				if (inside[k])
+					T.Add (i, neighbour[k], -sqrt (scale[i] * scale[neighbour[k]]));
+		}
+
+	Ms_t A (T);
+	Md_t b (n, 1);
+	Md_t r (n, 1);
+
+	b.randomly_fill (1.0);
+
+	SparseMatrix::Jacobi_t J (A);
+	SparseMatrix::SSOR_t S (A, 1.5);
+	SparseMatrix::IC0_t I (A);
+	Mp_t *M[] = {0, &J, &S, &I};
+	const char *name[] = {"none", "Jacobi", "SSOR", "IC(0)"};
+	int iterations[4];
+
+	for (int p = 0; p < 4; ++p)
+	{
+		PCG_t CG = (M[p] ? PCG_t (A, *M[p]) : PCG_t (A));
+		Md_t x (n, 1, 0.0);
+
+		CG.SetTolerance (1e-10);
+		CG.SetMaxIterations (5000);
+
+		clock_t start = clock ();
+		bool converged = CG.Solve (b, x);
+		clock_t end = clock ();
+
+		assert (converged);
+
+		MatrixVectorProduct (A, x, r);
+		r = r - b;
+		assert (r.vec_magnitude () <= 1.1e-10 * b.vec_magnitude ());
+
+		iterations[p] = CG.GetIterations ();
+
+		printf ("PCG (%s):\t%d unknowns, %d iterations, |r|/|b| = %e, %.3f s (cpu)\n",
+			name[p],
+			n,
+			CG.GetIterations (),
+			CG.GetResidual (),
+			(double) (end - start) / CLOCKS_PER_SEC);
+	}
+
+	assert (iterations[3] < iterations[1] && iterations[1] < iterations[0]);
+
+	/*
+	 * x is written in place, it must not write through to what it shares
+	 * storage with: b itself as the guess, or a guess kept for later.
+	 *
+	 */
+	{
+		PCG_t CG (A, I);
+		Md_t b_save (n, 1);
+		Md_t guess (n, 1, 0.0);
+		Md_t x = b;
+		Md_t y = guess;
+
+		b_save.pipe (b);
+		CG.SetTolerance (1e-10);
+
+		assert (CG.Solve (b, x));
+		assert (b.equal_eps (b_save, 0.0));
+
+		MatrixVectorProduct (A, x, r);
+		r = r - b;
+		assert (r.vec_magnitude () <= 1.1e-10 * b.vec_magnitude ());
+
+		assert (CG.Solve (b, y));
+		assert (guess.vec_magnitude () == 0);
+	}
+
+	// and the pipelined variant
+	{
+		PipelinedCG_t CG (A, S);
+		Md_t b_save (n, 1);
+		Md_t guess (n, 1, 0.0);
+		Md_t x = b;
+		Md_t y = guess;
+
+		b_save.pipe (b);
+		CG.SetTolerance (1e-10);
+		CG.SetMaxIterations (5000);
+
+		assert (CG.Solve (b, x));
+		assert (b.equal_eps (b_save, 0.0));
+
+		MatrixVectorProduct (A, x, r);
+		r = r - b;
+		assert (r.vec_magnitude () <= 1.1e-10 * b.vec_magnitude ());
+
+		assert (CG.Solve (b, y));
+		assert (guess.vec_magnitude () == 0);
+	}
+
+	// pipelined, should track PCG's iteration count closely
+	for (int p = 0; p < 3; ++p)
+	{
+		PipelinedCG_t CG = (M[p] ? PipelinedCG_t (A, *M[p]) : PipelinedCG_t (A));
+		Md_t x (n, 1, 0.0);
+
+		CG.SetTolerance (1e-10);
+		CG.SetMaxIterations (5000);
+
+		clock_t start = clock ();
+		bool converged = CG.Solve (b, x);
+		clock_t end = clock ();
+
+		assert (converged);
+		assert (CG.GetIterations () < 1.2 * iterations[p] + 10);
+
+		MatrixVectorProduct (A, x, r);
+		r = r - b;
+		assert (r.vec_magnitude () <= 1.1e-10 * b.vec_magnitude ());
+
+		printf ("Pipelined (%s):\t%d iterations, %d replacements, |r|/|b| = %e, %.3f s (cpu)\n",
+			name[p],
+			CG.GetIterations (),
+			CG.GetReplacements (),
+			CG.GetResidual (),
+			(double) (end - start) / CLOCKS_PER_SEC);
+	}
+}
+
+/*
+ * The 5 point Laplacian on a side x side grid, never stored.  A functor
+ * so MatrixFree_t inlines it.
+ *
+ */
+struct Laplacian_t
+{
+	int			lp_side;
+
+	void operator() (const double *x, double *y) const
+	{
+		int side = lp_side;
+
+#pragma omp parallel for schedule(static)
+		for (int r = 0; r < side; ++r)
+			for (int c = 0; c < side; ++c)
+			{
+				int i = r * side + c;
+				double sum = 4 * x[i];
+
+				if (r > 0)
+					sum -= x[i - side];
+				if (r < side - 1)
+					sum -= x[i + side];
+				if (c > 0)
+					sum -= x[i - 1];
+				if (c < side - 1)
+					sum -= x[i + 1];
+
+				y[i] = sum;
+			}
+	}
+};
+
+/*
+ * The solvers on operators that are not CSR: a stencil, a dense matrix
+ * and a lambda, each checked against the stored equivalent.
+ *
+ */
+void operators ()
+{
+	int side = 300;
+	int n = side * side;
+	SparseMatrix::Triplets_t T (n, n);
+
+	for (int r = 0; r < side; ++r)
+		for (int c = 0; c < side; ++c)
+		{
+			int i = r * side + c;
+
+			T.Add (i, i, 4);
+
+			if (r > 0)
+				T.Add (i, i - side, -1);
+			if (r < side - 1)
+				T.Add (i, i + side, -1);
+			if (c > 0)
+				T.Add (i, i - 1, -1);
+			if (c < side - 1)
+				T.Add (i, i + 1, -1);
+		}
+
+	Ms_t A (T);
+	Laplacian_t L = {side};
+	SparseMatrix::MatrixFree_t<Laplacian_t> S (n, n, L, L);	// symmetric
+	Mo_t *op[] = {&A, &S};
+	const char *name[] = {"CSR", "stencil"};
+	int iterations[2];
+	Md_t b (n, 1);
+	Md_t r (n, 1);
+
+	b.randomly_fill (1.0);
+
+	for (int o = 0; o < 2; ++o)
+	{
+		PCG_t CG (*op[o]);
+		Md_t x (n, 1, 0.0);
+
+		CG.SetTolerance (1e-10);
+		CG.SetMaxIterations (5000);
+
+		clock_t start = clock ();
+		bool converged = CG.Solve (b, x);
+		clock_t end = clock ();
+
+		assert (converged);
+
+		// against the stored matrix
+		MatrixVectorProduct (A, x, r);
+		r = r - b;
+		assert (r.vec_magnitude () <= 1.1e-10 * b.vec_magnitude ());
+
+		iterations[o] = CG.GetIterations ();
+
+		printf ("PCG (%s):\t%d iterations, |r|/|b| = %e, %.3f s (cpu)\n",
+			name[o],
+			CG.GetIterations (),
+			CG.GetResidual (),
+			(double) (end - start) / CLOCKS_PER_SEC);
+	}
+
+	// the same products up to the order of summation
+	assert (abs (iterations[0] - iterations[1]) <= 2);
+
+	Md_t y (n, 1);
+	Md_t z (n, 1);
+
+	TransposeVectorProduct (S, b, y);
+	TransposeVectorProduct (A, b, z);
+	assert (y.equal_eps (z, 1e-12));
+
+	/*
+	 * A lambda, A + I without forming it, which has no transpose.
+	 *
+	 */
+	SparseMatrix::MatrixFree_t shifted (n, n, [&A, n] (const double *x, double *y) {
+		A.Multiply (1.0, x, 0.0, y);
+		Kernels::Axpy (1.0, x, y, n);
+	});
+	PCG_t CG (shifted);
+	Md_t x (n, 1, 0.0);
+
+	CG.SetTolerance (1e-10);
+	assert (CG.Solve (b, x));
+
+	MatrixVectorProduct (A, x, r);
+	r = r + x - b;
+	assert (r.vec_magnitude () <= 1.1e-10 * b.vec_magnitude ());
+
+	bool thrown = false;
+
+	try
+	{
+		TransposeVectorProduct (shifted, b, y);
+	}
+	catch (const char *)
+	{
+		thrown = true;
+	}
+
+	assert (thrown);
+
+	printf ("PCG (lambda, A + I):\t%d iterations\n", CG.GetIterations ());
+
+	/*
+	 * ConjugateGrad_t on a dense matrix behind the operator interface,
+	 * against its own fused dense path.
+	 *
+	 */
+	Md_t D = BuildPDM ();
+	Md_t d (__DIM, 1);
+
+	d.randomly_fill (__DIM);
+
+	SparseMatrix::DenseOperator_t O (D);
+	ConjugateGrad_t fused (D, d);
+	ConjugateGrad_t generic (O, d);
+
+	fused.Compute ();
+	generic.Compute ();
+
+	Md_t xf = fused.Answer ();
+	Md_t xg = generic.Answer ();
+
+	assert ((xf - xg).vec_magnitude () <= 1e-8 * xf.vec_magnitude ());
+	assert ((D * xg - d).vec_magnitude () <= 1e-8 * d.vec_magnitude ());
+
+	Md_t t (__DIM, 1);
+	Md_t u = D.transpose () * d;
+
+	TransposeVectorProduct (O, d, t);
+	assert ((t - u).vec_magnitude () <= 1e-12 * u.vec_magnitude ());
+
+	// y = αWx + βy over several blocks of rows, the last one short
+	Md_t W (2500, 40);
+	Md_t w (40, 1);
+	Md_t v (2500, 1);
+
+	W.randomly_fill (1.0);
+	w.randomly_fill (1.0);
+	v.randomly_fill (1.0);
+
+	Md_t expect = 2.0 * (W * w) + 0.5 * v;
+	SparseMatrix::DenseOperator_t R (W);
+
+	v.copy ();
+	R.Multiply (2.0, w.raw (), 0.5, v.raw ());
+	assert ((v - expect).vec_magnitude () <= 1e-12 * expect.vec_magnitude ());
+
+	printf ("CG (dense operator):\t%d steps, fused %d steps\n",
+		generic.cg_step,
+		fused.cg_step);
+}
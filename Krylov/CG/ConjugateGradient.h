@@ -30,18 +30,29 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #define __DEBUG
 #include <matrix.h>
+#include <Kernels.h>
+#include <SparseOperator.h>
 
 typedef Matrix_t<double> Md_t;
 
+/*
+ * A is dense, or any SparseOperator_t (sparse, DenseOperator_t or
+ * matrix free).  The dense case keeps the product fused with the
+ * direction update; an operator forms p first and fuses p·Ap instead.
+ *
+ */
+
 struct ConjugateGrad_t
 {
 	// Ax = b, the problem, immutable
 	Md_t			cg_A;
+	SparseMatrix::SparseOperator_t	*cg_Op;		// instead of cg_A
 	Md_t			cg_b;
 
 	Md_t			cg_x;			// The answer (so far)
 	Md_t			cg_r;			// The residual
 	Md_t			cg_p;			// The search direction
+	Md_t			cg_w;			// A p
 
 	double			cg_rho;			// rho_i
 	double			cg_rhoMinus;	// rho_i - 1
@@ -53,6 +64,7 @@ public:
 
 	ConjugateGrad_t (Md_t &A, Md_t &b) :
 		cg_A (A),
+		cg_Op (0),
 		cg_b (b),
 		cg_halt (MACH_EPS * cg_b.vec_magnitude ()),
 		cg_step (0)
@@ -62,10 +74,35 @@ public:
 
 	ConjugateGrad_t (Md_t &A, Md_t &b, double halt) :
 		cg_A (A),
+		cg_Op (0),
+		cg_b (b),
+		cg_halt (halt),
+		cg_step (0)
+	{
+		Reset ();
+	}
+
+	ConjugateGrad_t (SparseMatrix::SparseOperator_t &A, Md_t &b) :
+		cg_Op (&A),
+		cg_b (b),
+		cg_halt (MACH_EPS * cg_b.vec_magnitude ()),
+		cg_step (0)
+	{
+		if (A.rows () != A.columns () || A.rows () != b.rows ())
+			throw ("CG: dimension mismatch");
+
+		Reset ();
+	}
+
+	ConjugateGrad_t (SparseMatrix::SparseOperator_t &A, Md_t &b, double halt) :
+		cg_Op (&A),
 		cg_b (b),
 		cg_halt (halt),
 		cg_step (0)
 	{
+		if (A.rows () != A.columns () || A.rows () != b.rows ())
+			throw ("CG: dimension mismatch");
+
 		Reset ();
 	}
 
@@ -73,16 +110,36 @@ public:
 	{
 	}
 
+	/*
+	 * The vectors are allocated here, once.  The iteration then works
+	 * in place on them, so x is unshared (copy-on-write) first.
+	 *
+	 */
 	void Reset (void)
 	{
+		int n = cg_b.rows ();
+
 		cg_x = cg_b;
-		cg_r = cg_b - cg_A * cg_x;
+		cg_x.copy ();
+		cg_p = Md_t (n, 1, 0.0);
+		cg_w = Md_t (n, 1);
+
+		if (cg_Op)
+		{
+			cg_r = Md_t (n, 1);
+			cg_r.pipe (cg_b);
+			cg_Op->Multiply (-1.0, cg_x.raw (), 1.0, cg_r.raw ());
+		}
+		else
+			cg_r = cg_b - cg_A * cg_x;
+
 		cg_rho = cg_r.vec_dotT ();
+		cg_step = 0;
 	}
 
 	void Compute (void)
 	{
-		int N = cg_A.rows () - 1;
+		int N = cg_b.rows () - 1;
 
 		for (int i = 0; i < N && cg_halt < sqrt (cg_rho); ++i)
 			Step ();
@@ -91,32 +148,53 @@ public:
 	/*
 	 * Algorithm 11.3.8, GVL 4th edition (page 635)
 	 *
+	 * Two sweeps and no allocation: the p update is folded into the
+	 * product w = Ap (each p_j is formed as column j needs it), and the
+	 * x and r updates into the computation of ρ = |r|².
+	 *
 	 */
 	void Step (void)
 	{
-		++cg_step; 
+		int n = cg_b.rows ();
+		double tau = (cg_step ? cg_rho / cg_rhoMinus : 0.0);	// p = r first
 
-		if (cg_step == 1)
-
-			cg_p = cg_r;
+		++cg_step; 
 
-		else {
+		double pw;
 
-			double tau = cg_rho / cg_rhoMinus;
-			cg_p = cg_r + tau * cg_p;
+		if (cg_Op)
+		{
+			Kernels::Xpby (cg_r.raw (), tau, cg_p.raw (), n);
+			pw = cg_Op->MultiplyDot (cg_p.raw (), cg_w.raw ());
 		}
+		else
+			pw = Kernels::DirectionProduct (cg_A.raw (),
+											cg_A.stride (),
+											cg_r.raw (),
+											tau,
+											cg_p.raw (),
+											cg_w.raw (),
+											n);
+
+		double mu = cg_rho / pw;
 
-		Md_t w = cg_A * cg_p;
-		double mu = cg_rho / cg_p.vec_dot (w);
-		cg_x = cg_x + mu * cg_p;
-		cg_r = cg_r - mu * w;
 		cg_rhoMinus = cg_rho;
-		cg_rho = cg_r.vec_dotT ();
+		cg_rho = Kernels::Update (mu,
+								cg_p.raw (),
+								cg_w.raw (),
+								cg_x.raw (),
+								cg_r.raw (),
+								n);
 	}
 
+	// a copy, the iteration keeps writing to cg_x
 	Md_t Answer (void)
 	{
-		return cg_x;
+		Md_t x = cg_x;
+
+		x.copy ();
+
+		return x;
 	}
 };
 
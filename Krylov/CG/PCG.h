@@ -0,0 +1,195 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_PCG__H__
+#define __DJS_PCG__H__
+
+#include <math.h>
+
+#include <Krylov.h>
+
+/*
+ * Preconditioned conjugate gradient (Saad, algorithm 9.1, Iterative
+ * Methods for Sparse Linear Systems) for symmetric positive definite A,
+ * any storage format, and a symmetric positive definite preconditioner
+ * (Jacobi_t, SSOR_t, IC0_t).  Without one M = I and it is plain CG.
+ *
+ * Iteration stops when |r| <= tolerance |b| or after the maximum
+ * number of iterations (default: the dimension, when CG would have
+ * terminated in exact arithmetic).
+ *
+ * The vectors are allocated once.  An iteration is the product fused with
+ * p·Ap, the x and r updates fused with |r|², the preconditioner and r·z,
+ * and the p update: the least memory traffic the recurrences allow.
+ *
+ */
+
+class PCG_t
+{
+	Mo_t			&pc_A;
+	Mp_t			*pc_M;
+	double			pc_tolerance;
+	int				pc_maxIterations;
+	int				pc_iterations;
+	double			pc_residual;		// |r| / |b| on return
+
+public:
+
+	PCG_t (Mo_t &A) :
+		pc_A (A),
+		pc_M (0),
+		pc_tolerance (1e-8),
+		pc_maxIterations (A.rows ()),
+		pc_iterations (0),
+		pc_residual (0)
+	{
+		if (A.rows () != A.columns ())
+			throw ("PCG: matrix not square");
+	}
+
+	PCG_t (Mo_t &A, Mp_t &M) :
+		pc_A (A),
+		pc_M (&M),
+		pc_tolerance (1e-8),
+		pc_maxIterations (A.rows ()),
+		pc_iterations (0),
+		pc_residual (0)
+	{
+		if (A.rows () != A.columns () || M.rows () != A.rows ())
+			throw ("PCG: dimension mismatch");
+	}
+
+	~PCG_t (void)
+	{
+	}
+
+	// relative: stop when |r| <= relative |b|
+	void SetTolerance (double relative)
+	{
+		pc_tolerance = relative;
+	}
+
+	void SetMaxIterations (int iterations)
+	{
+		pc_maxIterations = iterations;
+	}
+
+	int GetIterations (void) const
+	{
+		return pc_iterations;
+	}
+
+	double GetResidual (void) const
+	{
+		return pc_residual;
+	}
+
+	/*
+	 * x holds the initial guess and on return the solution.  Returns
+	 * true if the tolerance was met.
+	 *
+	 */
+	bool Solve (Md_t &b, Md_t &x)
+	{
+		int n = pc_A.rows ();
+
+		assert (b.rows () == n && x.rows () == n);
+		assert (b.columns () == 1 && x.columns () == 1);
+
+		Md_t R (n, 1);
+		Md_t Z (n, 1);
+		Md_t P (n, 1);
+		Md_t Q (n, 1);
+
+		x.copy ();	// written in place, x may share with b or the guess
+
+		double *r = R.raw ();
+		double *z = (pc_M ? Z.raw () : r);
+		double *p = P.raw ();
+		double *q = Q.raw ();
+		double *xp = x.raw ();
+		double bnorm = sqrt (Kernels::Dot (b.raw (), b.raw (), n));
+		double halt = pc_tolerance * bnorm;
+
+		// r = b - Ax
+		MatrixVectorProduct (pc_A, x, R);
+		Kernels::Xpby (b.raw (), -1.0, r, n);
+
+		double rnorm = sqrt (Kernels::Dot (r, r, n));
+
+		pc_iterations = 0;
+
+		if (rnorm <= halt)
+		{
+			pc_residual = (bnorm > 0 ? rnorm / bnorm : 0);
+			return true;
+		}
+
+		if (pc_M)
+			pc_M->Apply (r, z);
+
+		Kernels::Copy (z, p, n);
+
+		double rz = Kernels::Dot (r, z, n);
+
+		while (pc_iterations < pc_maxIterations)
+		{
+			++pc_iterations;
+
+			double pq = pc_A.MultiplyDot (p, q);
+
+			if (!(pq > 0))
+				break;	// A (or M) is not positive definite
+
+			double alpha = rz / pq;
+			double rr = Kernels::Update (alpha, p, q, xp, r, n);
+
+			rnorm = sqrt (rr);
+			if (rnorm <= halt)
+				break;
+
+			double rzNext = rr;
+
+			if (pc_M)
+			{
+				pc_M->Apply (r, z);
+				rzNext = Kernels::Dot (r, z, n);
+			}
+
+			double beta = rzNext / rz;
+
+			rz = rzNext;
+			Kernels::Xpby (z, beta, p, n);
+		}
+
+		pc_residual = (bnorm > 0 ? rnorm / bnorm : rnorm);
+
+		return (rnorm <= halt);
+	}
+};
+
+#endif // header inclusion
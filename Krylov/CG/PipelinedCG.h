@@ -0,0 +1,307 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_PIPELINED_CG__H__
+#define __DJS_PIPELINED_CG__H__
+
+#include <math.h>
+
+#include <Krylov.h>
+
+/*
+ * Pipelined preconditioned CG (Ghysels and Vanroose, "Hiding global
+ * synchronization latency in the preconditioned Conjugate Gradient
+ * algorithm", algorithm 4).
+ *
+ * PCG has two reductions per iteration (p·Ap and r·z), each a barrier
+ * that every thread waits on, separated by the vector updates.  Here
+ * recurrences for w = Au, s = Ap, z = As (and with M, u = M⁻¹r and
+ * q = M⁻¹s) make all of the inner products of an iteration independent
+ * of its product, so
+ *
+ * (i) γ = r·u, δ = w·u and |r|² are one reduction, and
+ * (ii) it is fused into the sweep that updates the vectors, the next
+ * product and preconditioner then run with the scalars already known.
+ *
+ * An iteration is one product, one preconditioner application and one
+ * sweep with one barrier, against PCG's three.  The price is four more
+ * vectors and rounding error that accumulates in the recurrences, so
+ * every SetReplacement () iterations (and before declaring convergence)
+ * the recurred vectors are replaced by their true values.
+ *
+ */
+
+class PipelinedCG_t
+{
+	Mo_t			&pl_A;
+	Mp_t			*pl_M;
+	double			pl_tolerance;
+	int				pl_maxIterations;
+	int				pl_replacement;
+	int				pl_iterations;
+	int				pl_replaced;
+	double			pl_residual;	// |r| / |b| on return
+
+public:
+
+	PipelinedCG_t (Mo_t &A) :
+		pl_A (A),
+		pl_M (0),
+		pl_tolerance (1e-8),
+		pl_maxIterations (A.rows ()),
+		pl_replacement (50),
+		pl_iterations (0),
+		pl_replaced (0),
+		pl_residual (0)
+	{
+		if (A.rows () != A.columns ())
+			throw ("pipelined CG: matrix not square");
+	}
+
+	PipelinedCG_t (Mo_t &A, Mp_t &M) :
+		pl_A (A),
+		pl_M (&M),
+		pl_tolerance (1e-8),
+		pl_maxIterations (A.rows ()),
+		pl_replacement (50),
+		pl_iterations (0),
+		pl_replaced (0),
+		pl_residual (0)
+	{
+		if (A.rows () != A.columns () || M.rows () != A.rows ())
+			throw ("pipelined CG: dimension mismatch");
+	}
+
+	~PipelinedCG_t (void)
+	{
+	}
+
+	// relative: stop when |r| <= relative |b|
+	void SetTolerance (double relative)
+	{
+		pl_tolerance = relative;
+	}
+
+	void SetMaxIterations (int iterations)
+	{
+		pl_maxIterations = iterations;
+	}
+
+	// iterations between residual replacements, 0 for none
+	void SetReplacement (int period)
+	{
+		pl_replacement = period;
+	}
+
+	int GetIterations (void) const
+	{
+		return pl_iterations;
+	}
+
+	int GetReplacements (void) const
+	{
+		return pl_replaced;
+	}
+
+	double GetResidual (void) const
+	{
+		return pl_residual;
+	}
+
+	bool Solve (Md_t &b, Md_t &x);
+};
+
+/*
+ * x holds the initial guess and on return the solution.  Returns true if
+ * the tolerance was met (by the true residual).
+ *
+ */
+bool
+PipelinedCG_t::Solve (Md_t &b, Md_t &x)
+{
+	int n = pl_A.rows ();
+
+	assert (b.rows () == n && x.rows () == n);
+	assert (b.columns () == 1 && x.columns () == 1);
+
+	bool M = (pl_M != 0);
+	Md_t V (n, M ? 9 : 6);
+	double *r = V.raw ();
+	double *w = r + (int64_t) 1 * V.stride ();
+	double *p = r + (int64_t) 2 * V.stride ();
+	double *s = r + (int64_t) 3 * V.stride ();
+	double *z = r + (int64_t) 4 * V.stride ();
+	double *nv = r + (int64_t) 5 * V.stride ();	// A m
+	double *u = (M ? r + (int64_t) 6 * V.stride () : r);
+	double *q = (M ? r + (int64_t) 7 * V.stride () : s);
+	double *m = (M ? r + (int64_t) 8 * V.stride () : w);
+	double *xp;
+	const double *bp = b.raw ();
+	double bnorm = sqrt (Kernels::Dot (bp, bp, n));
+	double halt = pl_tolerance * bnorm;
+	double gamma = 0, delta = 0, rr = 0;
+	double gammaLast = 0, alpha = 0, beta = 0;
+	bool first = true;
+
+	x.copy ();	// written in place, x may share with b or the guess
+	xp = x.raw ();
+
+	pl_iterations = 0;
+	pl_replaced = 0;
+
+	/*
+	 * r = b - Ax, u = M⁻¹r, w = Au, and if the direction exists its
+	 * images s = Ap, q = M⁻¹s, z = Aq.  At the start, and to replace
+	 * the recurred values.
+	 *
+	 */
+	auto Replace = [&] (bool direction) {
+		pl_A.Multiply (1.0, xp, 0.0, r);
+		Kernels::Xpby (bp, -1.0, r, n);
+
+		if (M)
+			pl_M->Apply (r, u);
+
+		pl_A.Multiply (1.0, u, 0.0, w);
+
+		if (direction)
+		{
+			pl_A.Multiply (1.0, p, 0.0, s);
+
+			if (M)
+				pl_M->Apply (s, q);
+
+			pl_A.Multiply (1.0, q, 0.0, z);
+		}
+
+		gamma = Kernels::Dot (r, u, n);
+		delta = Kernels::Dot (w, u, n);
+		rr = Kernels::Dot (r, r, n);
+	};
+
+	Replace (false);
+
+	while (true)
+	{
+		if (sqrt (rr) <= halt)
+		{
+			// the recurred residual says so, the true one must agree
+			Replace (!first);
+			++pl_replaced;
+
+			if (sqrt (rr) <= halt)
+				break;
+		}
+
+		if (pl_iterations >= pl_maxIterations)
+			break;
+
+		if (pl_replacement > 0 && !first && pl_iterations % pl_replacement == 0)
+		{
+			Replace (true);
+			++pl_replaced;
+		}
+
+		++pl_iterations;
+
+		// m = M⁻¹w, n = Am: the scalars are already known
+		if (M)
+			pl_M->Apply (w, m);
+
+		pl_A.Multiply (1.0, m, 0.0, nv);
+
+		if (first)
+		{
+			beta = 0;
+			alpha = gamma / delta;
+		}
+		else
+		{
+			beta = gamma / gammaLast;
+			alpha = gamma / (delta - beta * gamma / alpha);
+		}
+
+		if (!(alpha > 0) || !isfinite (alpha))
+			break;	// A (or M) is not positive definite
+
+		first = false;
+		gammaLast = gamma;
+
+		double g = 0, d = 0, e = 0;
+
+		/*
+		 * The sweep: directions, then iterates, with the next
+		 * iteration's inner products accumulated as they are formed.
+		 *
+		 */
+		if (M)
+		{
+#pragma omp parallel for schedule(static) reduction(+:g, d, e) if(n >= __KERNEL_PARALLEL)
+			for (int i = 0; i < n; ++i)
+			{
+				z[i] = nv[i] + beta * z[i];
+				q[i] = m[i] + beta * q[i];
+				s[i] = w[i] + beta * s[i];
+				p[i] = u[i] + beta * p[i];
+				xp[i] += alpha * p[i];
+				r[i] -= alpha * s[i];
+				u[i] -= alpha * q[i];
+				w[i] -= alpha * z[i];
+				g += r[i] * u[i];
+				d += w[i] * u[i];
+				e += r[i] * r[i];
+			}
+		}
+		else
+		{
+#pragma omp parallel for schedule(static) reduction(+:d, e) if(n >= __KERNEL_PARALLEL)
+			for (int i = 0; i < n; ++i)
+			{
+				z[i] = nv[i] + beta * z[i];
+				s[i] = w[i] + beta * s[i];
+				p[i] = r[i] + beta * p[i];
+				xp[i] += alpha * p[i];
+				r[i] -= alpha * s[i];
+				w[i] -= alpha * z[i];
+				d += w[i] * r[i];
+				e += r[i] * r[i];
+			}
+
+			g = e;
+		}
+
+		gamma = g;
+		delta = d;
+		rr = e;
+	}
+
+	pl_residual = (bnorm > 0 ? sqrt (rr) / bnorm : sqrt (rr));
+
+	return (sqrt (rr) <= halt);
+}
+
+#endif // header inclusion
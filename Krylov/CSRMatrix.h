@@ -0,0 +1,907 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_CSR_MATRIX__H__
+#define __DJS_CSR_MATRIX__H__
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include <SparseOperator.h>
+
+/*
+ * Products with fewer non-zeros than this run on the calling thread, the
+ * fork/join would cost more than it saves.
+ *
+ */
+#define __CSR_PARALLEL	32768
+
+// vectors of an SpMM taken together
+#define __CSR_PANEL		8
+
+namespace SparseMatrix
+{
+
+/*
+ * Σ values[k] x[colIdx[k]] for k in [begin, end).  With AVX2 four
+ * products are gathered at once (the Makefiles pass -mavx2 -mfma, build
+ * with SIMD= for the portable loop alone).
+ *
+ */
+static inline double RowDot (const double * __restrict values,
+							const int * __restrict colIdx,
+							int64_t begin,
+							int64_t end,
+							const double * __restrict x)
+{
+	double sum = 0;
+	int64_t k = begin;
+
+#ifdef __AVX2__
+	__m256d acc = _mm256_setzero_pd ();
+	__m256d all = _mm256_castsi256_pd (_mm256_set1_epi64x (-1));
+
+	for (; k + 4 <= end; k += 4)
+	{
+		__m128i index = _mm_loadu_si128 ((const __m128i *) (colIdx + k));
+		__m256d gathered = _mm256_mask_i32gather_pd (acc, x, index, all, 8);
+		__m256d a = _mm256_loadu_pd (values + k);
+
+#ifdef __FMA__
+		acc = _mm256_fmadd_pd (a, gathered, acc);
+#else
+		acc = _mm256_add_pd (acc, _mm256_mul_pd (a, gathered));
+#endif
+	}
+
+	__m128d half = _mm_add_pd (_mm256_castpd256_pd128 (acc),
+								_mm256_extractf128_pd (acc, 1));
+
+	sum = _mm_cvtsd_f64 (_mm_add_sd (half, _mm_unpackhi_pd (half, half)));
+#endif
+
+	for (; k < end; ++k)
+		sum += values[k] * x[colIdx[k]];
+
+	return sum;
+}
+
+/*
+ * Coordinate (triplet) form, the way to build a sparse matrix.  Entries
+ * can be added in any order, duplicates are summed when the matrix is
+ * compressed (as in finite element assembly).
+ *
+ */
+
+class Triplets_t
+{
+	int					tr_rows;
+	int					tr_columns;
+
+public:
+
+	std::vector<int>	tr_row;
+	std::vector<int>	tr_column;
+	std::vector<double>	tr_datum;
+
+	Triplets_t (int rows, int columns, int64_t reserve = 0) :
+		tr_rows (rows),
+		tr_columns (columns)
+	{
+		if (rows < 0 || columns < 0)
+			throw ("Triplets: illegal dimension");
+
+		tr_row.reserve (reserve);
+		tr_column.reserve (reserve);
+		tr_datum.reserve (reserve);
+	}
+
+	int rows (void)
+	{
+		return tr_rows;
+	}
+
+	int columns (void)
+	{
+		return tr_columns;
+	}
+
+	int64_t size (void)
+	{
+		return tr_datum.size ();
+	}
+
+	void Add (int row, int column, double datum)
+	{
+		assert (row >= 0 && row < tr_rows);
+		assert (column >= 0 && column < tr_columns);
+
+		tr_row.push_back (row);
+		tr_column.push_back (column);
+		tr_datum.push_back (datum);
+	}
+
+	void clear (void)
+	{
+		tr_row.clear ();
+		tr_column.clear ();
+		tr_datum.clear ();
+	}
+};
+
+/*
+ * Compressed sparse row.  Row i occupies [cs_rowPtr[i], cs_rowPtr[i + 1])
+ * of cs_colIdx and cs_values, sorted by column, no duplicates.  The
+ * offsets are 64 bits so the number of non-zeros is not limited by the
+ * size of an int.
+ *
+ * The index and value arrays are separate so SpMV streams 12 bytes per
+ * non-zero rather than a padded 16 byte (column, datum) pair.
+ *
+ */
+
+class CSRMatrix_t : public SparseOperator_t
+{
+	int			cs_rows;
+	int			cs_columns;
+	int64_t		*cs_rowPtr;
+	int			*cs_colIdx;
+	double		*cs_values;
+
+	// set when the arrays belong to someone else (e.g. an mmap)
+	std::shared_ptr<void>	cs_owner;
+
+	/*
+	 * SpMV work split, cs_split[p] is the first row of part p.  Computed
+	 * on first use (and when the thread count changes) then reused.
+	 *
+	 */
+	int			cs_parts;
+	int			*cs_split;
+
+	/*
+	 * Aᵀx scatters each part into a private window over just the columns
+	 * its rows touch: columns [cs_low[p], cs_low[p] + width) at
+	 * cs_scatter + cs_window[p], width = cs_window[p + 1] - cs_window[p].
+	 * Built for cs_scatterParts parts, kept between calls (and left
+	 * zeroed) so repeated products neither allocate nor sweep columns a
+	 * part never writes.
+	 *
+	 */
+	int			cs_scatterParts;
+	int			*cs_low;
+	int64_t		*cs_window;
+	double		*cs_scatter;
+
+	void Allocate (int64_t nnz)
+	{
+		cs_rowPtr = new int64_t [cs_rows + 1];
+		cs_colIdx = new int [nnz];
+		cs_values = new double [nnz];
+	}
+
+	/*
+	 * Cut the rows into parts with (nearly) the same number of non-zeros,
+	 * a row count split leaves the threads owning dense rows behind.
+	 *
+	 */
+	void Partition (int parts)
+	{
+		if (parts == cs_parts)
+			return;
+
+		int64_t nnz = cs_rowPtr[cs_rows];
+
+		delete [] cs_split;
+		cs_split = new int [parts + 1];
+
+		cs_split[0] = 0;
+		for (int p = 1; p < parts; ++p)
+		{
+			int64_t target = nnz * p / parts;
+			int64_t *row = std::lower_bound (cs_rowPtr,
+											cs_rowPtr + cs_rows + 1,
+											target);
+
+			cs_split[p] = std::max ((int) (row - cs_rowPtr), cs_split[p - 1]);
+		}
+		cs_split[parts] = cs_rows;
+
+		cs_parts = parts;
+	}
+
+	void Assemble (Triplets_t &);
+
+	// not copyable, share by reference
+	CSRMatrix_t (const CSRMatrix_t &);
+	CSRMatrix_t &operator= (const CSRMatrix_t &);
+
+public:
+
+	CSRMatrix_t (Triplets_t &T) :
+		cs_rows (T.rows ()),
+		cs_columns (T.columns ()),
+		cs_parts (0),
+		cs_split (0),
+		cs_scatterParts (0),
+		cs_low (0),
+		cs_window (0),
+		cs_scatter (0)
+	{
+		Assemble (T);
+	}
+
+	/*
+	 * Uninitialised storage for nnz entries, for code that produces CSR
+	 * directly.  The caller fills in RowPtr (), ColIdx () and Values ().
+	 *
+	 */
+	CSRMatrix_t (int rows, int columns, int64_t nnz) :
+		cs_rows (rows),
+		cs_columns (columns),
+		cs_parts (0),
+		cs_split (0),
+		cs_scatterParts (0),
+		cs_low (0),
+		cs_window (0),
+		cs_scatter (0)
+	{
+		if (rows < 0 || columns < 0 || nnz < 0)
+			throw ("CSR: illegal dimension");
+
+		Allocate (nnz);
+		cs_rowPtr[0] = 0;
+	}
+
+	/*
+	 * Wrap arrays that are already in CSR form without copying them.
+	 * They are not freed, owner is released instead when the matrix is
+	 * destroyed.
+	 *
+	 */
+	CSRMatrix_t (int rows,
+				int columns,
+				int64_t *rowPtr,
+				int *colIdx,
+				double *values,
+				std::shared_ptr<void> owner) :
+		cs_rows (rows),
+		cs_columns (columns),
+		cs_rowPtr (rowPtr),
+		cs_colIdx (colIdx),
+		cs_values (values),
+		cs_owner (owner),
+		cs_parts (0),
+		cs_split (0),
+		cs_scatterParts (0),
+		cs_low (0),
+		cs_window (0),
+		cs_scatter (0)
+	{
+	}
+
+	~CSRMatrix_t (void)
+	{
+		delete [] cs_split;
+		delete [] cs_low;
+		delete [] cs_window;
+		delete [] cs_scatter;
+
+		if (cs_owner)
+			return;
+
+		delete [] cs_rowPtr;
+		delete [] cs_colIdx;
+		delete [] cs_values;
+	}
+
+	int rows (void)
+	{
+		return cs_rows;
+	}
+
+	int columns (void)
+	{
+		return cs_columns;
+	}
+
+	int64_t nnz (void)
+	{
+		return cs_rowPtr[cs_rows];
+	}
+
+	const char *Format (void)
+	{
+		return "CSR";
+	}
+
+	int64_t *RowPtr (void)
+	{
+		return cs_rowPtr;
+	}
+
+	int *ColIdx (void)
+	{
+		return cs_colIdx;
+	}
+
+	double *Values (void)
+	{
+		return cs_values;
+	}
+
+	// the index of A(row, column) in Values (), -1 if not stored
+	int64_t Find (int row, int column)
+	{
+		int *first = cs_colIdx + cs_rowPtr[row];
+		int *last = cs_colIdx + cs_rowPtr[row + 1];
+		int *p = std::lower_bound (first, last, column);
+
+		if (p == last || *p != column)
+			return -1;
+
+		return p - cs_colIdx;
+	}
+
+	// A(row, column), zero if not stored
+	double get (int row, int column)
+	{
+		int64_t k = Find (row, column);
+
+		return (k < 0 ? 0.0 : cs_values[k]);
+	}
+
+	/*
+	 * Value updates for a fixed structure (a new time step, a new Newton
+	 * iterate).  Only the values change, so everything derived from the
+	 * structure (the SpMV partition, orderings, symbolic factorisations,
+	 * preconditioner patterns) stays valid and only the numeric work is
+	 * repeated.  Writing outside the structure is an error, not fill.
+	 *
+	 */
+	void SetValue (int row, int column, double datum)
+	{
+		int64_t k = Find (row, column);
+
+		if (k < 0)
+			throw ("CSR: entry not in the structure");
+
+		cs_values[k] = datum;
+	}
+
+	void AddValue (int row, int column, double datum)
+	{
+		int64_t k = Find (row, column);
+
+		if (k < 0)
+			throw ("CSR: entry not in the structure");
+
+		cs_values[k] += datum;
+	}
+
+	void Zero (void)
+	{
+		memset (cs_values, 0, nnz () * sizeof (double));
+	}
+
+	// nnz () values in CSR order (that of Values ())
+	void SetValues (const double *values)
+	{
+		memcpy (cs_values, values, nnz () * sizeof (double));
+	}
+
+	/*
+	 * Reassembly: the values become the sum of the triplets (duplicates
+	 * summed, as when the matrix was built), entries without a triplet
+	 * become zero.
+	 *
+	 * slots caches where each triplet lands in Values ().  When it is
+	 * empty it is filled by a binary search per triplet; passed back
+	 * with triplets in the same order (the usual reassembly loop) the
+	 * update is a plain scatter.
+	 *
+	 */
+	void SetValues (Triplets_t &T, std::vector<int64_t> &slots)
+	{
+		int64_t count = T.tr_row.size ();
+		bool outside = false;
+
+		if (T.rows () != cs_rows || T.columns () != cs_columns)
+			throw ("CSR: triplets do not fit");
+
+		if ((int64_t) slots.size () != count)
+		{
+			slots.resize (count);
+
+#pragma omp parallel for schedule(static) reduction(||:outside) if(count >= __CSR_PARALLEL)
+			for (int64_t t = 0; t < count; ++t)
+			{
+				slots[t] = Find (T.tr_row[t], T.tr_column[t]);
+
+				if (slots[t] < 0)
+					outside = true;
+			}
+
+			if (outside)
+			{
+				slots.clear ();
+				throw ("CSR: entry not in the structure");
+			}
+		}
+
+		const int64_t * __restrict slot = slots.data ();
+		const double * __restrict datum = T.tr_datum.data ();
+
+		Zero ();
+
+		// summing into shared entries, so serial
+		for (int64_t t = 0; t < count; ++t)
+			cs_values[slot[t]] += datum[t];
+	}
+
+	void SetValues (Triplets_t &T)
+	{
+		std::vector<int64_t> slots;
+
+		SetValues (T, slots);
+	}
+
+	void display (const char *name = "")
+	{
+		for (int i = 0; i < cs_rows; ++i)
+		{
+			int64_t k = cs_rowPtr[i];
+
+			for (int j = 0; j < cs_columns; ++j)
+			{
+				double element = 0.0;
+
+				if (k < cs_rowPtr[i + 1] && cs_colIdx[k] == j)
+					element = cs_values[k++];
+
+				printf ("%.1f\t", element);
+			}
+
+			printf ("\n");
+		}
+	}
+
+	// dense copy
+	Md_t Copy (void)
+	{
+		Md_t A (cs_rows, cs_columns, 0.0);
+
+		for (int i = 0; i < cs_rows; ++i)
+			for (int64_t k = cs_rowPtr[i]; k < cs_rowPtr[i + 1]; ++k)
+				A (i, cs_colIdx[k]) = cs_values[k];
+
+		return A;
+	}
+
+	/*
+	 * y = αAx + βy.  Threads take the cached parts statically, part p
+	 * always goes to the same thread so its slice of y stays in that
+	 * core's cache across products.
+	 *
+	 */
+	void Multiply (double alpha, const double *x, double beta, double *y)
+	{
+		const int64_t * __restrict rowPtr = cs_rowPtr;
+		const int * __restrict colIdx = cs_colIdx;
+		const double * __restrict values = cs_values;
+		int parts = 1;
+
+#ifdef _OPENMP
+		if (nnz () >= __CSR_PARALLEL)
+			parts = omp_get_max_threads ();
+#endif
+
+		Partition (parts);
+
+		const int * __restrict split = cs_split;
+
+#pragma omp parallel for schedule(static, 1) if(parts > 1)
+		for (int p = 0; p < parts; ++p)
+		{
+			for (int i = split[p]; i < split[p + 1]; ++i)
+			{
+				double sum = RowDot (values, colIdx, rowPtr[i], rowPtr[i + 1], x);
+
+				if (beta == 0)
+					y[i] = alpha * sum;
+				else
+					y[i] = alpha * sum + beta * y[i];
+			}
+		}
+	}
+
+	double MultiplyDot (const double *x, double *y)
+	{
+		const int64_t * __restrict rowPtr = cs_rowPtr;
+		const int * __restrict colIdx = cs_colIdx;
+		const double * __restrict values = cs_values;
+		double dot = 0;
+		int parts = 1;
+
+		assert (cs_rows == cs_columns);
+
+#ifdef _OPENMP
+		if (nnz () >= __CSR_PARALLEL)
+			parts = omp_get_max_threads ();
+#endif
+
+		Partition (parts);
+
+		const int * __restrict split = cs_split;
+
+#pragma omp parallel for schedule(static, 1) reduction(+:dot) if(parts > 1)
+		for (int p = 0; p < parts; ++p)
+			for (int i = split[p]; i < split[p + 1]; ++i)
+			{
+				y[i] = RowDot (values, colIdx, rowPtr[i], rowPtr[i + 1], x);
+				dot += x[i] * y[i];
+			}
+
+		return dot;
+	}
+
+	/*
+	 * The columns touched by each part of the rows.  A row is sorted, so
+	 * its first and last entries bound it.
+	 *
+	 */
+	void Windows (int parts)
+	{
+		if (parts == cs_scatterParts)
+			return;
+
+		delete [] cs_low;
+		delete [] cs_window;
+		delete [] cs_scatter;
+
+		cs_low = new int [parts];
+		cs_window = new int64_t [parts + 1];
+
+		cs_window[0] = 0;
+		for (int p = 0; p < parts; ++p)
+		{
+			int low = cs_columns;
+			int high = 0;
+
+			for (int i = cs_split[p]; i < cs_split[p + 1]; ++i)
+				if (cs_rowPtr[i] < cs_rowPtr[i + 1])
+				{
+					low = std::min (low, cs_colIdx[cs_rowPtr[i]]);
+					high = std::max (high, cs_colIdx[cs_rowPtr[i + 1] - 1] + 1);
+				}
+
+			cs_low[p] = (low < high ? low : 0);
+			cs_window[p + 1] = cs_window[p] + (low < high ? high - low : 0);
+		}
+
+		cs_scatter = new double [cs_window[parts]] ();
+		cs_scatterParts = parts;
+	}
+
+	/*
+	 * y = αAᵀx + βy.  Row i of A scatters x[i] times its entries into y,
+	 * so threads (each taking a part of the rows) scatter into private
+	 * windows which are then summed.  Only the parts whose window holds
+	 * column j are read for y[j]: a banded or blocked matrix reduces
+	 * about one window per column whatever the thread count.
+	 *
+	 */
+	void MultiplyTranspose (double alpha, const double *x, double beta, double *y)
+	{
+		const int64_t * __restrict rowPtr = cs_rowPtr;
+		const int * __restrict colIdx = cs_colIdx;
+		const double * __restrict values = cs_values;
+		int parts = 1;
+
+#ifdef _OPENMP
+		if (nnz () >= __CSR_PARALLEL)
+			parts = omp_get_max_threads ();
+#endif
+
+		Partition (parts);
+		Windows (parts);
+
+		int columns = cs_columns;
+		const int * __restrict split = cs_split;
+		const int * __restrict low = cs_low;
+		const int64_t * __restrict window = cs_window;
+		double * __restrict scatter = cs_scatter;
+
+#pragma omp parallel for schedule(static, 1) if(parts > 1)
+		for (int p = 0; p < parts; ++p)
+		{
+			double * __restrict mine = scatter + window[p];
+			int lo = low[p];
+
+			for (int i = split[p]; i < split[p + 1]; ++i)
+			{
+				double xi = x[i];
+
+				for (int64_t k = rowPtr[i]; k < rowPtr[i + 1]; ++k)
+					mine[colIdx[k] - lo] += values[k] * xi;
+			}
+		}
+
+#pragma omp parallel for schedule(static) if(parts > 1)
+		for (int j = 0; j < columns; ++j)
+		{
+			double sum = 0;
+
+			// zeroed as it is read, ready for the next call
+			for (int p = 0; p < parts; ++p)
+				if (j >= low[p] && j - low[p] < window[p + 1] - window[p])
+				{
+					double *mine = scatter + window[p] + (j - low[p]);
+
+					sum += *mine;
+					*mine = 0;
+				}
+
+			if (beta == 0)
+				y[j] = alpha * sum;
+			else
+				y[j] = alpha * sum + beta * y[j];
+		}
+	}
+
+	/*
+	 * Y = αAX + βY (SpMM).  The vectors are taken W at a time: the panel
+	 * of X is interleaved (row major) so the W values a non-zero multiplies
+	 * are adjacent, every non-zero is then read once for all W vectors and
+	 * the fixed length loop over them stays in registers.
+	 *
+	 */
+	void MultiplyBlock (double alpha,
+						const double *X,
+						int ldx,
+						double beta,
+						double *Y,
+						int ldy,
+						int k)
+	{
+		int parts = 1;
+
+#ifdef _OPENMP
+		if (nnz () * k >= __CSR_PARALLEL)
+			parts = omp_get_max_threads ();
+#endif
+
+		Partition (parts);
+
+		std::vector<double> interleaved ((size_t) cs_columns * std::min (k, __CSR_PANEL));
+		double *Xi = interleaved.data ();
+
+		for (int c = 0; c < k; )
+		{
+			const double *Xc = X + (int64_t) c * ldx;
+			double *Yc = Y + (int64_t) c * ldy;
+
+			if (k - c >= 8)
+				Panel<8> (alpha, Xc, ldx, beta, Yc, ldy, Xi, parts), c += 8;
+			else if (k - c >= 4)
+				Panel<4> (alpha, Xc, ldx, beta, Yc, ldy, Xi, parts), c += 4;
+			else if (k - c >= 2)
+				Panel<2> (alpha, Xc, ldx, beta, Yc, ldy, Xi, parts), c += 2;
+			else
+				Multiply (alpha, Xc, beta, Yc), c += 1;
+		}
+	}
+
+private:
+
+	template <int W> void Panel (double alpha,
+								const double *X,
+								int ldx,
+								double beta,
+								double *Y,
+								int ldy,
+								double *Xi,
+								int parts)
+	{
+		const int64_t * __restrict rowPtr = cs_rowPtr;
+		const int * __restrict colIdx = cs_colIdx;
+		const double * __restrict values = cs_values;
+		const int * __restrict split = cs_split;
+		int columns = cs_columns;
+
+#pragma omp parallel if(parts > 1)
+		{
+#pragma omp for schedule(static)
+			for (int j = 0; j < columns; ++j)
+				for (int c = 0; c < W; ++c)
+					Xi[(size_t) j * W + c] = X[(int64_t) c * ldx + j];
+
+#pragma omp for schedule(static, 1)
+			for (int p = 0; p < parts; ++p)
+				for (int i = split[p]; i < split[p + 1]; ++i)
+				{
+					double sum[W];
+
+					for (int c = 0; c < W; ++c)
+						sum[c] = 0;
+
+					for (int64_t n = rowPtr[i]; n < rowPtr[i + 1]; ++n)
+					{
+						const double * __restrict xj = Xi + (size_t) colIdx[n] * W;
+						double a = values[n];
+
+						for (int c = 0; c < W; ++c)
+							sum[c] += a * xj[c];
+					}
+
+					for (int c = 0; c < W; ++c)
+					{
+						double *y = Y + (int64_t) c * ldy + i;
+
+						if (beta == 0)
+							*y = alpha * sum[c];
+						else
+							*y = alpha * sum[c] + beta * *y;
+					}
+				}
+		}
+	}
+};
+
+/*
+ * Triplets to CSR.
+ *
+ * (i) count the entries of each row and scan for the row offsets
+ * (ii) scatter the triplets (their indices) into their rows
+ * (iii) sort each row by column and sum duplicates, in triplet order so
+ *       the sums do not depend on the thread timing of (ii)
+ * (iv) squeeze out the space freed by duplicates
+ *
+ * The rows are independent in (ii) - (iv) so they are done in parallel.
+ *
+ */
+
+inline void CSRMatrix_t::Assemble (Triplets_t &T)
+{
+	int64_t size = T.size ();
+	int rows = cs_rows;
+	const int *tr_row = T.tr_row.data ();
+	const int *tr_column = T.tr_column.data ();
+	const double *tr_datum = T.tr_datum.data ();
+	int64_t *count = new int64_t [rows + 1];
+	int64_t *fill = new int64_t [rows];
+	int64_t *order = new int64_t [size];
+	int *column = new int [size];
+	double *datum = new double [size];
+
+	memset (count, 0, (rows + 1) * sizeof (int64_t));
+
+	for (int64_t k = 0; k < size; ++k)
+		++count[tr_row[k] + 1];
+
+	for (int i = 0; i < rows; ++i)
+		count[i + 1] += count[i];
+
+	memcpy (fill, count, rows * sizeof (int64_t));
+
+	// the order within a row does not matter, it is sorted below
+#pragma omp parallel for schedule(static)
+	for (int64_t k = 0; k < size; ++k)
+	{
+		int64_t slot;
+
+#pragma omp atomic capture
+		slot = fill[tr_row[k]]++;
+
+		order[slot] = k;
+	}
+
+	// fill[i] becomes the number of distinct columns in row i
+#pragma omp parallel
+	{
+		std::vector< std::pair<int, int64_t> > scratch;	// column, triplet
+
+#pragma omp for schedule(dynamic, 256)
+		for (int i = 0; i < rows; ++i)
+		{
+			int64_t first = count[i];
+			int64_t len = count[i + 1] - first;
+			int64_t distinct = 0;
+
+			scratch.resize (len);
+			for (int64_t k = 0; k < len; ++k)
+				scratch[k] = std::make_pair (tr_column[order[first + k]], order[first + k]);
+
+			// the keys are unique, the order is total
+			std::sort (scratch.begin (), scratch.end ());
+
+			for (int64_t k = 0; k < len; ++k)
+			{
+				double value = tr_datum[scratch[k].second];
+
+				if (distinct && column[first + distinct - 1] == scratch[k].first)
+				{
+					datum[first + distinct - 1] += value;
+					continue;
+				}
+
+				column[first + distinct] = scratch[k].first;
+				datum[first + distinct] = value;
+				++distinct;
+			}
+
+			fill[i] = distinct;
+		}
+	}
+
+	int64_t nnz = 0;
+
+	for (int i = 0; i < rows; ++i)
+		nnz += fill[i];
+
+	Allocate (nnz);
+
+	cs_rowPtr[0] = 0;
+	for (int i = 0; i < rows; ++i)
+		cs_rowPtr[i + 1] = cs_rowPtr[i] + fill[i];
+
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < rows; ++i)
+	{
+		memcpy (cs_colIdx + cs_rowPtr[i],
+				column + count[i],
+				fill[i] * sizeof (int));
+
+		memcpy (cs_values + cs_rowPtr[i],
+				datum + count[i],
+				fill[i] * sizeof (double));
+	}
+
+	delete [] count;
+	delete [] fill;
+	delete [] order;
+	delete [] column;
+	delete [] datum;
+}
+
+};
+
+#endif // header inclusion
@@ -0,0 +1,932 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_SPARSE_CHOLESKY__H__
+#define __DJS_SPARSE_CHOLESKY__H__
+
+#include <math.h>
+
+#include <Reorder.h>
+
+/*
+ * Subtrees of the assembly tree with fewer columns than this are factored
+ * by the thread that reaches them rather than spawned as tasks.
+ *
+ */
+#define __CHOLESKY_TASK		256
+
+// Schur complements of this order, or larger, are updated by a taskloop
+#define __CHOLESKY_SPLIT	192
+
+// columns per block of the dense panel and Schur kernels
+#define __CHOLESKY_BLOCK	32
+
+/*
+ * Sparse Cholesky, PAPᵀ = LLᵀ, by the multifrontal method.
+ *
+ * Symbolic analysis (the constructor):
+ *
+ * (i) a fill reducing ordering (nested dissection by default)
+ * (ii) the elimination tree of PAPᵀ, postordered so every subtree is a
+ * contiguous range of columns
+ * (iii) the column counts of L from the row subtrees
+ * (iv) fundamental supernodes, chains of columns with nested structure,
+ * relaxed by merging a child into its parent while the explicit zeros
+ * that adds stay few, and the row structure of each
+ *
+ * Numeric factorisation (Factor): each supernode assembles a dense
+ * frontal matrix from its columns of A and the update matrices of its
+ * children, factors its leading columns and passes the Schur complement
+ * to its parent.  The fronts are dense so the work is done by blocked
+ * kernels on contiguous memory rather than by sparse gathers.  Disjoint
+ * subtrees are independent and are factored as OpenMP tasks.
+ *
+ * The structure depends only on the structure of A, Factor can be called
+ * again when the values of A change.  A factorisation is then reused for
+ * any number of Solves.
+ *
+ * A is symmetric positive definite with both triangles stored (as
+ * assembled from Triplets_t), only the lower triangle of PAPᵀ is read.
+ * A is referenced, not copied, and must outlive the factorisation.
+ *
+ */
+
+class SparseCholesky_t
+{
+public:
+
+	enum ordering_t {
+		Natural,
+		ReverseCuthillMcKee,
+		NestedDissection
+	};
+
+private:
+
+	SparseMatrix::CSRMatrix_t	&ch_A;
+	int							ch_n;
+	std::vector<int>			ch_perm;		// perm[new] = old
+
+	// lower triangle of PAPᵀ by column, values are A.Values ()[map[k]]
+	std::vector<int64_t>		ch_colPtr;
+	std::vector<int>			ch_rowIdx;
+	std::vector<int64_t>		ch_map;
+
+	// supernode s is columns [ch_first[s], ch_first[s + 1])
+	int							ch_supernodes;
+	std::vector<int>			ch_first;
+	std::vector<int64_t>		ch_rowPtr;		// rows of L in supernode s
+	std::vector<int>			ch_rows;
+	std::vector<int>			ch_parent;		// -1 for a root
+	std::vector<int>			ch_childPtr;
+	std::vector<int>			ch_children;
+	std::vector<int>			ch_columns;		// columns in subtree s
+	std::vector<int>			ch_descendants;	// supernodes in subtree s
+
+	// L, supernode s is a dense m x w column major block at ch_Lptr[s]
+	std::vector<int64_t>		ch_Lptr;
+	std::vector<double>			ch_L;
+	bool						ch_factored;
+
+	// update matrices, waiting for their parent
+	std::vector<double *>		ch_update;
+
+	// not copyable
+	SparseCholesky_t (const SparseCholesky_t &);
+	SparseCholesky_t &operator= (const SparseCholesky_t &);
+
+	void Lower (const std::vector<int> &perm)
+	{
+		int64_t *rowPtr = ch_A.RowPtr ();
+		int *colIdx = ch_A.ColIdx ();
+		std::vector<int> inverse = SparseMatrix::Inverse (perm);
+
+		ch_colPtr.assign (ch_n + 1, 0);
+
+		for (int r = 0; r < ch_n; ++r)
+			for (int64_t k = rowPtr[r]; k < rowPtr[r + 1]; ++k)
+				if (inverse[r] >= inverse[colIdx[k]])
+					++ch_colPtr[inverse[colIdx[k]] + 1];
+
+		for (int j = 0; j < ch_n; ++j)
+			ch_colPtr[j + 1] += ch_colPtr[j];
+
+		std::vector<int64_t> next (ch_colPtr.begin (), ch_colPtr.end () - 1);
+
+		ch_rowIdx.resize (ch_colPtr[ch_n]);
+		ch_map.resize (ch_colPtr[ch_n]);
+
+		for (int r = 0; r < ch_n; ++r)
+			for (int64_t k = rowPtr[r]; k < rowPtr[r + 1]; ++k)
+			{
+				int i = inverse[r];
+				int j = inverse[colIdx[k]];
+
+				if (i >= j)
+				{
+					ch_rowIdx[next[j]] = i;
+					ch_map[next[j]++] = k;
+				}
+			}
+	}
+
+	/*
+	 * Liu's algorithm, with path compression through ancestor.  The
+	 * entries of row i left of the diagonal are the columns j of the
+	 * lower triangle with an entry in row i, taken in increasing i.
+	 *
+	 */
+	void EliminationTree (std::vector<int> &parent,
+						std::vector<int64_t> &rowPtr,
+						std::vector<int> &rowIdx)
+	{
+		std::vector<int> ancestor (ch_n, -1);
+
+		// the lower triangle by row, the transpose of ch_colPtr/ch_rowIdx
+		rowPtr.assign (ch_n + 1, 0);
+
+		for (int64_t k = 0; k < ch_colPtr[ch_n]; ++k)
+			++rowPtr[ch_rowIdx[k] + 1];
+
+		for (int i = 0; i < ch_n; ++i)
+			rowPtr[i + 1] += rowPtr[i];
+
+		std::vector<int64_t> next (rowPtr.begin (), rowPtr.end () - 1);
+		rowIdx.resize (rowPtr[ch_n]);
+
+		for (int j = 0; j < ch_n; ++j)
+			for (int64_t k = ch_colPtr[j]; k < ch_colPtr[j + 1]; ++k)
+				rowIdx[next[ch_rowIdx[k]]++] = j;
+
+		parent.assign (ch_n, -1);
+
+		for (int i = 0; i < ch_n; ++i)
+			for (int64_t k = rowPtr[i]; k < rowPtr[i + 1]; ++k)
+			{
+				int r = rowIdx[k];
+
+				if (r >= i)
+					continue;
+
+				while (ancestor[r] != -1 && ancestor[r] != i)
+				{
+					int t = ancestor[r];
+
+					ancestor[r] = i;
+					r = t;
+				}
+
+				if (ancestor[r] == -1)
+				{
+					ancestor[r] = i;
+					parent[r] = i;
+				}
+			}
+	}
+
+	/*
+	 * Whether to keep a merged supernode of w columns and m rows when
+	 * zeros of its entries are explicit zeros.  The thresholds are
+	 * CHOLMOD's: narrow supernodes tolerate many zeros, wide ones few.
+	 *
+	 */
+	static bool Relax (int64_t w, int64_t m, int64_t zeros)
+	{
+		double fraction = (double) zeros / (w * m - w * (w - 1) / 2);
+
+		return (w <= 4 ||
+				(w <= 16 && fraction < 0.8) ||
+				(w <= 48 && fraction < 0.1) ||
+				fraction < 0.05);
+	}
+
+	void Analyse (ordering_t ordering)
+	{
+		std::vector<int> perm;
+
+		switch (ordering)
+		{
+		case ReverseCuthillMcKee:
+
+			perm = SparseMatrix::ReverseCuthillMcKee (ch_A);
+			break;
+
+		case NestedDissection:
+
+			perm = SparseMatrix::NestedDissection (ch_A);
+			break;
+
+		default:
+
+			perm.resize (ch_n);
+			for (int i = 0; i < ch_n; ++i)
+				perm[i] = i;
+		}
+
+		std::vector<int> parent;
+		std::vector<int64_t> rowPtr;
+		std::vector<int> rowIdx;
+
+		Lower (perm);
+		EliminationTree (parent, rowPtr, rowIdx);
+
+		// postorder, children before parents and subtrees contiguous
+		std::vector<int> head (ch_n, -1), sibling (ch_n, -1), stack;
+		std::vector<int> post;
+
+		for (int j = ch_n - 1; j >= 0; --j)
+			if (parent[j] != -1)
+			{
+				sibling[j] = head[parent[j]];
+				head[parent[j]] = j;
+			}
+
+		post.reserve (ch_n);
+
+		for (int root = 0; root < ch_n; ++root)
+		{
+			if (parent[root] != -1)
+				continue;
+
+			stack.push_back (root);
+
+			while (!stack.empty ())
+			{
+				int j = stack.back ();
+
+				if (head[j] == -1)
+				{
+					stack.pop_back ();
+					post.push_back (j);
+				}
+				else
+				{
+					int child = head[j];
+
+					head[j] = sibling[child];
+					stack.push_back (child);
+				}
+			}
+		}
+
+		ch_perm.resize (ch_n);
+		for (int k = 0; k < ch_n; ++k)
+			ch_perm[k] = perm[post[k]];
+
+		Lower (ch_perm);
+		EliminationTree (parent, rowPtr, rowIdx);
+
+		// column counts: row i of L is the row subtree of row i of A
+		std::vector<int> count (ch_n, 1), mark (ch_n, -1), kids (ch_n, 0);
+
+		for (int i = 0; i < ch_n; ++i)
+		{
+			mark[i] = i;
+
+			for (int64_t k = rowPtr[i]; k < rowPtr[i + 1]; ++k)
+				for (int j = rowIdx[k]; mark[j] != i; j = parent[j])
+				{
+					mark[j] = i;
+					++count[j];
+				}
+
+			if (parent[i] != -1)
+				++kids[parent[i]];
+		}
+
+		// fundamental supernodes
+		std::vector<int> fundamental;
+
+		for (int j = 0; j < ch_n; ++j)
+			if (!(j > 0 &&
+				parent[j - 1] == j &&
+				count[j - 1] == count[j] + 1 &&
+				kids[j] == 1))
+				fundamental.push_back (j);
+
+		fundamental.push_back (ch_n);
+
+		/*
+		 * Relaxed amalgamation.  Every child of a fundamental supernode
+		 * hangs off its first column, and in postorder the last child
+		 * ends just before it.  Merging the two gives the child's columns
+		 * the parent's rows, explicit zeros, in return for a wider front
+		 * and one update matrix fewer.
+		 *
+		 */
+		std::vector<int64_t> height;	// rows of each merged supernode
+		int64_t zeros = 0;				// in the last one
+
+		ch_first.clear ();
+
+		for (size_t f = 0; f + 1 < fundamental.size (); ++f)
+		{
+			int first = fundamental[f];
+			int64_t w = fundamental[f + 1] - first;
+			int64_t m = count[first];
+
+			if (!ch_first.empty () && parent[first - 1] == first)
+			{
+				int64_t cw = first - ch_first.back ();
+				int64_t extra = cw * (cw + m - height.back ());
+
+				if (Relax (cw + w, cw + m, zeros + extra))
+				{
+					height.back () = cw + m;
+					zeros += extra;
+					continue;
+				}
+			}
+
+			ch_first.push_back (first);
+			height.push_back (m);
+			zeros = 0;
+		}
+
+		ch_supernodes = (int) ch_first.size ();
+		ch_first.push_back (ch_n);
+
+		std::vector<int> super (ch_n);
+
+		for (int s = 0; s < ch_supernodes; ++s)
+			for (int j = ch_first[s]; j < ch_first[s + 1]; ++j)
+				super[j] = s;
+
+		ch_parent.assign (ch_supernodes, -1);
+		ch_childPtr.assign (ch_supernodes + 1, 0);
+
+		for (int s = 0; s < ch_supernodes; ++s)
+		{
+			int last = ch_first[s + 1] - 1;
+
+			if (parent[last] != -1)
+			{
+				ch_parent[s] = super[parent[last]];
+				++ch_childPtr[ch_parent[s] + 1];
+			}
+		}
+
+		for (int s = 0; s < ch_supernodes; ++s)
+			ch_childPtr[s + 1] += ch_childPtr[s];
+
+		std::vector<int> next (ch_childPtr.begin (), ch_childPtr.end () - 1);
+		ch_children.resize (ch_childPtr[ch_supernodes]);
+		ch_columns.assign (ch_supernodes, 0);
+		ch_descendants.assign (ch_supernodes, 1);
+
+		for (int s = 0; s < ch_supernodes; ++s)
+		{
+			ch_columns[s] += ch_first[s + 1] - ch_first[s];
+
+			if (ch_parent[s] != -1)
+			{
+				ch_children[next[ch_parent[s]]++] = s;
+				ch_columns[ch_parent[s]] += ch_columns[s];
+				ch_descendants[ch_parent[s]] += ch_descendants[s];
+			}
+		}
+
+		// row structures, the union of A's columns and the children's rows
+		ch_rowPtr.assign (ch_supernodes + 1, 0);
+		ch_Lptr.assign (ch_supernodes + 1, 0);
+		ch_rows.clear ();
+		std::fill (mark.begin (), mark.end (), -1);
+
+		for (int s = 0; s < ch_supernodes; ++s)
+		{
+			int first = ch_first[s];
+			int last = ch_first[s + 1];
+			size_t start = ch_rows.size ();
+
+			for (int j = first; j < last; ++j)
+			{
+				ch_rows.push_back (j);
+				mark[j] = s;
+			}
+
+			for (int j = first; j < last; ++j)
+				for (int64_t k = ch_colPtr[j]; k < ch_colPtr[j + 1]; ++k)
+					if (mark[ch_rowIdx[k]] != s)
+					{
+						mark[ch_rowIdx[k]] = s;
+						ch_rows.push_back (ch_rowIdx[k]);
+					}
+
+			for (int c = ch_childPtr[s]; c < ch_childPtr[s + 1]; ++c)
+			{
+				int child = ch_children[c];
+				int width = ch_first[child + 1] - ch_first[child];
+
+				for (int64_t k = ch_rowPtr[child] + width; k < ch_rowPtr[child + 1]; ++k)
+					if (mark[ch_rows[k]] != s)
+					{
+						mark[ch_rows[k]] = s;
+						ch_rows.push_back (ch_rows[k]);
+					}
+			}
+
+			std::sort (ch_rows.begin () + start + (last - first), ch_rows.end ());
+
+			int64_t m = ch_rows.size () - start;
+
+			assert (m == height[s]);
+
+			ch_rowPtr[s + 1] = ch_rows.size ();
+			ch_Lptr[s + 1] = ch_Lptr[s] + m * (last - first);
+		}
+	}
+
+	/*
+	 * The dense kernels.  F is m x m, column major, only its lower
+	 * triangle is referenced.  The leading w columns are factored
+	 * (F11 = L11 L11ᵀ, L21 = F21 L11⁻ᵀ) and the trailing block is
+	 * overwritten by its Schur complement F22 - L21 L21ᵀ.
+	 *
+	 * Update is the common kernel: columns [j0, j1) of F, on and below
+	 * the diagonal, less the product of columns [k0, k1) with their own
+	 * rows [j0, j1), a rank k1 - k0 update.  Below the diagonal block two
+	 * columns of F take four columns of L at a time, so each row loads
+	 * six values and stores two for sixteen flops with the eight
+	 * multipliers held in registers.
+	 *
+	 */
+	static void Update (double * __restrict F, int m, int k0, int k1, int j0, int j1)
+	{
+		for (int j = j0; j < j1; j += 2)
+		{
+			int jb = std::min (2, j1 - j);
+
+			// the triangle on the diagonal, then an odd column whole
+			for (int c = 0; c < jb; ++c)
+			{
+				double *Fc = F + (int64_t) (j + c) * m;
+				int end = (jb == 2 ? j + jb : m);
+
+				for (int k = k0; k < k1; ++k)
+				{
+					const double *Lk = F + (int64_t) k * m;
+					double a = Lk[j + c];
+
+					for (int i = j + c; i < end; ++i)
+						Fc[i] -= a * Lk[i];
+				}
+			}
+
+			if (jb < 2)
+				continue;
+
+			double *F0 = F + (int64_t) j * m;
+			double *F1 = F0 + m;
+			int k = k0;
+
+			for (; k + 4 <= k1; k += 4)
+			{
+				const double *L0 = F + (int64_t) k * m;
+				const double *L1 = L0 + m;
+				const double *L2 = L1 + m;
+				const double *L3 = L2 + m;
+				double a00 = L0[j], a01 = L0[j + 1];
+				double a10 = L1[j], a11 = L1[j + 1];
+				double a20 = L2[j], a21 = L2[j + 1];
+				double a30 = L3[j], a31 = L3[j + 1];
+
+				for (int i = j + 2; i < m; ++i)
+				{
+					double l0 = L0[i], l1 = L1[i], l2 = L2[i], l3 = L3[i];
+
+					F0[i] -= a00 * l0 + a10 * l1 + a20 * l2 + a30 * l3;
+					F1[i] -= a01 * l0 + a11 * l1 + a21 * l2 + a31 * l3;
+				}
+			}
+
+			for (; k < k1; ++k)
+			{
+				const double *Lk = F + (int64_t) k * m;
+				double a0 = Lk[j], a1 = Lk[j + 1];
+
+				for (int i = j + 2; i < m; ++i)
+				{
+					double l = Lk[i];
+
+					F0[i] -= a0 * l;
+					F1[i] -= a1 * l;
+				}
+			}
+		}
+	}
+
+	/*
+	 * Blocked right looking: a block of __CHOLESKY_BLOCK columns is
+	 * factored a column at a time, then applied to the rest of the panel
+	 * in one Update.  The trailing block waits for Schur.
+	 *
+	 */
+	static bool Panel (double * __restrict F, int m, int w)
+	{
+		for (int k0 = 0; k0 < w; k0 += __CHOLESKY_BLOCK)
+		{
+			int k1 = std::min (w, k0 + __CHOLESKY_BLOCK);
+
+			for (int k = k0; k < k1; ++k)
+			{
+				double *Fk = F + (int64_t) k * m;
+
+				if (!(Fk[k] > 0))
+					return false;
+
+				double d = sqrt (Fk[k]);
+
+				Fk[k] = d;
+				for (int i = k + 1; i < m; ++i)
+					Fk[i] /= d;
+
+				for (int j = k + 1; j < k1; ++j)
+				{
+					double *Fj = F + (int64_t) j * m;
+					double a = Fk[j];
+
+					for (int i = j; i < m; ++i)
+						Fj[i] -= a * Fk[i];
+				}
+			}
+
+			Update (F, m, k0, k1, k1, w);
+		}
+
+		return true;
+	}
+
+	/*
+	 * F22 -= L21 L21ᵀ for columns [j0, j1) of F22.  L21 is taken
+	 * __CHOLESKY_BLOCK columns at a time so the block being read stays
+	 * in cache across the columns it updates.
+	 *
+	 */
+	static void Schur (double * __restrict F, int m, int w, int j0, int j1)
+	{
+		for (int k0 = 0; k0 < w; k0 += __CHOLESKY_BLOCK)
+			Update (F, m, k0, std::min (w, k0 + __CHOLESKY_BLOCK), j0, j1);
+	}
+
+	bool Front (int s, std::vector<int> &local)
+	{
+		int first = ch_first[s];
+		int w = ch_first[s + 1] - first;
+		const int *rows = ch_rows.data () + ch_rowPtr[s];
+		int m = (int) (ch_rowPtr[s + 1] - ch_rowPtr[s]);
+		int u = m - w;
+		const double *values = ch_A.Values ();
+		std::vector<double> front ((size_t) m * m, 0.0);
+		double *F = front.data ();
+
+		for (int r = 0; r < m; ++r)
+			local[rows[r]] = r;
+
+		for (int c = 0; c < w; ++c)
+			for (int64_t k = ch_colPtr[first + c]; k < ch_colPtr[first + c + 1]; ++k)
+				F[(int64_t) c * m + local[ch_rowIdx[k]]] += values[ch_map[k]];
+
+		// extend-add the children's update matrices
+		for (int e = ch_childPtr[s]; e < ch_childPtr[s + 1]; ++e)
+		{
+			int child = ch_children[e];
+			int cw = ch_first[child + 1] - ch_first[child];
+			const int *crows = ch_rows.data () + ch_rowPtr[child] + cw;
+			int cu = (int) (ch_rowPtr[child + 1] - ch_rowPtr[child]) - cw;
+			double *U = ch_update[child];
+
+			if (!U)
+				return false;	// the child failed
+
+			for (int c = 0; c < cu; ++c)
+			{
+				double *Fc = F + (int64_t) local[crows[c]] * m;
+				const double *Uc = U + (int64_t) c * cu;
+
+				for (int r = c; r < cu; ++r)
+					Fc[local[crows[r]]] += Uc[r];
+			}
+
+			delete [] U;
+			ch_update[child] = 0;
+		}
+
+		if (!Panel (F, m, w))
+			return false;
+
+		if (u >= __CHOLESKY_SPLIT)
+		{
+#pragma omp taskloop
+			for (int j = w; j < m; j += __CHOLESKY_BLOCK)
+				Schur (F, m, w, j, std::min (m, j + __CHOLESKY_BLOCK));
+		}
+		else
+			Schur (F, m, w, w, m);
+
+		memcpy (ch_L.data () + ch_Lptr[s], F, (size_t) m * w * sizeof (double));
+
+		if (ch_parent[s] == -1)
+			return true;
+
+		double *U = new double [(size_t) u * u];
+
+		for (int c = 0; c < u; ++c)
+			memcpy (U + (int64_t) c * u + c,
+					F + (int64_t) (w + c) * m + w + c,
+					(u - c) * sizeof (double));
+
+		ch_update[s] = U;
+
+		return true;
+	}
+
+	// a small subtree, its supernodes in (post)order on this thread
+	bool Inline (int s, std::vector< std::vector<int> > &local)
+	{
+		int thread = 0;
+		bool ok = true;
+
+#ifdef _OPENMP
+		thread = omp_get_thread_num ();
+#endif
+
+		for (int t = s - ch_descendants[s] + 1; t <= s && ok; ++t)
+			ok = Front (t, local[thread]);
+
+		return ok;
+	}
+
+	/*
+	 * The subtree rooted at s.  The tree is walked down its heaviest
+	 * children, the other children are spawned as tasks (or factored
+	 * inline when small), so the recursion is as deep as the number of
+	 * light branches rather than the height of the tree.  After the
+	 * taskwait the spine is factored bottom up.
+	 *
+	 * local maps the rows of a front to its positions, it is per thread
+	 * and only used before a front's Schur complement, where no other
+	 * task can be scheduled on the thread.
+	 *
+	 */
+	bool Subtree (int s, std::vector< std::vector<int> > &local)
+	{
+		std::vector<int> spine;
+		bool ok = true;
+
+		for (int t = s; t != -1; )
+		{
+			int heavy = -1;
+
+			spine.push_back (t);
+
+			for (int e = ch_childPtr[t]; e < ch_childPtr[t + 1]; ++e)
+				if (heavy == -1 || ch_columns[ch_children[e]] > ch_columns[heavy])
+					heavy = ch_children[e];
+
+			for (int e = ch_childPtr[t]; e < ch_childPtr[t + 1]; ++e)
+			{
+				int child = ch_children[e];
+
+				if (child == heavy)
+					continue;
+
+				if (ch_columns[child] < __CHOLESKY_TASK)
+				{
+					if (!Inline (child, local))
+						ok = false;
+
+					continue;
+				}
+
+#pragma omp task shared(ok, local)
+				{
+					if (!Subtree (child, local))
+					{
+#pragma omp atomic write
+						ok = false;
+					}
+				}
+			}
+
+			if (heavy != -1 && ch_columns[heavy] < __CHOLESKY_TASK)
+			{
+				if (!Inline (heavy, local))
+					ok = false;
+
+				heavy = -1;
+			}
+
+			t = heavy;
+		}
+
+#pragma omp taskwait
+
+		int thread = 0;
+
+#ifdef _OPENMP
+		thread = omp_get_thread_num ();
+#endif
+
+		for (int k = (int) spine.size () - 1; k >= 0 && ok; --k)
+			ok = Front (spine[k], local[thread]);
+
+		return ok;
+	}
+
+public:
+
+	SparseCholesky_t (SparseMatrix::CSRMatrix_t &A,
+					ordering_t ordering = NestedDissection) :
+		ch_A (A),
+		ch_n (A.rows ()),
+		ch_factored (false)
+	{
+		if (A.rows () != A.columns ())
+			throw ("Cholesky: matrix not square");
+
+		Analyse (ordering);
+
+		ch_L.resize (ch_Lptr[ch_supernodes]);
+		ch_update.assign (ch_supernodes, 0);
+	}
+
+	~SparseCholesky_t (void)
+	{
+		for (double *U : ch_update)
+			delete [] U;
+	}
+
+	int supernodes (void)
+	{
+		return ch_supernodes;
+	}
+
+	// entries of L, including the diagonal and the zeros relaxation adds
+	int64_t nnz (void)
+	{
+		int64_t count = 0;
+
+		for (int s = 0; s < ch_supernodes; ++s)
+		{
+			int64_t m = ch_rowPtr[s + 1] - ch_rowPtr[s];
+			int64_t w = ch_first[s + 1] - ch_first[s];
+
+			count += m * w - w * (w - 1) / 2;
+		}
+
+		return count;
+	}
+
+	const std::vector<int> &Permutation (void)
+	{
+		return ch_perm;
+	}
+
+	/*
+	 * The numeric factorisation from the current values of A.  Returns
+	 * false if A is not (numerically) positive definite.
+	 *
+	 */
+	bool Factor (void)
+	{
+		bool ok = true;
+		int threads = 1;
+
+#ifdef _OPENMP
+		threads = omp_get_max_threads ();
+#endif
+
+		std::vector< std::vector<int> > local (threads, std::vector<int> (ch_n));
+
+#pragma omp parallel
+#pragma omp single
+		{
+			for (int s = 0; s < ch_supernodes; ++s)
+			{
+				if (ch_parent[s] != -1)
+					continue;
+
+#pragma omp task shared(ok, local)
+				{
+					if (!Subtree (s, local))
+					{
+#pragma omp atomic write
+						ok = false;
+					}
+				}
+			}
+		}
+
+		for (double *&U : ch_update)
+		{
+			delete [] U;
+			U = 0;
+		}
+
+		ch_factored = ok;
+
+		return ok;
+	}
+
+	/*
+	 * Solves Ax = b for every column of b: Ly = Pb, Lᵀz = y, x = Pᵀz.
+	 *
+	 */
+	void Solve (Md_t &b, Md_t &x)
+	{
+		if (!ch_factored)
+			throw ("Cholesky: not factored");
+
+		assert (b.rows () == ch_n && x.rows () == ch_n);
+		assert (b.columns () == x.columns ());
+
+		std::vector<double> y (ch_n);
+
+		x.copy ();	// written in place, x may share with b or another
+
+		for (int c = 0; c < b.columns (); ++c)
+		{
+			const double *from = b.raw () + (int64_t) c * b.stride ();
+			double *to = x.raw () + (int64_t) c * x.stride ();
+
+			for (int i = 0; i < ch_n; ++i)
+				y[i] = from[ch_perm[i]];
+
+			for (int s = 0; s < ch_supernodes; ++s)
+			{
+				int first = ch_first[s];
+				int w = ch_first[s + 1] - first;
+				const int *rows = ch_rows.data () + ch_rowPtr[s];
+				int m = (int) (ch_rowPtr[s + 1] - ch_rowPtr[s]);
+				const double *L = ch_L.data () + ch_Lptr[s];
+
+				for (int k = 0; k < w; ++k)
+				{
+					const double *Lk = L + (int64_t) k * m;
+					double yk = (y[first + k] /= Lk[k]);
+
+					for (int r = k + 1; r < m; ++r)
+						y[rows[r]] -= Lk[r] * yk;
+				}
+			}
+
+			for (int s = ch_supernodes - 1; s >= 0; --s)
+			{
+				int first = ch_first[s];
+				int w = ch_first[s + 1] - first;
+				const int *rows = ch_rows.data () + ch_rowPtr[s];
+				int m = (int) (ch_rowPtr[s + 1] - ch_rowPtr[s]);
+				const double *L = ch_L.data () + ch_Lptr[s];
+
+				for (int k = w - 1; k >= 0; --k)
+				{
+					const double *Lk = L + (int64_t) k * m;
+					double sum = y[first + k];
+
+					for (int r = k + 1; r < m; ++r)
+						sum -= Lk[r] * y[rows[r]];
+
+					y[first + k] = sum / Lk[k];
+				}
+			}
+
+			for (int i = 0; i < ch_n; ++i)
+				to[ch_perm[i]] = y[i];
+		}
+	}
+
+	Md_t Solve (Md_t &b)
+	{
+		Md_t x (b.rows (), b.columns ());
+
+		Solve (b, x);
+
+		return x;
+	}
+};
+
+#endif // header inclusion
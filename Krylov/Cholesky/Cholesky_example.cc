@@ -0,0 +1,230 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include <assert.h>
+#include <float.h>
+
+#include <Cholesky.h> // defines typedef Matrix_t<double> Md_t
+
+using namespace SparseMatrix;
+
+void dense (void);
+void grid (void);
+
+int main (int argc, char *argv[])
+{
+	long seed = time (0);
+	char opt;
+
+	while (true)
+	{
+		opt = getopt (argc, argv, "s:");
+		if (opt == -1)
+			break;
+
+		switch (opt)
+		{
+		case 's':
+
+			seed = atol (optarg);
+			break;
+
+		default:
+
+			printf ("usage: %s [-s seed]\n", argv[0]);
+			exit (-1);
+		}
+	}
+
+	printf ("Using seed %ld\n", seed);
+
+	srand (seed);
+
+	dense ();
+	grid ();
+
+	return 0;
+}
+
+/*
+ * A random sparse SPD matrix (symmetric, diagonally dominant), solved by
+ * every ordering and by the dense Cholesky.
+ *
+ */
+void dense (void)
+{
+	int n = 300;
+	Triplets_t T (n, n);
+
+	for (int i = 0; i < n; ++i)
+	{
+		T.Add (i, i, 40);
+
+		for (int k = 0; k < 3; ++k)
+		{
+			int j = rand () % n;
+			double datum = (double) (rand () % 200 - 100) / 10;
+
+			if (j == i)
+				continue;
+
+			T.Add (i, j, datum);
+			T.Add (j, i, datum);
+		}
+	}
+
+	CSRMatrix_t A (T);
+	Md_t D = A.Copy ();
+	Md_t b (n, 2);
+	Md_t x (n, 2);
+
+	b.randomly_fill (1.0);
+
+	SparseCholesky_t::ordering_t orderings[] = {
+		SparseCholesky_t::Natural,
+		SparseCholesky_t::ReverseCuthillMcKee,
+		SparseCholesky_t::NestedDissection
+	};
+
+	for (SparseCholesky_t::ordering_t ordering : orderings)
+	{
+		SparseCholesky_t C (A, ordering);
+
+		assert (C.Factor ());
+
+		C.Solve (b, x);
+
+		Md_t r = D * x;
+		assert (r.equal_eps (b, 1e-10));
+	}
+
+	Md_t b0 = b.view (0, 0, n, 1);
+	Md_t x0 (n, 1);
+	Md_t d0 (n, 1);
+
+	SparseCholesky_t C (A);
+	assert (C.Factor ());
+	C.Solve (b0, x0);
+	assert (D.SolveSymmetric (b0, d0));
+	assert (x0.equal_eps (d0, 1e-10));
+
+	// not positive definite
+	A.Values ()[0] = -1;
+	assert (!C.Factor ());
+}
+
+/*
+ * The 5 point Laplacian, the fill of each ordering and a factorisation
+ * reused after the values change.
+ *
+ */
+void grid (void)
+{
+	int side = 250;
+	int n = side * side;
+	Triplets_t T (n, n);
+
+	for (int r = 0; r < side; ++r)
+		for (int c = 0; c < side; ++c)
+		{
+			int i = r * side + c;
+
+			T.Add (i, i, 4.01);
+
+			if (r > 0)
+				T.Add (i, i - side, -1);
+			if (r < side - 1)
+				T.Add (i, i + side, -1);
+			if (c > 0)
+				T.Add (i, i - 1, -1);
+			if (c < side - 1)
+				T.Add (i, i + 1, -1);
+		}
+
+	CSRMatrix_t A (T);
+	Md_t b (n, 1);
+	Md_t x (n, 1);
+	Md_t r (n, 1);
+
+	b.randomly_fill (1.0);
+
+	SparseCholesky_t::ordering_t orderings[] = {
+		SparseCholesky_t::ReverseCuthillMcKee,
+		SparseCholesky_t::NestedDissection
+	};
+	const char *names[] = {"RCM", "nested dissection"};
+	int64_t fill[2];
+
+	for (int o = 0; o < 2; ++o)
+	{
+		clock_t start = clock ();
+		SparseCholesky_t C (A, orderings[o]);
+		clock_t middle = clock ();
+		assert (C.Factor ());
+		clock_t end = clock ();
+
+		C.Solve (b, x);
+
+		MatrixVectorProduct (A, x, r);
+		r = r - b;
+		assert (r.vec_magnitude () < 1e-10 * b.vec_magnitude ());
+
+		fill[o] = C.nnz ();
+
+		// relaxed, the supernodes are few and wide enough to block
+		assert (C.supernodes () * 4 < n);
+
+		printf ("Cholesky (%s):\t%d unknowns, %d supernodes, %ld in L, "
+				"analyse %.3f s, factor %.3f s (cpu)\n",
+			names[o],
+			n,
+			C.supernodes (),
+			(long) C.nnz (),
+			(double) (middle - start) / CLOCKS_PER_SEC,
+			(double) (end - middle) / CLOCKS_PER_SEC);
+
+		if (o == 1)
+		{
+			// same structure, new values: x scales with 1 / 2
+			Md_t y = x;	// Solve must not write through to y
+
+			for (int64_t k = 0; k < A.nnz (); ++k)
+				A.Values ()[k] *= 2;
+
+			assert (C.Factor ());
+			C.Solve (b, x);
+
+			y = 0.5 * y;
+			assert (x.equal_eps (y, 1e-10));
+		}
+	}
+
+	assert (fill[1] < fill[0]);
+}
@@ -0,0 +1,531 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_BLOCK_GMRES__H__
+#define __DJS_BLOCK_GMRES__H__
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <random>
+#include <vector>
+
+#include <Krylov.h>
+
+// seeds the directions that replace a lost rank
+#define __BLOCK_GMRES_SEED	1
+
+/*
+ * Block GMRES (Saad, section 6.12, Iterative Methods for Sparse Linear
+ * Systems) for AX = B with p right hand sides solved together.
+ *
+ * Block Arnoldi builds AVm = Vm+1Hm where each step adds p vectors, and
+ * the product with A is a single SpMM (MultiplyBlock) that reads A once
+ * for all of them.  Hm is block Hessenberg with p subdiagonals, reduced
+ * to triangular with p Givens rotations per column as each block column
+ * is produced, so the residual of every right hand side is known at
+ * every step and the cycle ends when all are small enough.
+ *
+ * A right hand side that has converged (|r| <= tolerance |b|, checked
+ * against the true residual at each restart) leaves the block, later
+ * cycles are run on the remaining ones only.  The true residual costs
+ * one SpMM, which is cheaper than recovering it from the basis as
+ * GMRES_t does once p is more than a few.
+ *
+ * The price is orthogonalisation: a step projects p vectors onto a basis
+ * p times longer than GMRES_t's, so it pays when the products with A
+ * dominate (A much larger than cache, or many non-zeros per row).  The
+ * projections are blocked (Kernels::ProjectBlock) to read the basis
+ * once per step rather than once per right hand side.
+ *
+ * Should the block lose rank (two right hand sides the same, or one
+ * whose subspace is invariant) the lost direction is replaced by a
+ * random one, which only enlarges the subspace.
+ *
+ */
+
+class BlockGMRES_t
+{
+	Mo_t				&bg_A;
+	Md_t				bg_B;
+	Mp_t				*bg_M;			// right preconditioner, or NULL
+	int					bg_m;			// block steps per cycle
+	int					bg_restarts;
+	double				bg_tolerance;	// relative, per right hand side
+	int					bg_iterations;
+	int					bg_steps;
+	double				bg_residue;		// largest |r| / |b| last measured
+	SolverStats_t		bg_stats;
+	std::mt19937		bg_generator;	// private, rand () is the caller's
+
+	// a cycle on p right hand sides
+	int					bg_p;
+	Md_t				bg_V;			// n x (m + 1)p basis
+	Md_t				bg_H;			// (m + 1)p x mp block Hessenberg
+	Md_t				bg_G;			// (m + 1)p x p rotated RHS
+	Md_t				bg_c;			// p rotations per column of H
+	Md_t				bg_s;
+	Md_t				bg_Z;			// n x p scratch
+	std::vector<double>	bg_h;
+
+	// Y = αAX + βY, p columns
+	void multiply (double alpha, const double *X, int ldx, double beta, double *Y, int ldy, int p)
+	{
+		bg_A.MultiplyBlock (alpha, X, ldx, beta, Y, ldy, p);
+		bg_stats.ss_matvecs += p;
+	}
+
+	void precondition (double *V, int ldv, double *Z, int ldz, int p)
+	{
+		double start = SolverStats_t::Now ();
+
+		for (int l = 0; l < p; ++l)
+			bg_M->Apply (V + (int64_t) l * ldv, Z + (int64_t) l * ldz);
+
+		bg_stats.ss_precondition += SolverStats_t::Now () - start;
+		bg_stats.ss_applies += p;
+	}
+
+	void orthonormalise (int, int, double *, int);
+	void rotate (int);
+	int cycle (std::vector<int> &, std::vector<double> &, Md_t &, bool);
+
+public:
+
+	BlockGMRES_t (int m, Mo_t &A, Md_t &B, int restarts = 10) :
+		bg_A (A),
+		bg_B (B),
+		bg_M (0),
+		bg_m (m),
+		bg_restarts (restarts),
+		bg_tolerance (1e-8),
+		bg_iterations (0),
+		bg_steps (0),
+		bg_residue (0),
+		bg_generator (__BLOCK_GMRES_SEED),
+		bg_p (0)
+	{
+		if (A.rows () != A.columns () || B.rows () != A.rows ())
+			throw ("BlockGMRES: dimension mismatch");
+
+		if (m < 1)
+			throw ("BlockGMRES: illegal subspace");
+	}
+
+	~BlockGMRES_t (void)
+	{
+	}
+
+	// relative: stop when |r| <= relative |b| for every right hand side
+	void SetTolerance (double relative)
+	{
+		bg_tolerance = relative;
+	}
+
+	// M (which must outlive this) is applied from the right
+	void SetPreconditioner (Mp_t &M)
+	{
+		bg_M = &M;
+	}
+
+	int GetIterations (void) const
+	{
+		return bg_iterations;
+	}
+
+	int GetSteps (void) const
+	{
+		return bg_steps;
+	}
+
+	SolverStats_t GetStats (void) const
+	{
+		SolverStats_t stats = bg_stats;
+
+		stats.ss_iterations = bg_iterations;
+		stats.ss_steps = bg_steps;
+
+		return stats;
+	}
+
+	bool Solve (Md_t &X, double &residue);
+};
+
+/*
+ * X is the solution, residue the largest |r| / |b| over the right hand
+ * sides.  Returns true if every one met the tolerance.
+ *
+ */
+bool
+BlockGMRES_t::Solve (Md_t &X, double &residue)
+{
+	int n = bg_A.rows ();
+	int P = bg_B.columns ();
+	std::vector<int> active;
+	std::vector<double> bnorm (P);
+	double start = SolverStats_t::Now ();
+	bool rc = false;
+
+	X = Md_t (n, P, 0.0, true);
+
+	for (int l = 0; l < P; ++l)
+	{
+		double *b = bg_B.raw () + (int64_t) l * bg_B.stride ();
+
+		bnorm[l] = sqrt (Kernels::Dot (b, b, n));
+		active.push_back (l);
+	}
+
+	bg_iterations = 0;
+	bg_steps = 0;
+	bg_generator.seed (__BLOCK_GMRES_SEED);	// the same path every solve
+
+	for (;;)
+	{
+		bool last = (bg_iterations == bg_restarts);
+
+		if (cycle (active, bnorm, X, !last) == 0)
+		{
+			rc = true;
+			break;
+		}
+
+		if (last)
+			break;
+
+		++bg_iterations;
+	}
+
+	residue = bg_residue;
+	bg_stats.ss_total += SolverStats_t::Now () - start;
+
+	return rc;
+}
+
+/*
+ * One restart: the residuals of the active right hand sides, those that
+ * have converged are dropped, then (if run) a cycle of block GMRES on
+ * the rest.  Returns the number that had not converged.
+ *
+ */
+int
+BlockGMRES_t::cycle (std::vector<int> &active, std::vector<double> &bnorm, Md_t &X, bool run)
+{
+	int n = bg_A.rows ();
+	int p = active.size ();
+	int m = bg_m;
+	Md_t R (n, p);
+	Md_t Xa (n, p);
+	double *Rp = R.raw ();
+	std::vector<int> keep;
+
+	// R = B - AX for the active columns, packed
+	for (int l = 0; l < p; ++l)
+	{
+		Kernels::Copy (bg_B.raw () + (int64_t) active[l] * bg_B.stride (), Rp + (int64_t) l * n, n);
+		Kernels::Copy (X.raw () + (int64_t) active[l] * X.stride (), Xa.raw () + (int64_t) l * n, n);
+	}
+
+	multiply (-1.0, Xa.raw (), n, 1.0, Rp, n, p);
+
+	bg_residue = 0;
+
+	for (int l = 0; l < p; ++l)
+	{
+		double *r = Rp + (int64_t) l * n;
+		double rnorm = sqrt (Kernels::Dot (r, r, n));
+		double b = bnorm[active[l]];
+
+		bg_residue = fmax (bg_residue, (b > 0 ? rnorm / b : rnorm));
+
+		if (rnorm > bg_tolerance * b)
+			keep.push_back (l);
+	}
+
+	if (keep.empty () || !run)
+	{
+		std::vector<int> left;
+
+		for (size_t l = 0; l < keep.size (); ++l)
+			left.push_back (active[keep[l]]);
+
+		active = left;
+
+		return active.size ();
+	}
+
+	/*
+	 * The first block of the basis is the QR of the residuals, R is
+	 * the top of G.
+	 *
+	 */
+	p = bg_p = keep.size ();
+
+	bg_V = Md_t (n, (m + 1) * p);
+	bg_H = Md_t ((m + 1) * p, m * p, 0.0, true);
+	bg_G = Md_t ((m + 1) * p, p, 0.0, true);
+	bg_c = Md_t (p, m * p);
+	bg_s = Md_t (p, m * p);
+	bg_Z = Md_t (n, p);
+	bg_h.resize ((m + 1) * p * p);
+
+	int ldv = bg_V.stride ();
+	double *V = bg_V.raw ();
+
+	for (int l = 0; l < p; ++l)
+		Kernels::Copy (Rp + (int64_t) keep[l] * n, V + (int64_t) l * ldv, n);
+
+	orthonormalise (0, p, bg_G.raw (), bg_G.stride ());
+
+	int j;
+
+	for (j = 0; j < m; ++j)
+	{
+		double *Vj = V + (int64_t) j * p * ldv;
+		double *W = Vj + (int64_t) p * ldv;
+		bool converged = true;
+
+		if (bg_M)
+		{
+			precondition (Vj, ldv, bg_Z.raw (), n, p);
+			multiply (1.0, bg_Z.raw (), n, 0.0, W, ldv, p);
+		}
+		else
+			multiply (1.0, Vj, ldv, 0.0, W, ldv, p);
+
+		orthonormalise ((j + 1) * p, p, bg_H.raw () + (int64_t) j * p * bg_H.stride (), bg_H.stride ());
+		rotate (j);
+
+		++bg_steps;
+
+		// the residual of RHS l is the last p rows of column l of G
+		for (int l = 0; l < p && converged; ++l)
+		{
+			double rr = 0;
+
+			for (int i = (j + 1) * p; i < (j + 2) * p; ++i)
+				rr += bg_G (i, l) * bg_G (i, l);
+
+			converged = (sqrt (rr) <= bg_tolerance * bnorm[active[keep[l]]]);
+		}
+
+		if (converged)
+		{
+			++j;
+			break;
+		}
+	}
+
+	/*
+	 * Hk Y = G, Hk upper triangular, then X += M⁻¹VkY.
+	 *
+	 */
+	int k = j * p;
+	Md_t Y (k, p);
+
+	for (int l = 0; l < p; ++l)
+		for (int i = k - 1; i >= 0; --i)
+		{
+			double sum = bg_G (i, l);
+
+			for (int c = i + 1; c < k; ++c)
+				sum -= bg_H (i, c) * Y (c, l);
+
+			Y (i, l) = (bg_H (i, i) ? sum / bg_H (i, i) : 0.0);
+		}
+
+	Md_t Vk = bg_V.view (0, 0, n, k);
+	Md_t U = Vk * Y;
+	double *u = U.raw ();
+	int ldu = U.stride ();
+
+	if (bg_M)
+	{
+		precondition (u, ldu, bg_Z.raw (), n, p);
+		u = bg_Z.raw ();
+		ldu = n;
+	}
+
+	std::vector<int> left;
+
+	for (int l = 0; l < p; ++l)
+	{
+		int col = active[keep[l]];
+
+		Kernels::Axpy (1.0, u + (int64_t) l * ldu, X.raw () + (int64_t) col * X.stride (), n);
+		left.push_back (col);
+	}
+
+	active = left;
+
+	return p;
+}
+
+/*
+ * Columns [first, first + p) of V are orthonormalised against all the
+ * columns before them.  The block is projected onto the earlier blocks
+ * twice (block CGS2, so the basis is read once for all p columns), the
+ * coefficients are the block of H above the diagonal.  Then the columns
+ * of the block are orthonormalised among themselves with CGS2, which is
+ * the triangular factor of its QR.  Column l's coefficients go to
+ * h + l ldh.
+ *
+ */
+void
+BlockGMRES_t::orthonormalise (int first, int p, double *h, int ldh)
+{
+	int n = bg_A.rows ();
+	int ldv = bg_V.stride ();
+	double *V = bg_V.raw ();
+	double *W = V + (int64_t) first * ldv;
+	double *c = bg_h.data ();
+	std::vector<double> before (p);
+
+	for (int l = 0; l < p; ++l)
+		before[l] = Kernels::Dot (W + (int64_t) l * ldv, W + (int64_t) l * ldv, n);
+
+	for (int pass = 0; pass < 2 && first > 0; ++pass)
+	{
+		bool cancelled = false;
+
+		Kernels::ProjectBlock (V, ldv, first, W, ldv, p, c, n);
+		Kernels::SubtractBlock (V, ldv, first, c, W, ldv, p, n);
+
+		for (int l = 0; l < p; ++l)
+			for (int i = 0; i < first; ++i)
+				h[l * ldh + i] = (pass ? h[l * ldh + i] : 0) + c[l * first + i];
+
+		// as Krylov_t's Selective, a second pass only if a column cancelled
+		for (int l = 0; l < p && !cancelled; ++l)
+		{
+			double *w = W + (int64_t) l * ldv;
+
+			cancelled = (Kernels::Dot (w, w, n) < 0.5 * before[l]);
+		}
+
+		if (!cancelled)
+			break;
+	}
+
+	for (int l = 0; l < p; ++l)
+	{
+		int k = first + l;
+		double *w = W + (int64_t) l * ldv;
+		double *coef = h + (int64_t) l * ldh;
+		double after = before[l];
+
+		for (int pass = 0; pass < 2 && l > 0; ++pass)
+		{
+			Kernels::Project (W, ldv, l, w, c, n);
+			after = Kernels::Subtract (W, ldv, l, c, w, n);
+
+			for (int i = 0; i < l; ++i)
+				coef[first + i] = (pass ? coef[first + i] : 0) + c[i];
+		}
+
+		if (l == 0 && first > 0)
+			after = Kernels::Dot (w, w, n);
+
+		if (after > 1e-24 * before[l] && after > 0)
+		{
+			coef[k] = sqrt (after);
+			Kernels::Scale (1.0 / coef[k], w, n);
+
+			continue;
+		}
+
+		// w is in the span of the basis, replace it with a random direction
+		coef[k] = 0;
+
+		std::uniform_real_distribution<double> uniform (-0.5, 0.5);
+
+		for (int i = 0; i < n; ++i)
+			w[i] = uniform (bg_generator);
+
+		for (int pass = 0; pass < 2; ++pass)
+		{
+			Kernels::Project (V, ldv, k, w, c, n);
+			after = Kernels::Subtract (V, ldv, k, c, w, n);
+		}
+
+		Kernels::Scale (1.0 / sqrt (after), w, n);
+	}
+}
+
+/*
+ * Reduces block column j of H to upper triangular.  Column c of H has
+ * p entries below its diagonal, eliminated bottom up by rotations of
+ * adjacent rows; each column first has the rotations of the columns
+ * before it applied, and its own are applied to G as they are made.
+ *
+ */
+void
+BlockGMRES_t::rotate (int j)
+{
+	int p = bg_p;
+
+	for (int col = j * p; col < (j + 1) * p; ++col)
+	{
+		for (int c = 0; c < col; ++c)
+			for (int t = p - 1; t >= 0; --t)
+			{
+				double ci = bg_c (t, c);
+				double si = bg_s (t, c);
+				double a = bg_H (c + t, col);
+				double b = bg_H (c + t + 1, col);
+
+				bg_H (c + t, col) = ci * a + si * b;
+				bg_H (c + t + 1, col) = -si * a + ci * b;
+			}
+
+		for (int t = p - 1; t >= 0; --t)
+		{
+			double a = bg_H (col + t, col);
+			double b = bg_H (col + t + 1, col);
+			double denom = hypot (a, b);
+			double ci = (denom ? a / denom : 1.0);
+			double si = (denom ? b / denom : 0.0);
+
+			bg_c (t, col) = ci;
+			bg_s (t, col) = si;
+
+			bg_H (col + t, col) = denom;
+			bg_H (col + t + 1, col) = 0.0;
+
+			for (int l = 0; l < p; ++l)
+			{
+				double g0 = bg_G (col + t, l);
+				double g1 = bg_G (col + t + 1, l);
+
+				bg_G (col + t, l) = ci * g0 + si * g1;
+				bg_G (col + t + 1, l) = -si * g0 + ci * g1;
+			}
+		}
+	}
+}
+
+#endif // header inclusion
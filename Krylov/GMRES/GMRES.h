@@ -28,7 +28,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef __DJS_GMRES_GIVENS__H__
 #define __DJS_GMRES_GIVENS__H__
 
+#include <algorithm>
+
 #include <Krylov.h>
+#include <francis.h>
 
 /*
  * An example use of Krylov_t by implementing a naive Generalized Minimum 
@@ -37,6 +40,16 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * It is a simple and naive implementation intended to demonstrate how GMRES
  * works in code.
  *
+ * Given a callable preconditioner it is FGMRES, the preconditioner can
+ * then be another solver whose answer varies with its input.
+ *
+ * With deflation (GMRES-DR, Morgan 2002) a restart keeps the k harmonic
+ * Ritz vectors of the smallest harmonic Ritz values of the cycle.  The
+ * eigencomponents that make restarted GMRES stagnate are then removed
+ * for good rather than rediscovered every cycle, at a fixed m.  If a
+ * restart barely reduces the residual deflation is switched on (k =
+ * m / 4) unless k was set.
+ *
  */
 
 class GMRES_t : private Krylov_t
@@ -44,30 +57,50 @@ class GMRES_t : private Krylov_t
 	int				gm_restarts;
 	double			gm_residual;
 	int				gm_iterations;
+	int				gm_steps;		// Arnoldi steps over all cycles
+
+	Md_t			gm_c;			// Givens rotations of the cycle
+	Md_t			gm_s;
+
+	int				gm_deflate;		// harmonic Ritz vectors kept, -1 on stall
+	int				gm_kept;		// ... by the current cycle
+	Md_t			gm_Hbar;		// H before rotation
+	Md_t			gm_Omega;		// triangularises the kept block
 
 	void init ()
 	{
+		gm_c = Md_t (k_n, 1);
+		gm_s = Md_t (k_n, 1);
+		gm_Hbar = Md_t (k_n + 1, k_n, 0.0, true);
+		gm_deflate = -1;
+		gm_kept = 0;
 	}
 
 	Md_t step (double &);
-	double rotate (void);
+	double rotate (int);
+	Md_t coordinates (int);
+	Md_t residual (int);
+	int harmonic (int, int, Md_t &);
+	bool deflate (void);
 
 public:
 
-	GMRES_t (int n, Ms_t &A, Md_t &b) :
+	GMRES_t (int n, Mo_t &A, Md_t &b) :
 		Krylov_t (A, b, n),
 		gm_restarts (10),
 		gm_residual (0.5),
-		gm_iterations (0)
+		gm_iterations (0),
+		gm_steps (0)
 	{
 		init ();
 	}
 
-	GMRES_t (int n, Ms_t &A, Md_t &b, int restarts) :
+	GMRES_t (int n, Mo_t &A, Md_t &b, int restarts) :
 		Krylov_t (A, b, n),
 		gm_restarts (restarts),
 		gm_residual (0.5),
-		gm_iterations (0)
+		gm_iterations (0),
+		gm_steps (0)
 	{
 		init ();
 	}
@@ -86,6 +119,53 @@ public:
 		return gm_iterations;
 	}
 
+	int GetSteps (void) const
+	{
+		return gm_steps;
+	}
+
+	// see Krylov_t, M is not owned
+	void SetPreconditioner (Mp_t &M, side_t side = Right)
+	{
+		Precondition (&M, side);
+	}
+
+	// GMRES-DR, k < m harmonic Ritz vectors kept at a restart (0 never)
+	void SetDeflation (int k)
+	{
+		if (k < 0 || k >= k_n - 1)
+			throw ("GMRES: require 0 <= k < m - 1");
+
+		gm_deflate = k;
+	}
+
+	// FGMRES, M may vary from step to step (see Krylov_t)
+	void SetPreconditioner (Mf_t M)
+	{
+		Precondition (M);
+	}
+
+	SolverStats_t GetStats (void) const
+	{
+		SolverStats_t stats = k_stats;
+
+		stats.ss_iterations = gm_iterations;
+		stats.ss_steps = gm_steps;
+
+		return stats;
+	}
+
+	// see Krylov_t, Selective by default
+	void SetReorthogonalisation (reorth_t reorth)
+	{
+		Reorthogonalise (reorth);
+	}
+
+	int GetReorthogonalisations (void) const
+	{
+		return k_passes;
+	}
+
 	bool Solve (Md_t &, double &);
 };
 
@@ -95,6 +175,8 @@ GMRES_t::Solve (Md_t &xm, double &residue)
 	xm = Md_t (k_b.rows (), 1, 0.0);
 	bool rc = false;
 	double last = DBL_MAX;
+	bool left = (k_M && k_side == Left);
+	double start = SolverStats_t::Now ();
 	Md_t _x;
 	Md_t r;
 
@@ -104,7 +186,21 @@ GMRES_t::Solve (Md_t &xm, double &residue)
 
 		xm += _x;
 
-		r = k_b - k_A * xm;
+		/*
+		 * The residual of the cycle is in the span of the basis, so the
+		 * restart costs no product with A.  The recurrence can drift
+		 * from b - Ax, which is checked once before claiming success.
+		 * The left preconditioned residual is M⁻¹r, test the true one.
+		 *
+		 */
+		if (left || residue <= gm_residual)
+		{
+			r = k_b - k_A * xm;
+			residue = r.vec_magnitude ();
+			++k_stats.ss_matvecs;
+		}
+		else
+			r = residual (k_i);
 
 		if (residue <= gm_residual)
 		{
@@ -112,16 +208,29 @@ GMRES_t::Solve (Md_t &xm, double &residue)
 			break;
 		}
 
-		if (residue == last)
-		{
-			// GMRES has stalled.  See Saad for further suggestions.
-			k_n += 50;
-			printf ("Increasing m = %d\n", k_n);
-		}
+		// stalled, deflate the eigenvalues responsible
+		if (residue > 0.99 * last && gm_deflate < 0 && k_n > 4)
+			gm_deflate = std::max (1, k_n / 4);
 
 		last = residue;
 
-		Restart (r, k_n);
+		bool deflated = (gm_deflate > 0 && k_i == k_n && k_side != Flexible);
+
+		if (deflated)
+			deflated = deflate ();
+
+		if (!deflated)
+		{
+			gm_kept = 0;
+
+			if (left)
+			{
+				Apply (r, k_z);
+				Restart (k_z, k_n);
+			}
+			else
+				Restart (r, k_n);
+		}
 
 		++gm_iterations;
 
@@ -131,6 +240,8 @@ GMRES_t::Solve (Md_t &xm, double &residue)
 #endif
 	}
 
+	k_stats.ss_total += SolverStats_t::Now () - start;
+
 	return rc;
 }
 
@@ -149,28 +260,60 @@ GMRES_t::Solve (Md_t &xm, double &residue)
  *
  * H is a Hessenberg matrix and much smaller than A, so this is very fast.
  *
+ * Each column of H is rotated as Arnoldi produces it, the least squares
+ * residual is then |e1(i + 1)| at every step and the cycle ends as soon
+ * as it is small enough, or Kn is invariant (the solution is exact).
+ *
  */
 
 Md_t
 GMRES_t::step (double &residue)
 {
-	int runs;
+	int m = k_i;	// after a deflated restart the kept vectors
+
+	residue = fabs (k_e1 (m, 0));
 
-	runs = RunArnoldi (k_n);
-	if (runs < k_n) // broke down
+	while (m < k_n && residue > gm_residual)
 	{
-		residue = nan (NULL);
-		return Md_t ();
+		bool invariant = (RunArnoldi (1) == m);
+
+		for (int i = 0; i <= m + 1; ++i)
+			gm_Hbar (i, m) = k_H (i, m);
+
+		residue = rotate (m++);
+
+		if (invariant)
+		{
+			k_i = m;
+			break;
+		}
 	}
 
-	residue = rotate (); // H -> upper triangular (R)
-	Md_t H = k_H.view (0, 0, k_i, k_i, false);
-	Md_t Q = k_Q.view (0, 0, k_A.rows (), k_i);
-	Md_t y = k_e1.view (0, 0, k_i, 1);
+	gm_steps += m - gm_kept;
+
+	if (m == 0)
+		return Md_t (k_b.rows (), 1, 0.0);
+
+	Md_t H = k_H.view (0, 0, m, m, false);
+	Md_t Q = k_Q.view (0, 0, k_A.rows (), m);
+	Md_t y = k_e1.view (0, 0, m, 1);
 	y = H.find_x (y); // Hx = b', where H is upper triangular
 
+	// flexible: x* = Zy, the preconditioner was applied building Z
+	if (k_side == Flexible)
+		return k_Z.view (0, 0, k_A.rows (), m) * y;
+
 	Md_t _x = Q * y;
 
+	if (k_M && k_side == Right)
+	{
+		Md_t z (_x.rows (), 1);
+
+		Apply (_x, z);
+
+		return z;
+	}
+
 	return _x;
 }
 
@@ -178,44 +321,358 @@ GMRES_t::step (double &residue)
  * Use Givens rotations to transform Hessenberg matrix to upper triangular.
  * GVL (4th edition) Section 5.1.8
  *
- * |b|e1 is taken care of while computing the upper triangular.
+ * Column j has the rotations of the columns before it applied, then its
+ * own, which is kept for the columns after it.  |b|e1 is rotated with
+ * it, returns the residual of the least squares problem.
+ *
+ * After a deflated restart the kept block is dense and was triangularised
+ * by Ω, which comes first.
  *
  */
 double 
-GMRES_t::rotate (void)
+GMRES_t::rotate (int j)
 {
-	int m = k_i;
-	double tmp[2];
+	double tmp;
 	double denom;
 	double ci;
 	double si;
 
+	if (gm_kept)
+	{
+		int k = gm_kept + 1;
+		Md_t t (k, 1, 0.0);
+
+		for (int c = 0; c < k; ++c)
+			for (int i = 0; i < k; ++i)
+				t (i, 0) += gm_Omega (i, c) * k_H (c, j);
+
+		for (int i = 0; i < k; ++i)
+			k_H (i, j) = t (i, 0);
+	}
+
+	for (int i = gm_kept; i < j; ++i) 
+	{
+		ci = gm_c (i, 0);
+		si = gm_s (i, 0);
+
+		tmp = ci * k_H(i, j) + si * k_H(i + 1, j);
+		k_H (i + 1, j) = -si * k_H(i, j) + ci * k_H(i + 1, j);
+		k_H (i, j) = tmp;
+	}
+
+	denom = hypot (k_H(j, j), k_H(j + 1, j));
+	ci = (denom ? k_H(j, j) / denom : 1.0);
+	si = (denom ? k_H(j + 1, j) / denom : 0.0);
+
+	gm_c (j, 0) = ci;
+	gm_s (j, 0) = si;
+
+	tmp = ci * k_e1(j, 0);
+	k_e1 (j + 1, 0) = -si * k_e1(j, 0);
+	k_e1 (j, 0) = tmp;
+
+	k_H (j, j) = denom;
+	k_H (j + 1, j) = 0.0;
+
+	return fabs (k_e1(j + 1, 0));
+}
+
+/*
+ * βe1 - Hy for the y of a cycle of m steps, the residual in the basis.
+ *
+ * With Ω the rotations, βe1 - Hy = Ωᵀ(e1(m) e_m).
+ *
+ */
+Md_t
+GMRES_t::coordinates (int m)
+{
+	Md_t z (m + 1, 1, 0.0);
+	double tmp;
+
+	z (m, 0) = k_e1 (m, 0);
+
+	for (int i = m - 1; i >= gm_kept; --i)
+	{
+		double ci = gm_c (i, 0);
+		double si = gm_s (i, 0);
+
+		tmp = ci * z(i, 0) - si * z(i + 1, 0);
+		z (i + 1, 0) = si * z(i, 0) + ci * z(i + 1, 0);
+		z (i, 0) = tmp;
+	}
+
+	if (gm_kept)
+	{
+		int k = gm_kept + 1;
+		Md_t t (k, 1, 0.0);
+
+		for (int c = 0; c < k; ++c)
+			for (int i = 0; i < k; ++i)
+				t (i, 0) += gm_Omega (c, i) * z (c, 0);
+
+		for (int i = 0; i < k; ++i)
+			z (i, 0) = t (i, 0);
+	}
+
+	return z;
+}
+
+/*
+ * r = b - Ax for the x of a cycle of m steps, without A: r = Vz.
+ *
+ */
+Md_t
+GMRES_t::residual (int m)
+{
+	Md_t z = coordinates (m);
+	Md_t Q = k_Q.view (0, 0, k_A.rows (), m + 1);
+
+	return Q * z;
+}
+
+/*
+ * The harmonic Ritz vectors of AVm = Vm+1Hm are the eigenvectors of
+ *
+ *    F = Hm + h² Hm⁻ᵀ em emᵀ (h = Hm+1,m)
+ *
+ * and the smallest harmonic Ritz values approximate the eigenvalues of A
+ * nearest the origin, the ones restarting loses.  The real and imaginary
+ * parts of the k with the smallest modulus go to the columns of G (a
+ * conjugate pair is not split, so it can be k + 1).  Returns their number.
+ *
+ */
+int
+GMRES_t::harmonic (int m, int k, Md_t &G)
+{
+	Md_t F (m, m);
+	Md_t Ht (m, m);
+	Md_t em (m, 1, 0.0);
+	double h = gm_Hbar (m, m - 1);
+
+	for (int j = 0; j < m; ++j)
+		for (int i = 0; i < m; ++i)
+		{
+			F (i, j) = gm_Hbar (i, j);
+			Ht (j, i) = gm_Hbar (i, j);
+		}
+
+	em (m - 1, 0) = 1;
+
+	Md_t f = Ht.solveQR (em);
+
 	for (int i = 0; i < m; ++i)
+		F (i, m - 1) += h * h * f (i, 0);
+
+	EigenFrancis_t FR;
+	Md_t scratch (m, m);
+
+	scratch.pipe (F);
+	FR.CalcEigenValuesGeneral (scratch);
+
+	std::vector<conj_t> theta (FR.ef_EigenValues, FR.ef_EigenValues + FR.ef_N);
+
+	std::stable_sort (theta.begin (),
+					theta.end (),
+					[] (conj_t a, conj_t b)
+					{
+						return a.modulus () < b.modulus ();
+					});
+
+	int found = 0;
+
+	G = Md_t (m, k + 1, 0.0, true);
+
+	for (size_t i = 0; i < theta.size () && found < k; ++i)
 	{
-		denom = hypot (k_H(i, i), k_H(i + 1, i));
-		ci = k_H(i, i) / denom;
-		si = k_H(i + 1, i) / denom;
+		Md_t u;
+		Md_t v;
+
+		// inverse iteration that stops short is still a good enough basis,
+		// one that overflowed (θ exact) is not
+		EigenFrancis_t::FindEigenVectorComplex (theta[i], F, u, v);
+
+		double sum = 0;
 
-		tmp[0] = ci * k_e1(i, 0) + si * k_e1(i + 1, 0);
-		tmp[1] = -si * k_e1(i, 0) + ci * k_e1(i + 1, 0);
+		for (int r = 0; r < m; ++r)
+			sum += u (r, 0) + v (r, 0);
 
-		k_e1 (i, 0) = tmp[0];
-		k_e1 (i + 1, 0) = tmp[1];
+		if (!std::isfinite (sum))
+			continue;
 
-		k_H (i, i) = ci * k_H(i, i) + si * k_H(i + 1, i);
-		k_H (i + 1, i) = 0.0;
+		for (int r = 0; r < m; ++r)
+			G (r, found) = u (r, 0);
 
-		for (int j = i + 1; j < m; ++j) 
+		++found;
+
+		if (theta[i].imag == 0)
+			continue;
+
+		if (found == k + 1)
+			break;
+
+		for (int r = 0; r < m; ++r)
+			G (r, found) = v (r, 0);
+
+		++found;
+	}
+
+	return found;
+}
+
+/*
+ * A deflated restart.  With c = βe1 - Hy the residual of the cycle in the
+ * basis and G the harmonic Ritz vectors, P = [G 0; c] orthonormalised,
+ *
+ *    Vk+1 = Vm+1 P, Hk = Pᵀ Hm Pk
+ *
+ * and AVk = Vk+1Hk still holds (c's span contains Hm's image of G).  The
+ * cycle continues from vk+1 with Pᵀc as the right hand side.  Returns
+ * false if nothing could be kept, the caller restarts plainly.
+ *
+ */
+bool
+GMRES_t::deflate (void)
+{
+	int n = k_A.rows ();
+	int m = k_i;
+	Md_t c = coordinates (m);
+	Md_t G;
+	int k = harmonic (m, gm_deflate, G);
+	Md_t P (m + 1, k + 1, 0.0, true);
+	double *Pp = P.raw ();
+	int ldp = P.stride ();
+	std::vector<double> h (k + 1);
+
+	for (int j = 0; j < k; ++j)
+		for (int i = 0; i < m; ++i)
+			P (i, j) = G (i, j);
+
+	for (int i = 0; i <= m; ++i)
+		P (i, k) = c (i, 0);
+
+	// orthonormal, dropping any vector that turns out dependent
+	int kept = 0;
+
+	for (int j = 0; j <= k; ++j)
+	{
+		double *p = Pp + (int64_t) kept * ldp;
+		double before;
+		double after;
+
+		if (j != kept)
+			Kernels::Copy (Pp + (int64_t) j * ldp, p, m + 1);
+
+		before = Kernels::Dot (p, p, m + 1);
+		after = before;
+
+		for (int pass = 0; pass < 2 && kept > 0; ++pass)
+		{
+			Kernels::Project (Pp, ldp, kept, p, h.data (), m + 1);
+			after = Kernels::Subtract (Pp, ldp, kept, h.data (), p, m + 1);
+		}
+
+		if (after <= 1e-20 * before || after == 0)
+		{
+			if (j == k)		// c must be last
+				return false;
+
+			continue;
+		}
+
+		Kernels::Scale (1.0 / sqrt (after), p, m + 1);
+		++kept;
+	}
+
+	k = kept - 1;	// the last is c's direction
+	if (k < 1)
+		return false;
+
+	// Vk+1 = Vm+1 P
+	Md_t V = k_Q.view (0, 0, n, m + 1);
+	Md_t Pk1 = P.view (0, 0, m + 1, k + 1);
+	Md_t W = V * Pk1;
+
+	for (int j = 0; j <= k; ++j)
+		Kernels::Copy (W.raw () + (int64_t) j * W.stride (), k_Q.raw () + (int64_t) j * k_Q.stride (), n);
+
+	// Hk = Pᵀ Hm Pk, and the right hand side Pᵀc
+	Md_t HP (m + 1, k, 0.0, true);
+
+	for (int j = 0; j < k; ++j)
+		for (int l = 0; l < m; ++l)
+			for (int i = 0; i <= m; ++i)
+				HP (i, j) += gm_Hbar (i, l) * P (l, j);
+
+	k_H.zero ();
+	gm_Hbar.zero ();
+	k_e1.zero ();
+
+	for (int j = 0; j < k; ++j)
+		for (int i = 0; i <= k; ++i)
 		{
-			tmp[0] = ci * k_H(i, j) + si * k_H(i + 1, j);
-			tmp[1] = -si * k_H(i, j) + ci * k_H(i + 1, j);
-			k_H (i, j) = tmp[0];
-			k_H (i + 1, j) = tmp[1];
+			double sum = 0;
+
+			for (int l = 0; l <= m; ++l)
+				sum += P (l, i) * HP (l, j);
+
+			k_H (i, j) = gm_Hbar (i, j) = sum;
 		}
+
+	for (int i = 0; i <= k; ++i)
+	{
+		double sum = 0;
+
+		for (int l = 0; l <= m; ++l)
+			sum += P (l, i) * c (l, 0);
+
+		k_e1 (i, 0) = sum;
 	}
 
-	return fabs (k_e1(m, 0));
+	/*
+	 * Hk is dense, triangularise it once with rotations accumulated in
+	 * Ω, which is applied to the columns that follow.
+	 *
+	 */
+	gm_Omega = Md_t (k + 1, k + 1, 1.0);
+
+	for (int col = 0; col < k; ++col)
+		for (int r = k; r > col; --r)
+		{
+			double a = k_H (r - 1, col);
+			double b = k_H (r, col);
+			double denom = hypot (a, b);
+			double ci = (denom ? a / denom : 1.0);
+			double si = (denom ? b / denom : 0.0);
+
+			for (int j = col; j < k; ++j)
+			{
+				double t0 = k_H (r - 1, j);
+				double t1 = k_H (r, j);
+
+				k_H (r - 1, j) = ci * t0 + si * t1;
+				k_H (r, j) = -si * t0 + ci * t1;
+			}
+
+			for (int j = 0; j <= k; ++j)
+			{
+				double t0 = gm_Omega (r - 1, j);
+				double t1 = gm_Omega (r, j);
+
+				gm_Omega (r - 1, j) = ci * t0 + si * t1;
+				gm_Omega (r, j) = -si * t0 + ci * t1;
+			}
+
+			double g0 = k_e1 (r - 1, 0);
+			double g1 = k_e1 (r, 0);
+
+			k_e1 (r - 1, 0) = ci * g0 + si * g1;
+			k_e1 (r, 0) = -si * g0 + ci * g1;
+		}
+
+	gm_kept = k;
+	k_i = k;
+
+	return true;
 }
 
 #endif // header inclusion
-
@@ -32,10 +32,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <float.h>
 
 #include <GMRES.h> // defines typedef Matrix_t<double> Md_t
+#include <BlockGMRES.h>
+#include <ILU.h>
 
 int __DIM = 1000;
 
 void run ();
+void block ();
+void deflated ();
 void unitary (Krylov_t &);
 
 int KrylovDim = 200;
@@ -75,13 +79,15 @@ int main (int argc, char *argv[])
 	srand (seed);
 
 	run ();
+	block ();
+	deflated ();
 
 	return 0;
 }
 
 void run ()
 {
-	Ms_t A (__DIM, __DIM);
+	SparseMatrix::Triplets_t T (__DIM, __DIM);
 	Md_t b (__DIM, 1);
 
 	/*
@@ -109,12 +115,14 @@ void run ()
 				sample = (double) (rand () % (100));
 
 			if (i == j)
-				A[i][j] = 4 * sample;
+				T.Add (i, j, 4 * sample);
 			else
-				A[i][j] = sample;
+				T.Add (i, j, sample);
 		}
 	}
 
+	Ms_t A (T);
+
 	b.randomly_fill (5);
 
 	Md_t QR = A.Copy ();
@@ -147,5 +155,298 @@ void run ()
 		residual, 
 		(x - _x).vec_magnitude (),
 		KrylovDim);
+
+	/*
+	 * The same system preconditioned, ILU(0) from the left and ILUT
+	 * from the right.  Both should need a handful of restarts.
+	 *
+	 */
+	SparseMatrix::ILU_t ILU0 (A);
+	SparseMatrix::ILU_t ILUT (A, 1e-3, 10);
+	SparseMatrix::ILU_t *M[] = {&ILU0, &ILUT};
+	Krylov_t::side_t side[] = {Krylov_t::Left, Krylov_t::Right};
+	const char *name[] = {"ILU(0), left", "ILUT, right"};
+
+	for (int p = 0; p < 2; ++p)
+	{
+		GMRES_t P (KrylovDim, A, b, 1000);
+
+		P.SetPreconditioner (*M[p], side[p]);
+		P.SetTolerance (1e-8);
+
+		clock_t start = clock ();
+		bool converged = P.Solve (_x, residual);
+		clock_t end = clock ();
+
+		assert (converged);
+		assert ((x - _x).vec_magnitude () < 1e-6 * x.vec_magnitude ());
+
+		// the cycle ends as soon as the estimate meets the tolerance
+		assert (P.GetSteps () < KrylovDim);
+
+		printf ("%s:	Restarts = %d	Steps = %d	Residual = %g	Error = %g	%ld in LU	%.3f s\n",
+			name[p],
+			P.GetIterations (),
+			P.GetSteps (),
+			residual,
+			(x - _x).vec_magnitude (),
+			(long) M[p]->nnz (),
+			(double) (end - start) / CLOCKS_PER_SEC);
+	}
+
+	/*
+	 * Each reorthogonalisation policy must reach the same solution,
+	 * Selective takes the second pass only where CGS cancelled.
+	 *
+	 */
+	Krylov_t::reorth_t reorth[] = {Krylov_t::Always, Krylov_t::Selective, Krylov_t::Never};
+	const char *policy[] = {"Always", "Selective", "Never"};
+
+	for (int p = 0; p < 3; ++p)
+	{
+		GMRES_t P (KrylovDim, A, b, 1000);
+
+		P.SetPreconditioner (ILUT, Krylov_t::Right);
+		P.SetReorthogonalisation (reorth[p]);
+		P.SetTolerance (1e-8);
+
+		clock_t start = clock ();
+		bool converged = P.Solve (_x, residual);
+		clock_t end = clock ();
+
+		assert (converged);
+		assert ((x - _x).vec_magnitude () < 1e-6 * x.vec_magnitude ());
+		assert (reorth[p] != Krylov_t::Never || P.GetReorthogonalisations () == 0);
+
+		printf ("CGS %s:	Restarts = %d	Second passes = %d	Residual = %g	%.3f s\n",
+			policy[p],
+			P.GetIterations (),
+			P.GetReorthogonalisations (),
+			residual,
+			(double) (end - start) / CLOCKS_PER_SEC);
+	}
+
+	/*
+	 * FGMRES preconditioned by a few steps of ILUT preconditioned GMRES,
+	 * an inner solver that is not a fixed linear operator.
+	 *
+	 */
+	GMRES_t F (KrylovDim, A, b, 1000);
+
+	F.SetPreconditioner ([&] (Md_t &r, Md_t &z) {
+		Md_t inner;
+		double rr;
+		GMRES_t I (4, A, r, 1);
+
+		I.SetPreconditioner (ILUT, Krylov_t::Right);
+		I.SetTolerance (1e-3 * r.vec_magnitude ());
+		I.Solve (inner, rr);
+
+		z.pipe (inner);
+	});
+	F.SetTolerance (1e-8);
+
+	bool converged = F.Solve (_x, residual);
+	SolverStats_t stats = F.GetStats ();
+
+	assert (converged);
+	assert ((x - _x).vec_magnitude () < 1e-6 * x.vec_magnitude ());
+	assert (stats.ss_applies == stats.ss_steps);
+
+	printf ("FGMRES:	Restarts = %d	Steps = %d	Residual = %g	%d applications	%.3f of %.3f s\n",
+		stats.ss_iterations,
+		stats.ss_steps,
+		residual,
+		stats.ss_applies,
+		stats.ss_precondition,
+		stats.ss_total);
 }
 
+
+/*
+ * 16 right hand sides of a convection-diffusion problem with block GMRES
+ * against GMRES on each.  One right hand side repeats another (the block
+ * loses rank) and one is zero (converged before starting).
+ *
+ */
+void block ()
+{
+	int side = 100;
+	int n = side * side;
+	int P = 16;
+	double tolerance = 1e-8;
+	SparseMatrix::Triplets_t T (n, n);
+
+	for (int r = 0; r < side; ++r)
+		for (int c = 0; c < side; ++c)
+		{
+			int i = r * side + c;
+			double w = 0.2 * rand () / RAND_MAX;
+
+			T.Add (i, i, 4 + 2 * w);
+
+			if (r > 0)
+				T.Add (i, i - side, -1 - w);
+			if (r < side - 1)
+				T.Add (i, i + side, -1);
+			if (c > 0)
+				T.Add (i, i - 1, -1 - w);
+			if (c < side - 1)
+				T.Add (i, i + 1, -1);
+		}
+
+	Ms_t A (T);
+	Md_t B (n, P);
+	SparseMatrix::ILU_t ILU0 (A);
+
+	B.randomly_fill (1.0);
+
+	for (int i = 0; i < n; ++i)
+	{
+		B (i, 1) = B (i, 0);
+		B (i, 2) = 0;
+	}
+
+	BlockGMRES_t K (20, A, B, 100);
+	Md_t X;
+	double residue;
+
+	K.SetPreconditioner (ILU0);
+	K.SetTolerance (tolerance);
+
+	// the lost rank is replaced from a private generator, not rand ()
+	unsigned seed = rand ();
+
+	srand (seed);
+	int expect = rand ();
+
+	srand (seed);
+	bool converged = K.Solve (X, residue);
+	SolverStats_t stats = K.GetStats ();
+
+	assert (converged);
+	assert (rand () == expect);
+
+	Md_t R (n, P);
+
+	R.pipe (B);
+	A.Product (-1.0, X, 1.0, R);
+
+	for (int l = 0; l < P; ++l)
+	{
+		double rnorm = R.view (0, l, n, 1).vec_magnitude ();
+		double bnorm = B.view (0, l, n, 1).vec_magnitude ();
+
+		assert (rnorm <= tolerance * bnorm);
+	}
+
+	// one SpMM per block step, and one for the residuals of each restart
+	int reads = stats.ss_steps + stats.ss_iterations + 1;
+
+	printf ("Block GMRES:	%d right hand sides, Restarts = %d	Block steps = %d	A read %d times	%d products	Residual = %g	%.3f s\n",
+		P,
+		stats.ss_iterations,
+		stats.ss_steps,
+		reads,
+		stats.ss_matvecs,
+		residue,
+		stats.ss_total);
+
+	// the same one at a time
+	double start = SolverStats_t::Now ();
+	int products = 0;
+
+	for (int l = 0; l < P; ++l)
+	{
+		Md_t b (n, 1);
+
+		b.pipe (B.view (0, l, n, 1));
+		double bnorm = b.vec_magnitude ();
+		Md_t x;
+
+		if (bnorm == 0)
+			continue;
+
+		GMRES_t G (20, A, b, 100);
+
+		G.SetPreconditioner (ILU0, Krylov_t::Right);
+		G.SetTolerance (tolerance * bnorm);
+
+		assert (G.Solve (x, residue));
+
+		products += G.GetStats ().ss_matvecs;
+	}
+
+	assert (reads < products);
+
+	printf ("GMRES:		%d right hand sides, A read %d times	%.3f s\n",
+		P,
+		products,
+		SolverStats_t::Now () - start);
+}
+
+/*
+ * The 1D Laplacian has eigenvalues down to π²/n², restarted GMRES(20)
+ * forgets them every cycle and stagnates.  GMRES-DR keeps the harmonic
+ * Ritz vectors of the smallest, at the same m.
+ *
+ */
+void deflated ()
+{
+	int n = 1000;
+	int m = 20;
+	SparseMatrix::Triplets_t T (n, n);
+
+	for (int i = 0; i < n; ++i)
+	{
+		T.Add (i, i, 2);
+
+		if (i > 0)
+			T.Add (i, i - 1, -1);
+		if (i < n - 1)
+			T.Add (i, i + 1, -1);
+	}
+
+	Ms_t A (T);
+	Md_t b (n, 1);
+
+	b.randomly_fill (1.0);
+
+	double tolerance = 1e-8 * b.vec_magnitude ();
+	int deflate[] = {0, 4, 8, -1};
+	int restarts = 2000;	// the same budget for each
+
+	for (int d = 0; d < 4; ++d)
+	{
+		GMRES_t G (m, A, b, restarts);
+		Md_t x;
+		double residue;
+
+		if (deflate[d] >= 0)
+			G.SetDeflation (deflate[d]);
+		G.SetTolerance (tolerance);
+
+		bool converged = G.Solve (x, residue);
+		SolverStats_t stats = G.GetStats ();
+
+		// plain restarts stagnate, any deflation gets there
+		assert (converged == (deflate[d] != 0));
+		assert (converged || stats.ss_iterations == restarts);
+
+		if (converged)
+		{
+			Md_t r = b - A * x;
+
+			assert (r.vec_magnitude () <= tolerance);
+		}
+
+		printf ("GMRES(%d)-DR(%s%d):	Restarts = %d	Steps = %d	Residual = %g	%.3f s\n",
+			m,
+			(deflate[d] < 0 ? "on stall, " : ""),
+			(deflate[d] < 0 ? m / 4 : deflate[d]),
+			stats.ss_iterations,
+			stats.ss_steps,
+			residue,
+			stats.ss_total);
+	}
+}
@@ -0,0 +1,730 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_ILU__H__
+#define __DJS_ILU__H__
+
+#include <math.h>
+
+#include <queue>
+
+#include <CSRMatrix.h>
+#include <Preconditioner.h>
+
+/*
+ * Level sets with fewer rows than this, on average, are not worth a
+ * barrier each and the triangular solves run on the calling thread.
+ *
+ */
+#define __ILU_LEVEL		64
+
+namespace SparseMatrix
+{
+
+/*
+ * A triangular factor by rows with its level sets: the rows of a level
+ * depend only on rows of earlier levels, so each level is solved in
+ * parallel.  The strictly triangular part is stored, the reciprocal of
+ * the diagonal is in tr_inverse (empty for a unit diagonal).
+ *
+ */
+struct Triangle_t
+{
+	std::vector<int64_t>	tr_ptr;
+	std::vector<int>		tr_idx;
+	std::vector<double>		tr_val;
+	std::vector<double>		tr_inverse;		// empty for a unit diagonal
+	std::vector<int>		tr_levelPtr;
+	std::vector<int>		tr_levelRows;
+	bool					tr_lower;
+	std::vector<int64_t>	tr_source;		// Strict: where each value is in A
+	int64_t					tr_nnz;			// ... and A's nnz
+
+	// lower: rows in increasing order, upper: rows in decreasing order
+	void Levels (bool lower)
+	{
+		int n = (int) tr_ptr.size () - 1;
+		std::vector<int> level (n, 0);
+		int depth = 0;
+
+		tr_lower = lower;
+
+		for (int k = 0; k < n; ++k)
+		{
+			int i = (lower ? k : n - 1 - k);
+			int l = 0;
+
+			for (int64_t e = tr_ptr[i]; e < tr_ptr[i + 1]; ++e)
+				l = std::max (l, level[tr_idx[e]] + 1);
+
+			level[i] = l;
+			depth = std::max (depth, l + 1);
+		}
+
+		tr_levelPtr.assign (depth + 1, 0);
+
+		for (int i = 0; i < n; ++i)
+			++tr_levelPtr[level[i] + 1];
+
+		for (int l = 0; l < depth; ++l)
+			tr_levelPtr[l + 1] += tr_levelPtr[l];
+
+		std::vector<int> next (tr_levelPtr.begin (), tr_levelPtr.end () - 1);
+		tr_levelRows.resize (n);
+
+		for (int i = 0; i < n; ++i)
+			tr_levelRows[next[level[i]]++] = i;
+	}
+
+	int levels (void)
+	{
+		return (int) tr_levelPtr.size () - 1;
+	}
+
+	// the strictly lower (or upper) part of A, the diagonal left to the caller
+	void Strict (CSRMatrix_t &A, bool lower)
+	{
+		int n = A.rows ();
+		int64_t *rowPtr = A.RowPtr ();
+		int *colIdx = A.ColIdx ();
+		double *values = A.Values ();
+
+		tr_ptr.assign (1, 0);
+		tr_idx.clear ();
+		tr_val.clear ();
+		tr_source.clear ();
+		tr_nnz = A.nnz ();
+
+		for (int i = 0; i < n; ++i)
+		{
+			for (int64_t k = rowPtr[i]; k < rowPtr[i + 1]; ++k)
+				if (lower ? colIdx[k] < i : colIdx[k] > i)
+				{
+					tr_idx.push_back (colIdx[k]);
+					tr_val.push_back (values[k]);
+					tr_source.push_back (k);
+				}
+
+			tr_ptr.push_back (tr_idx.size ());
+		}
+
+		Levels (lower);
+	}
+
+	// Strict's values again, from A with new values on the same structure
+	void Refresh (CSRMatrix_t &A)
+	{
+		const double *values = A.Values ();
+		int64_t count = tr_source.size ();
+
+		if (A.rows () != (int) tr_ptr.size () - 1 || A.nnz () != tr_nnz)
+			throw ("Triangle: structure changed");
+
+#pragma omp parallel for schedule(static) if(count >= __CSR_PARALLEL)
+		for (int64_t e = 0; e < count; ++e)
+			tr_val[e] = values[tr_source[e]];
+	}
+
+	// T = Lᵀ by rows (so upper), diagonal included
+	void Transpose (Triangle_t &L)
+	{
+		int n = (int) L.tr_ptr.size () - 1;
+
+		tr_ptr.assign (n + 1, 0);
+
+		for (int64_t e = 0; e < L.tr_ptr[n]; ++e)
+			++tr_ptr[L.tr_idx[e] + 1];
+
+		for (int i = 0; i < n; ++i)
+			tr_ptr[i + 1] += tr_ptr[i];
+
+		std::vector<int64_t> next (tr_ptr.begin (), tr_ptr.end () - 1);
+
+		tr_idx.resize (tr_ptr[n]);
+		tr_val.resize (tr_ptr[n]);
+
+		for (int i = 0; i < n; ++i)
+			for (int64_t e = L.tr_ptr[i]; e < L.tr_ptr[i + 1]; ++e)
+			{
+				int64_t slot = next[L.tr_idx[e]]++;
+
+				tr_idx[slot] = i;
+				tr_val[slot] = L.tr_val[e];
+			}
+
+		tr_inverse = L.tr_inverse;
+
+		Levels (false);
+	}
+
+	/*
+	 * In place: z = L⁻¹z or z = U⁻¹z.
+	 *
+	 */
+	void Solve (double *z)
+	{
+		const int64_t * __restrict ptr = tr_ptr.data ();
+		const int * __restrict idx = tr_idx.data ();
+		const double * __restrict val = tr_val.data ();
+		const double * __restrict inverse = (tr_inverse.empty () ? 0 : tr_inverse.data ());
+		int n = (int) tr_ptr.size () - 1;
+		int depth = levels ();
+		bool parallel = (n >= __ILU_LEVEL * depth && ptr[n] >= __CSR_PARALLEL);
+
+#ifdef _OPENMP
+		parallel = parallel && omp_get_max_threads () > 1;
+#else
+		parallel = false;
+#endif
+
+		// one thread: row order, the level order only costs locality
+		if (!parallel)
+		{
+			for (int k = 0; k < n; ++k)
+			{
+				int i = (tr_lower ? k : n - 1 - k);
+				double sum = z[i];
+
+				for (int64_t e = ptr[i]; e < ptr[i + 1]; ++e)
+					sum -= val[e] * z[idx[e]];
+
+				z[i] = (inverse ? sum * inverse[i] : sum);
+			}
+
+			return;
+		}
+
+#pragma omp parallel
+		for (int l = 0; l < depth; ++l)
+		{
+#pragma omp for schedule(static)
+			for (int k = tr_levelPtr[l]; k < tr_levelPtr[l + 1]; ++k)
+			{
+				int i = tr_levelRows[k];
+				double sum = z[i];
+
+				for (int64_t e = ptr[i]; e < ptr[i + 1]; ++e)
+					sum -= val[e] * z[idx[e]];
+
+				z[i] = (inverse ? sum * inverse[i] : sum);
+			}
+		}
+	}
+};
+
+/*
+ * Incomplete LU factorisations, A ≈ LU (Saad, chapter 10, Iterative
+ * Methods for Sparse Linear Systems).
+ *
+ * ILU(0): L and U keep exactly the pattern of A, fill outside it is
+ * discarded.  Row i depends only on the rows of U its L part references,
+ * the same dependencies as the forward solve, so the factorisation runs
+ * level by level in parallel too.
+ *
+ * ILUT(τ, p): Gaussian elimination of row i against the rows of U above
+ * it, dropping any entry smaller than τ|aᵢ| and then keeping only the p
+ * largest of each of the L and U parts.  Fill is allowed where it
+ * matters, so it is robust where ILU(0) is not (large off diagonals,
+ * weak diagonal dominance).
+ *
+ * Apply solves Ly = r, Uz = y with level scheduling.
+ *
+ */
+
+class ILU_t : public Preconditioner_t
+{
+	int				il_n;
+	double			il_tau;			// ILUT, or negative for ILU(0)
+	int				il_p;
+	Triangle_t		il_L;
+	Triangle_t		il_U;
+	std::vector<int64_t>	il_diagonal;	// ILU(0), a_ii in A.Values ()
+
+	void Split (CSRMatrix_t &A, std::vector<int64_t> &diagonal)
+	{
+		int64_t *rowPtr = A.RowPtr ();
+		int *colIdx = A.ColIdx ();
+
+		diagonal.resize (il_n);
+
+		for (int i = 0; i < il_n; ++i)
+		{
+			int *first = colIdx + rowPtr[i];
+			int *last = colIdx + rowPtr[i + 1];
+			int *d = std::lower_bound (first, last, i);
+
+			if (d == last || *d != i)
+				throw ("ILU: zero on the diagonal");
+
+			diagonal[i] = d - colIdx;
+		}
+	}
+
+	// the structure of ILU(0), that of A, and its level sets
+	void Pattern (CSRMatrix_t &A)
+	{
+		int64_t *rowPtr = A.RowPtr ();
+		int *colIdx = A.ColIdx ();
+
+		Split (A, il_diagonal);
+
+		il_L.tr_ptr.assign (il_n + 1, 0);
+		il_L.tr_idx.clear ();
+		il_U.tr_ptr.assign (il_n + 1, 0);
+		il_U.tr_idx.clear ();
+
+		for (int i = 0; i < il_n; ++i)
+		{
+			il_L.tr_ptr[i + 1] = il_L.tr_ptr[i] + (il_diagonal[i] - rowPtr[i]);
+			il_L.tr_idx.insert (il_L.tr_idx.end (), colIdx + rowPtr[i], colIdx + il_diagonal[i]);
+
+			il_U.tr_ptr[i + 1] = il_U.tr_ptr[i] + (rowPtr[i + 1] - il_diagonal[i] - 1);
+			il_U.tr_idx.insert (il_U.tr_idx.end (), colIdx + il_diagonal[i] + 1, colIdx + rowPtr[i + 1]);
+		}
+
+		il_L.tr_val.resize (il_L.tr_ptr[il_n]);
+		il_U.tr_val.resize (il_U.tr_ptr[il_n]);
+		il_U.tr_inverse.resize (il_n);
+
+		il_L.Levels (true);
+		il_U.Levels (false);
+	}
+
+	// ILU(0) on a copy of A's values, L and U then peeled off
+	void Zero (CSRMatrix_t &A)
+	{
+		int64_t *rowPtr = A.RowPtr ();
+		int *colIdx = A.ColIdx ();
+		std::vector<int64_t> &diagonal = il_diagonal;
+		std::vector<double> LU (A.Values (), A.Values () + A.nnz ());
+		int depth = il_L.levels ();
+		bool parallel = (il_n >= __ILU_LEVEL * depth && A.nnz () >= __CSR_PARALLEL);
+		bool singular = false;
+
+#pragma omp parallel if(parallel)
+		{
+			std::vector<int64_t> position (il_n, -1);
+
+			for (int l = 0; l < depth; ++l)
+			{
+#pragma omp for schedule(dynamic, 64) reduction(||:singular)
+				for (int k = il_L.tr_levelPtr[l]; k < il_L.tr_levelPtr[l + 1]; ++k)
+				{
+					int i = il_L.tr_levelRows[k];
+
+					for (int64_t e = rowPtr[i]; e < rowPtr[i + 1]; ++e)
+						position[colIdx[e]] = e;
+
+					for (int64_t e = rowPtr[i]; e < diagonal[i]; ++e)
+					{
+						int r = colIdx[e];
+						double pivot = (LU[e] /= LU[diagonal[r]]);
+
+						for (int64_t f = diagonal[r] + 1; f < rowPtr[r + 1]; ++f)
+							if (position[colIdx[f]] != -1)
+								LU[position[colIdx[f]]] -= pivot * LU[f];
+					}
+
+					if (LU[diagonal[i]] == 0)
+						singular = true;
+
+					for (int64_t e = rowPtr[i]; e < rowPtr[i + 1]; ++e)
+						position[colIdx[e]] = -1;
+				}
+			}
+		}
+
+		if (singular)
+			throw ("ILU: zero pivot");
+
+#pragma omp parallel for schedule(static) if(parallel)
+		for (int i = 0; i < il_n; ++i)
+		{
+			std::copy (LU.begin () + rowPtr[i],
+						LU.begin () + diagonal[i],
+						il_L.tr_val.begin () + il_L.tr_ptr[i]);
+			std::copy (LU.begin () + diagonal[i] + 1,
+						LU.begin () + rowPtr[i + 1],
+						il_U.tr_val.begin () + il_U.tr_ptr[i]);
+			il_U.tr_inverse[i] = 1.0 / LU[diagonal[i]];
+		}
+	}
+
+	/*
+	 * The p largest (in magnitude) of the entries listed in columns
+	 * appended to T's current row, in column order.
+	 *
+	 */
+	static void Keep (Triangle_t &T, std::vector<int> &columns, std::vector<double> &w, int p)
+	{
+		if ((int) columns.size () > p)
+		{
+			std::nth_element (columns.begin (),
+							columns.begin () + p,
+							columns.end (),
+							[&w] (int a, int b) {
+								return fabs (w[a]) > fabs (w[b]);
+							});
+			columns.resize (p);
+		}
+
+		std::sort (columns.begin (), columns.end ());
+
+		for (int j : columns)
+		{
+			T.tr_idx.push_back (j);
+			T.tr_val.push_back (w[j]);
+		}
+
+		T.tr_ptr.push_back (T.tr_idx.size ());
+	}
+
+	void Threshold (CSRMatrix_t &A, double tau, int p)
+	{
+		int64_t *rowPtr = A.RowPtr ();
+		int *colIdx = A.ColIdx ();
+		double *values = A.Values ();
+		std::vector<double> w (il_n, 0.0);
+		std::vector<char> used (il_n, 0);
+		std::vector<int> lower, upper, nonzero;
+
+		il_L.tr_ptr.assign (1, 0);
+		il_L.tr_idx.clear ();
+		il_L.tr_val.clear ();
+		il_U.tr_ptr.assign (1, 0);
+		il_U.tr_idx.clear ();
+		il_U.tr_val.clear ();
+		il_U.tr_inverse.resize (il_n);
+
+		for (int i = 0; i < il_n; ++i)
+		{
+			std::priority_queue<int, std::vector<int>, std::greater<int> > pending;
+			double norm = 0;
+
+			nonzero.clear ();
+
+			for (int64_t e = rowPtr[i]; e < rowPtr[i + 1]; ++e)
+			{
+				int j = colIdx[e];
+
+				w[j] = values[e];
+				used[j] = 1;
+				nonzero.push_back (j);
+				norm += values[e] * values[e];
+
+				if (j < i)
+					pending.push (j);
+			}
+
+			double drop = tau * sqrt (norm);
+
+			// eliminate with the rows of U, in increasing column order
+			while (!pending.empty ())
+			{
+				int k = pending.top ();
+				pending.pop ();
+
+				double pivot = (w[k] *= il_U.tr_inverse[k]);
+
+				if (fabs (pivot) < drop)
+				{
+					w[k] = 0;
+					continue;
+				}
+
+				for (int64_t e = il_U.tr_ptr[k]; e < il_U.tr_ptr[k + 1]; ++e)
+				{
+					int j = il_U.tr_idx[e];
+
+					if (!used[j])
+					{
+						used[j] = 1;
+						w[j] = 0;
+						nonzero.push_back (j);
+
+						if (j < i)
+							pending.push (j);
+					}
+
+					w[j] -= pivot * il_U.tr_val[e];
+				}
+			}
+
+			double diagonal = (used[i] ? w[i] : 0);
+
+			lower.clear ();
+			upper.clear ();
+
+			for (int j : nonzero)
+			{
+				if (j != i && fabs (w[j]) >= drop && w[j] != 0)
+					(j < i ? lower : upper).push_back (j);
+			}
+
+			Keep (il_L, lower, w, p);
+			Keep (il_U, upper, w, p);
+
+			// a (near) zero pivot is replaced, as is usual, rather than fail
+			if (fabs (diagonal) < drop * 1e-4 || diagonal == 0)
+				diagonal = (drop > 0 ? drop : 1.0);
+
+			il_U.tr_inverse[i] = 1.0 / diagonal;
+
+			for (int j : nonzero)
+			{
+				used[j] = 0;
+				w[j] = 0;
+			}
+		}
+
+		il_L.Levels (true);
+		il_U.Levels (false);
+	}
+
+	// not copyable
+	ILU_t (const ILU_t &);
+	ILU_t &operator= (const ILU_t &);
+
+public:
+
+	// ILU(0)
+	ILU_t (CSRMatrix_t &A) :
+		il_n (A.rows ()),
+		il_tau (-1),
+		il_p (0)
+	{
+		if (A.rows () != A.columns ())
+			throw ("ILU: matrix not square");
+
+		Pattern (A);
+		Zero (A);
+	}
+
+	// ILUT(τ, p)
+	ILU_t (CSRMatrix_t &A, double tau, int p) :
+		il_n (A.rows ()),
+		il_tau (tau),
+		il_p (p)
+	{
+		if (A.rows () != A.columns ())
+			throw ("ILU: matrix not square");
+
+		if (tau < 0 || p < 0)
+			throw ("ILU: illegal threshold");
+
+		Threshold (A, tau, p);
+	}
+
+	~ILU_t (void)
+	{
+	}
+
+	int rows (void)
+	{
+		return il_n;
+	}
+
+	// entries of L and U, including U's diagonal
+	int64_t nnz (void)
+	{
+		return il_L.tr_ptr[il_n] + il_U.tr_ptr[il_n] + il_n;
+	}
+
+	int levels (void)
+	{
+		return il_L.levels () + il_U.levels ();
+	}
+
+	/*
+	 * New values of A, same structure.  ILU(0) keeps its structure and
+	 * level sets and redoes only the numeric factorisation.  ILUT's
+	 * structure depends on the values so it is rebuilt.
+	 *
+	 */
+	void Refactor (CSRMatrix_t &A)
+	{
+		if (A.rows () != il_n || A.columns () != il_n)
+			throw ("ILU: dimensions changed");
+
+		if (il_tau < 0)
+		{
+			if (A.nnz () != nnz ())
+				throw ("ILU: structure changed");
+
+			Zero (A);
+		}
+		else
+			Threshold (A, il_tau, il_p);
+	}
+
+	void Apply (const double *r, double *z)
+	{
+		memcpy (z, r, il_n * sizeof (double));
+
+		il_L.Solve (z);
+		il_U.Solve (z);
+	}
+
+	using Preconditioner_t::Apply;
+};
+
+/*
+ * Incomplete Cholesky, IC(0): A ≈ LLᵀ with L keeping the pattern of the
+ * lower triangle of A (symmetric positive definite, both triangles
+ * stored).  By rows,
+ *
+ * l_ij = (a_ij - Σ l_ik l_jk) / l_jj,  l_ii = √(a_ii - Σ l_ik²)
+ *
+ * the sums over the columns k < j that rows i and j share.  As with
+ * ILU(0) row i needs only the rows its pattern references, so it is
+ * factored level by level in parallel.  Apply is Ly = r, Lᵀz = y.
+ *
+ * IC(0) exists for M-matrices and diagonally dominant matrices, for
+ * others a pivot may vanish and the factorisation throws.
+ *
+ */
+
+class IC0_t : public Preconditioner_t
+{
+	int				ic_n;
+	Triangle_t		ic_L;
+	Triangle_t		ic_Lt;
+
+	// not copyable
+	IC0_t (const IC0_t &);
+	IC0_t &operator= (const IC0_t &);
+
+public:
+
+	IC0_t (CSRMatrix_t &A) :
+		ic_n (A.rows ())
+	{
+		if (A.rows () != A.columns ())
+			throw ("IC: matrix not square");
+
+		ic_L.Strict (A, true);
+		Refactor (A);
+	}
+
+	~IC0_t (void)
+	{
+	}
+
+	int rows (void)
+	{
+		return ic_n;
+	}
+
+	// the numeric factorisation for new values of A, same structure
+	void Refactor (CSRMatrix_t &A)
+	{
+		int64_t *ptr = ic_L.tr_ptr.data ();
+		int *idx = ic_L.tr_idx.data ();
+		double *val = ic_L.tr_val.data ();
+		int depth = ic_L.levels ();
+		bool parallel = (ic_n >= __ILU_LEVEL * depth && A.nnz () >= __CSR_PARALLEL);
+		bool breakdown = false;
+
+		if (A.rows () != ic_n)
+			throw ("IC: dimensions changed");
+
+		std::vector<double> &inverse = ic_L.tr_inverse;
+		std::vector<double> diagonal (ic_n);
+
+		inverse.resize (ic_n);
+
+		for (int i = 0; i < ic_n; ++i)
+			diagonal[i] = A.get (i, i);
+
+		// start again from A, its lower triangle in L's pattern
+#pragma omp parallel for schedule(static) if(parallel)
+		for (int i = 0; i < ic_n; ++i)
+			for (int64_t e = ptr[i]; e < ptr[i + 1]; ++e)
+				val[e] = A.get (i, idx[e]);
+
+#pragma omp parallel if(parallel)
+		for (int l = 0; l < depth; ++l)
+		{
+#pragma omp for schedule(dynamic, 64) reduction(||:breakdown)
+			for (int k = ic_L.tr_levelPtr[l]; k < ic_L.tr_levelPtr[l + 1]; ++k)
+			{
+				int i = ic_L.tr_levelRows[k];
+				double square = 0;
+
+				for (int64_t e = ptr[i]; e < ptr[i + 1]; ++e)
+				{
+					int j = idx[e];
+					double sum = val[e];
+					int64_t a = ptr[i], b = ptr[j];
+
+					// Σ l_ik l_jk over the shared columns k < j
+					while (a < e && b < ptr[j + 1])
+					{
+						if (idx[a] == idx[b])
+							sum -= val[a++] * val[b++];
+						else if (idx[a] < idx[b])
+							++a;
+						else
+							++b;
+					}
+
+					val[e] = sum * inverse[j];
+					square += val[e] * val[e];
+				}
+
+				double pivot = diagonal[i] - square;
+
+				if (!(pivot > 0))
+				{
+					breakdown = true;
+					continue;
+				}
+
+				inverse[i] = 1.0 / sqrt (pivot);
+			}
+		}
+
+		if (breakdown)
+			throw ("IC: not positive definite");
+
+		ic_Lt.Transpose (ic_L);
+	}
+
+	void Apply (const double *r, double *z)
+	{
+		memcpy (z, r, ic_n * sizeof (double));
+
+		ic_L.Solve (z);
+		ic_Lt.Solve (z);
+	}
+
+	using Preconditioner_t::Apply;
+};
+
+} // namespace SparseMatrix
+
+#endif // header inclusion
@@ -0,0 +1,711 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_IRAM__H__
+#define __DJS_IRAM__H__
+
+#include <algorithm>
+#include <cmath>
+
+#include <Krylov.h>
+#include <francis.h>
+
+/*
+ * Implicitly Restarted Arnoldi Method (Sorensen; Lehoucq and Sorensen,
+ * the method behind ARPACK) for a few eigenvalues of a large sparse
+ * matrix.
+ *
+ * An m step Arnoldi factorisation, AVm = VmHm + f em', is built with
+ * Krylov_t.  The eigenvalues of the small Hm (the Ritz values) are found
+ * with EigenFrancis_t.  The m - k unwanted Ritz values are used as
+ * shifts of implicit QR steps on Hm, which filters their directions out
+ * of the starting vector.  The factorisation is then truncated to k
+ * steps and extended to m again, so storage is bounded by m + 1 vectors
+ * of length n (m defaults to 2k + 1).
+ *
+ * For symmetric matrices the basis is extended with the Lanczos three
+ * term recurrence (with a full reorthogonalisation pass to keep the basis
+ * orthonormal), Hm is kept symmetric tridiagonal and all shifts are real.
+ *
+ */
+
+class IRAM_t : private Krylov_t
+{
+public:
+
+	enum which_t {
+
+		LargestMagnitude,
+		SmallestMagnitude,
+		LargestReal,
+		SmallestReal
+	};
+
+private:
+
+	int				ir_k;			// number of wanted eigenvalues
+	which_t			ir_which;
+	bool			ir_symmetric;	// use Lanczos
+	double			ir_tolerance;
+	int				ir_maxRestarts;
+	int				ir_restarts;
+
+	int				ir_nRitz;		// Ritz values (conjugates expanded)
+	conj_t			*ir_ritz;
+	double			*ir_estimate;	// residual estimates of the Ritz pairs
+	int				ir_nconv;
+
+	double Key (conj_t &);
+	int Ritz (void);
+	bool Exact (void);
+	void Estimate (int);
+	void ShiftReal (Md_t &, Md_t &, int, double);
+	void ShiftDouble (Md_t &, Md_t &, int, conj_t &);
+	void Compress (Md_t &, Md_t &, int);
+	int RunLanczos (int);
+	int Extend (int);
+
+public:
+
+	IRAM_t (Mo_t &A,
+			Md_t &v0,
+			int k,
+			which_t which = LargestMagnitude,
+			int m = 0) :
+		Krylov_t (A, v0, (m ? m : 2 * k + 1)),
+		ir_k (k),
+		ir_which (which),
+		ir_symmetric (false),
+		ir_tolerance (1e-10),
+		ir_maxRestarts (300),
+		ir_restarts (0),
+		ir_nRitz (0),
+		ir_ritz (new conj_t [k_n]),
+		ir_estimate (new double [k_n]),
+		ir_nconv (0)
+	{
+		if (k < 1 || k_n < k + 2 || k_n > A.rows ())
+			throw ("IRAM: require 1 <= k, k + 2 <= m <= n");
+
+		/*
+		 * After a few restarts the compressed basis drifts from
+		 * orthogonal and the Ritz values with it, always take the
+		 * second pass.
+		 *
+		 */
+		Reorthogonalise (Always);
+	}
+
+	~IRAM_t (void)
+	{
+		delete [] ir_ritz;
+		delete [] ir_estimate;
+	}
+
+	void SetSymmetric (bool symmetric)
+	{
+		ir_symmetric = symmetric;
+	}
+
+	// relative accuracy of the Ritz values
+	void SetTolerance (double tolerance)
+	{
+		ir_tolerance = tolerance;
+	}
+
+	void SetMaxRestarts (int restarts)
+	{
+		ir_maxRestarts = restarts;
+	}
+
+	int GetRestarts (void) const
+	{
+		return ir_restarts;
+	}
+
+	int Converged (void) const
+	{
+		return ir_nconv;
+	}
+
+	// the wanted eigenvalues, best first (conjugate pairs adjacent)
+	conj_t &EigenValue (int i)
+	{
+#ifdef __DEBUG
+		assert (i >= 0 && i < ir_k);
+#endif
+		return ir_ritz[i];
+	}
+
+	double Residual (int i)
+	{
+		return ir_estimate[i];
+	}
+
+	bool Solve (void);
+	void EigenVector (int, Md_t &, Md_t &);
+};
+
+/*
+ * Run until the k wanted Ritz values have converged.
+ *
+ */
+
+bool
+IRAM_t::Solve (void)
+{
+	int m = k_n;
+
+	ir_restarts = 0;
+
+	if (Extend (m) < m) // invariant subspace, H is exact
+		return Exact ();
+
+	while (true)
+	{
+		if (Ritz () < ir_k)
+			throw ("IRAM: Francis failed on the projection");
+
+		// a conjugate pair is not split between wanted and unwanted
+		int k = ir_k;
+		if (k < ir_nRitz &&
+			ir_ritz[k - 1].imag != 0 && ir_ritz[k - 1].imag == -ir_ritz[k].imag)
+			++k;
+
+		Estimate (k);
+
+		if (ir_nconv >= ir_k || ir_restarts == ir_maxRestarts)
+			break;
+
+		/*
+		 * Retain more than k Ritz vectors as pairs converge, it speeds up
+		 * the remainder (the ARPACK heuristic).
+		 *
+		 */
+		k += std::min (ir_nconv, (m - k) / 2);
+		if (k > 1 && k < ir_nRitz &&
+			ir_ritz[k - 1].imag != 0 && ir_ritz[k - 1].imag == -ir_ritz[k].imag)
+			--k;
+
+		/*
+		 * Apply the unwanted Ritz values (exact shifts) to Hm
+		 * accumulating the orthogonal similarity in Q.
+		 *
+		 */
+		Md_t H (m, m);
+		Md_t Q (m, m, 1.0);
+
+		for (int j = 0; j < m; ++j)
+			for (int i = 0; i < m; ++i)
+				H(i, j) = (i <= j + 1 ? k_H(i, j) : 0.0);
+
+		for (int i = k; i < ir_nRitz; ++i)
+		{
+			if (ir_ritz[i].imag == 0)
+				ShiftReal (H, Q, m, ir_ritz[i].real);
+			else
+			{
+				ShiftDouble (H, Q, m, ir_ritz[i]);
+				++i;
+			}
+		}
+
+		Compress (H, Q, k);
+
+		// lucky breakdown, the counts of the last restart no longer apply
+		if (Extend (m - k) < m)
+			return Exact ();
+
+		++ir_restarts;
+	}
+
+	return (ir_nconv >= ir_k);
+}
+
+/*
+ * The basis spans an invariant subspace, so H is exact and its Ritz
+ * pairs are eigenpairs of A: every residual is zero.
+ *
+ */
+
+bool
+IRAM_t::Exact (void)
+{
+	Ritz ();
+
+	for (int i = 0; i < ir_nRitz; ++i)
+		ir_estimate[i] = 0;
+
+	ir_nconv = std::min (ir_k, ir_nRitz);
+
+	return (ir_nconv == ir_k);
+}
+
+/*
+ * Extend the factorisation by runs steps, Arnoldi or Lanczos.
+ *
+ */
+
+int
+IRAM_t::Extend (int runs)
+{
+	if (ir_symmetric)
+		return RunLanczos (runs);
+
+	return RunArnoldi (runs);
+}
+
+/*
+ * Lanczos: AQ = QT + f em', T symmetric tridiagonal.
+ *
+ * The coefficients come from the three term recurrence, a second
+ * (classical Gram-Schmidt) pass against the whole basis keeps Q
+ * orthonormal as the Ritz vectors converge.
+ *
+ */
+
+int
+IRAM_t::RunLanczos (int runs)
+{
+	int rows = k_Q.rows ();
+	Md_t v;
+	Md_t qi;
+
+	if (k_i + runs > k_n)
+		runs = k_n - k_i;
+
+	for (int i = 0; i < runs; ++i, ++k_i)
+	{
+		double beta = (k_i > 0 ? k_H (k_i, k_i - 1) : 0.0);
+		double alpha;
+		double *vptr;
+		double *qptr;
+
+		v = k_Q.vec_view (k_i + 1);
+		qi = k_Q.vec_view (k_i);
+
+		MatrixVectorProduct (k_A, qi, v);
+
+		alpha = qi.vec_dot (v);
+
+		vptr = v.raw ();
+		qptr = qi.raw ();
+		for (int k = 0; k < rows; ++k)
+			vptr[k] -= alpha * qptr[k];
+
+		if (k_i > 0)
+		{
+			vptr = v.raw ();
+			qptr = k_Q.raw () + (k_i - 1) * k_Q.stride ();
+			for (int k = 0; k < rows; ++k)
+				vptr[k] -= beta * qptr[k];
+		}
+
+		// reorthogonalise
+		for (int j = 0; j <= k_i; ++j)
+		{
+			double h;
+
+			qptr = k_Q.raw () + j * k_Q.stride ();
+			vptr = v.raw ();
+
+			h = 0;
+			for (int k = 0; k < rows; ++k)
+				h += qptr[k] * vptr[k];
+
+			for (int k = 0; k < rows; ++k)
+				vptr[k] -= h * qptr[k];
+
+			if (j == k_i)
+				alpha += h;
+		}
+
+		k_H (k_i, k_i) = alpha;
+		beta = v.vec_magnitude ();
+		k_H (k_i + 1, k_i) = beta;
+		if (k_i + 1 < k_n)
+			k_H (k_i, k_i + 1) = beta;
+
+		if (beta == 0)
+			return k_i;
+
+		v /= beta;
+	}
+
+	return k_i;
+}
+
+/*
+ * Sorting key, smallest is best.
+ *
+ */
+
+double
+IRAM_t::Key (conj_t &theta)
+{
+	switch (ir_which)
+	{
+	case LargestMagnitude:
+
+		return -theta.modulus ();
+
+	case SmallestMagnitude:
+
+		return theta.modulus ();
+
+	case LargestReal:
+
+		return -theta.real;
+
+	case SmallestReal:
+
+		return theta.real;
+	}
+
+	return 0;
+}
+
+/*
+ * Compute the Ritz values (eigenvalues of Hm) and sort them so that the
+ * wanted ones come first.  EigenFrancis_t reports a conjugate pair once,
+ * here both are listed.
+ *
+ */
+
+int
+IRAM_t::Ritz (void)
+{
+	int m = k_i;
+	Md_t H (m, m);
+	EigenFrancis_t FR;
+
+	for (int j = 0; j < m; ++j)
+		for (int i = 0; i < m; ++i)
+			H(i, j) = (i <= j + 1 ? k_H(i, j) : 0.0);
+
+	FR.CalcEigenValuesHessenberg (H);
+
+	ir_nRitz = 0;
+
+	for (int i = 0; i < FR.ef_N && ir_nRitz < m; ++i)
+	{
+		ir_ritz[ir_nRitz++] = FR.ef_EigenValues[i];
+
+		if (FR.ef_EigenValues[i].imag == 0 || ir_nRitz == m)
+			continue;
+
+		ir_ritz[ir_nRitz - 1].imag = fabs (FR.ef_EigenValues[i].imag);
+		ir_ritz[ir_nRitz] = FR.ef_EigenValues[i];
+		ir_ritz[ir_nRitz].imag = -ir_ritz[ir_nRitz - 1].imag;
+		++ir_nRitz;
+	}
+
+	std::stable_sort (ir_ritz,
+					ir_ritz + ir_nRitz,
+					[this] (conj_t a, conj_t b)
+					{
+						return Key (a) < Key (b);
+					});
+
+	return ir_nRitz;
+}
+
+/*
+ * The residual of a Ritz pair (θ, Vy) is |f| |em'y|.  Count the wanted
+ * pairs that have converged.
+ *
+ */
+
+void
+IRAM_t::Estimate (int k)
+{
+	int m = k_i;
+	double beta = k_H (m, m - 1);
+	Md_t H (m, m);
+	Md_t u;
+	Md_t v;
+
+	for (int j = 0; j < m; ++j)
+		for (int i = 0; i < m; ++i)
+			H(i, j) = (i <= j + 1 ? k_H(i, j) : 0.0);
+
+	ir_nconv = 0;
+
+	for (int i = 0; i < k; ++i)
+	{
+		double last;
+		double tolerance = ir_tolerance *
+							std::max (ir_ritz[i].modulus (), pow (MACH_EPS, 2.0 / 3));
+
+		EigenFrancis_t::FindEigenVectorComplex (ir_ritz[i], H, u, v);
+
+		last = hypot (u(m - 1, 0), v(m - 1, 0));
+		last /= hypot (u.vec_magnitude (), v.vec_magnitude ());
+
+		ir_estimate[i] = fabs (beta) * last;
+
+		// inverse iteration broke down on an exact eigenvalue of H
+		if (!std::isfinite (ir_estimate[i]))
+			ir_estimate[i] = HUGE_VAL;
+
+		if (i < ir_k && ir_estimate[i] <= tolerance)
+			++ir_nconv;
+	}
+}
+
+/*
+ * One implicit QR step with real shift µ on the Hessenberg H (Givens
+ * rotations chasing the bulge), Q accumulates the rotations.
+ *
+ */
+
+void
+IRAM_t::ShiftReal (Md_t &H, Md_t &Q, int m, double mu)
+{
+	double x = H(0, 0) - mu;
+	double y = H(1, 0);
+	double a;
+	double b;
+
+	for (int j = 0; j < m - 1; ++j)
+	{
+		if (j > 0)
+		{
+			x = H(j, j - 1);
+			y = H(j + 1, j - 1);
+		}
+
+		double r = hypot (x, y);
+		double c = (r == 0 ? 1.0 : x / r);
+		double s = (r == 0 ? 0.0 : y / r);
+
+		// G'H
+		for (int col = (j > 0 ? j - 1 : 0); col < m; ++col)
+		{
+			a = H(j, col);
+			b = H(j + 1, col);
+			H(j, col) = c * a + s * b;
+			H(j + 1, col) = -s * a + c * b;
+		}
+
+		// HG
+		for (int row = 0; row <= j + 2 && row < m; ++row)
+		{
+			a = H(row, j);
+			b = H(row, j + 1);
+			H(row, j) = c * a + s * b;
+			H(row, j + 1) = -s * a + c * b;
+		}
+
+		// QG
+		for (int row = 0; row < m; ++row)
+		{
+			a = Q(row, j);
+			b = Q(row, j + 1);
+			Q(row, j) = c * a + s * b;
+			Q(row, j + 1) = -s * a + c * b;
+		}
+
+		if (j > 0)
+			H(j + 1, j - 1) = 0;
+	}
+}
+
+/*
+ * One implicit double shift (Francis) step with the conjugate pair µ, µ*,
+ * so the arithmetic stays real: the first column of
+ * H^2 - (µ + µ*)H + µµ*I is reflected and the bulge chased with 3 x 3
+ * Householders.
+ *
+ */
+
+void
+IRAM_t::ShiftDouble (Md_t &H, Md_t &Q, int m, conj_t &mu)
+{
+	double s = 2 * mu.real;
+	double t = mu.real * mu.real + mu.imag * mu.imag;
+	double p[3];
+	double v[3];
+	double w;
+
+	p[0] = H(0, 0) * H(0, 0) + H(0, 1) * H(1, 0) - s * H(0, 0) + t;
+	p[1] = H(1, 0) * (H(0, 0) + H(1, 1) - s);
+	p[2] = (m > 2 ? H(2, 1) * H(1, 0) : 0.0);
+
+	for (int k = 0; k < m - 1; ++k)
+	{
+		int nr = (k + 2 < m ? 3 : 2);
+
+		if (k > 0)
+		{
+			p[0] = H(k, k - 1);
+			p[1] = H(k + 1, k - 1);
+			p[2] = (nr == 3 ? H(k + 2, k - 1) : 0.0);
+		}
+
+		double alpha = sqrt (p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+		if (alpha == 0)
+			continue;
+
+		// v = x + sign (x (1)) |x| e1
+		v[0] = p[0] + (p[0] >= 0 ? alpha : -alpha);
+		v[1] = p[1];
+		v[2] = p[2];
+
+		double beta = 2 / (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+
+		// (I - beta vv')H
+		for (int col = (k > 0 ? k - 1 : 0); col < m; ++col)
+		{
+			w = 0;
+			for (int i = 0; i < nr; ++i)
+				w += v[i] * H(k + i, col);
+
+			w *= beta;
+			for (int i = 0; i < nr; ++i)
+				H(k + i, col) -= w * v[i];
+		}
+
+		// H(I - beta vv')
+		for (int row = 0; row <= k + 3 && row < m; ++row)
+		{
+			w = 0;
+			for (int i = 0; i < nr; ++i)
+				w += H(row, k + i) * v[i];
+
+			w *= beta;
+			for (int i = 0; i < nr; ++i)
+				H(row, k + i) -= w * v[i];
+		}
+
+		// Q(I - beta vv')
+		for (int row = 0; row < m; ++row)
+		{
+			w = 0;
+			for (int i = 0; i < nr; ++i)
+				w += Q(row, k + i) * v[i];
+
+			w *= beta;
+			for (int i = 0; i < nr; ++i)
+				Q(row, k + i) -= w * v[i];
+		}
+
+		if (k > 0)
+		{
+			H(k + 1, k - 1) = 0;
+			if (nr == 3)
+				H(k + 2, k - 1) = 0;
+		}
+	}
+}
+
+/*
+ * Truncate the shifted factorisation to k steps:
+ *
+ * A(VmQ) = (VmQ)(Q'HmQ) + f em'Q
+ *
+ * The first k columns of VmQ, the leading k x k block of Q'HmQ and
+ * f' = (VmQ)(:, k)H'(k, k - 1) + f Q(m - 1, k - 1) form a k step
+ * factorisation.
+ *
+ */
+
+void
+IRAM_t::Compress (Md_t &H, Md_t &Q, int k)
+{
+	int m = k_n;
+	int rows = k_Q.rows ();
+	double sigma = k_H (m, m - 1) * Q(m - 1, k - 1);
+	double beta = H(k, k - 1);
+
+	Md_t Vm = k_Q.view (0, 0, rows, m, false);
+	Md_t Qk = Q.view (0, 0, m, k + 1, false);
+	Md_t V = Vm * Qk;
+	Md_t f = k_Q.vec_view (m);
+
+	double *fptr = f.raw ();
+	double *vptr = V.raw () + k * V.stride ();
+	for (int i = 0; i < rows; ++i)
+		fptr[i] = vptr[i] * beta + fptr[i] * sigma;
+
+	for (int j = 0; j < k; ++j)
+	{
+		Md_t q = k_Q.vec_view (j);
+		Md_t v = V.vec_view (j, false);
+
+		q.pipe (v);
+	}
+
+	double fnorm = f.vec_magnitude ();
+	Md_t q = k_Q.vec_view (k);
+	q.pipe (f);
+	if (fnorm > 0)
+		q /= fnorm;
+
+	k_H.zero ();
+	for (int j = 0; j < k; ++j)
+		for (int i = 0; i <= j + 1 && i < k; ++i)
+			k_H(i, j) = H(i, j);
+
+	k_H (k, k - 1) = fnorm;
+	if (ir_symmetric)
+		k_H (k - 1, k) = fnorm;
+
+	k_i = k;
+}
+
+/*
+ * The Ritz vector associated with the i'th wanted Ritz value, re + i im.
+ *
+ */
+
+void
+IRAM_t::EigenVector (int i, Md_t &re, Md_t &im)
+{
+	int m = k_i;
+	int rows = k_Q.rows ();
+	Md_t H (m, m);
+	Md_t u;
+	Md_t v;
+
+	for (int j = 0; j < m; ++j)
+		for (int r = 0; r < m; ++r)
+			H(r, j) = (r <= j + 1 ? k_H(r, j) : 0.0);
+
+	EigenFrancis_t::FindEigenVectorComplex (ir_ritz[i], H, u, v);
+
+	double norm = hypot (u.vec_magnitude (), v.vec_magnitude ());
+	Md_t Vm = k_Q.view (0, 0, rows, m, false);
+
+	re = Vm * u;
+	im = Vm * v;
+	re /= norm;
+	im /= norm;
+}
+
+#endif // header inclusion
+
@@ -0,0 +1,173 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include <assert.h>
+#include <float.h>
+
+#include <algorithm>
+
+#include <IRAM.h> // defines typedef Matrix_t<double> Md_t
+#include <SparseFormat.h>
+
+int Nx = 60;
+int Ny = 47;
+int Wanted = 8;
+
+void run (double, bool);
+
+int main (int argc, char *argv[])
+{
+	long seed = time (0);
+	char opt;
+
+	while (true)
+	{
+		opt = getopt (argc, argv, "s:k:");
+		if (opt == -1)
+			break;
+
+		switch (opt)
+		{
+		case 's':
+
+			seed = atol (optarg);
+			break;
+
+		case 'k':
+
+			Wanted = atoi (optarg);
+			break;
+
+		default:
+
+			printf ("usage: %s [-s seed] [-k wanted]\n", argv[0]);
+			exit (-1);
+		}
+	}
+
+	printf ("Using seed %ld\n", seed);
+
+	srand (seed);
+
+	run (0.0, true);	// symmetric (Lanczos)
+	run (0.8, false);	// convection-diffusion (Arnoldi)
+
+	return 0;
+}
+
+/*
+ * The 5 point discretisation of -Δu + c ∂u/∂x on an Nx x Ny grid (the
+ * scaling is dropped).  With c = 0 it is symmetric.  The off diagonals
+ * in x are -1 ± c / 2; their product is positive for |c| < 2 so the
+ * spectrum is real and known:
+ *
+ * λ = 4 - 2√(ab) cos (iπ / (Nx + 1)) - 2 cos (jπ / (Ny + 1))
+ *
+ */
+void run (double c, bool symmetric)
+{
+	int n = Nx * Ny;
+	double a = -1 - c / 2;
+	double b = -1 + c / 2;
+	SparseMatrix::Triplets_t T (n, n, 5 * n);
+	Md_t v0 (n, 1);
+
+	for (int j = 0; j < Ny; ++j)
+		for (int i = 0; i < Nx; ++i)
+		{
+			int row = j * Nx + i;
+
+			if (j > 0)
+				T.Add (row, row - Nx, -1);
+			if (i > 0)
+				T.Add (row, row - 1, a);
+			T.Add (row, row, 4);
+			if (i < Nx - 1)
+				T.Add (row, row + 1, b);
+			if (j < Ny - 1)
+				T.Add (row, row + Nx, -1);
+		}
+
+	// whichever storage suits the stencil, IRAM_t does not care
+	Mo_t *A = SparseMatrix::Compress (T);
+
+	double *lambda = new double [n];
+	for (int j = 0; j < Ny; ++j)
+		for (int i = 0; i < Nx; ++i)
+			lambda[j * Nx + i] = 4 - 2 * sqrt (a * b) * cos ((i + 1) * M_PI / (Nx + 1)) -
+							2 * cos ((j + 1) * M_PI / (Ny + 1));
+
+	std::sort (lambda, lambda + n, [] (double x, double y) { return x > y; });
+
+	v0.randomly_fill (1.0);
+
+	IRAM_t E (*A, v0, Wanted, IRAM_t::LargestReal);
+	E.SetSymmetric (symmetric);
+	bool rc = E.Solve ();
+
+	printf ("%s: n = %d (%s), %d restarts, %d of %d converged\n",
+		(symmetric ? "Lanczos" : "Arnoldi"),
+		n,
+		A->Format (),
+		E.GetRestarts (),
+		E.Converged (),
+		Wanted);
+
+	assert (rc);
+
+	for (int i = 0; i < Wanted; ++i)
+	{
+		Md_t re;
+		Md_t im;
+
+		E.EigenVector (i, re, im);
+
+		double theta = E.EigenValue (i).real;
+		double residual = (*A * re - theta * re).vec_magnitude ();
+
+		printf ("\t%.10f\t(%.10f)\testimate %e\tresidual %e\n",
+			theta,
+			lambda[i],
+			E.Residual (i),
+			residual);
+
+		// the convection term makes A non-normal, its eigenvalues are
+		// correspondingly more sensitive to the residual
+		assert (E.EigenValue (i).imag == 0);
+		assert (fabs (re.vec_magnitude () - 1) < 1e-8);
+		assert (fabs (theta - lambda[i]) <
+				(symmetric ? 1e-8 : 1e-6) * fabs (lambda[i]));
+		assert (residual < 1e-6);
+	}
+
+	delete [] lambda;
+	delete A;
+}
@@ -0,0 +1,388 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_KERNELS__H__
+#define __DJS_KERNELS__H__
+
+#include <stdint.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * Vectors shorter than this are swept by the calling thread.
+ *
+ */
+#define __KERNEL_PARALLEL	32768
+
+/*
+ * Rows per block of the dense basis kernels, the block of v stays in
+ * cache while every basis vector is swept over it.
+ *
+ */
+#define __KERNEL_BLOCK		1024
+
+/*
+ * In place vector kernels for the iterative solvers, on raw arrays (as
+ * returned by Md_t::raw ()) so an iteration allocates nothing.  Each is
+ * one pass over its operands; the fused ones do in one pass what
+ * Md_t's operators would do in several, so the traffic is the minimum
+ * the algorithm needs.
+ *
+ */
+
+namespace Kernels
+{
+
+inline double Dot (const double * __restrict x, const double * __restrict y, int n)
+{
+	double sum = 0;
+
+#pragma omp parallel for schedule(static) reduction(+:sum) if(n >= __KERNEL_PARALLEL)
+	for (int i = 0; i < n; ++i)
+		sum += x[i] * y[i];
+
+	return sum;
+}
+
+// y += αx
+inline void Axpy (double alpha, const double * __restrict x, double * __restrict y, int n)
+{
+#pragma omp parallel for schedule(static) if(n >= __KERNEL_PARALLEL)
+	for (int i = 0; i < n; ++i)
+		y[i] += alpha * x[i];
+}
+
+// y = x + βy
+inline void Xpby (const double * __restrict x, double beta, double * __restrict y, int n)
+{
+#pragma omp parallel for schedule(static) if(n >= __KERNEL_PARALLEL)
+	for (int i = 0; i < n; ++i)
+		y[i] = x[i] + beta * y[i];
+}
+
+// y = x
+inline void Copy (const double * __restrict x, double * __restrict y, int n)
+{
+#pragma omp parallel for schedule(static) if(n >= __KERNEL_PARALLEL)
+	for (int i = 0; i < n; ++i)
+		y[i] = x[i];
+}
+
+// x = αx
+inline void Scale (double alpha, double * __restrict x, int n)
+{
+#pragma omp parallel for schedule(static) if(n >= __KERNEL_PARALLEL)
+	for (int i = 0; i < n; ++i)
+		x[i] *= alpha;
+}
+
+/*
+ * The BiCGSTAB search direction, p = r + β(p - ωv).
+ *
+ */
+inline void Direction (const double * __restrict r,
+						double beta,
+						double omega,
+						const double * __restrict v,
+						double * __restrict p,
+						int n)
+{
+#pragma omp parallel for schedule(static) if(n >= __KERNEL_PARALLEL)
+	for (int i = 0; i < n; ++i)
+		p[i] = r[i] + beta * (p[i] - omega * v[i]);
+}
+
+/*
+ * The CG update: x += αp, r -= αq, returns |r|².  One pass instead of
+ * three.
+ *
+ */
+inline double Update (double alpha,
+					const double * __restrict p,
+					const double * __restrict q,
+					double * __restrict x,
+					double * __restrict r,
+					int n)
+{
+	double sum = 0;
+
+#pragma omp parallel for schedule(static) reduction(+:sum) if(n >= __KERNEL_PARALLEL)
+	for (int i = 0; i < n; ++i)
+	{
+		x[i] += alpha * p[i];
+		r[i] -= alpha * q[i];
+		sum += r[i] * r[i];
+	}
+
+	return sum;
+}
+
+/*
+ * q = Ap for a dense column major A (leading dimension lda) while p is
+ * updated to r + βp.  Each p_j is formed just before column j reads it,
+ * so the search direction update costs no pass of its own.  Returns p·q.
+ *
+ */
+inline double DirectionProduct (const double * __restrict A,
+								int lda,
+								const double * __restrict r,
+								double beta,
+								double * __restrict p,
+								double * __restrict q,
+								int n)
+{
+	for (int i = 0; i < n; ++i)
+		q[i] = 0;
+
+	for (int j = 0; j < n; ++j)
+	{
+		const double * __restrict a = A + (int64_t) j * lda;
+		double pj = (p[j] = r[j] + beta * p[j]);
+
+		for (int i = 0; i < n; ++i)
+			q[i] += a[i] * pj;
+	}
+
+	return Dot (p, q, n);
+}
+
+/*
+ * h = Qᵀv over the first k columns of a column major Q (leading
+ * dimension ldq), n rows.  Returns v·v, which comes for free as v is
+ * already being streamed.
+ *
+ */
+inline double Project (const double * __restrict Q,
+						int ldq,
+						int k,
+						const double * __restrict v,
+						double * __restrict h,
+						int n)
+{
+	int blocks = (n + __KERNEL_BLOCK - 1) / __KERNEL_BLOCK;
+	double vv = 0;
+
+	for (int j = 0; j < k; ++j)
+		h[j] = 0;
+
+#pragma omp parallel for schedule(static) reduction(+:vv, h[:k]) if(n >= __KERNEL_PARALLEL)
+	for (int b = 0; b < blocks; ++b)
+	{
+		int lo = b * __KERNEL_BLOCK;
+		int hi = (lo + __KERNEL_BLOCK < n ? lo + __KERNEL_BLOCK : n);
+
+		for (int i = lo; i < hi; ++i)
+			vv += v[i] * v[i];
+
+		for (int j = 0; j < k; ++j)
+		{
+			const double * __restrict q = Q + (int64_t) j * ldq;
+			double sum = 0;
+
+			for (int i = lo; i < hi; ++i)
+				sum += q[i] * v[i];
+
+			h[j] += sum;
+		}
+	}
+
+	return vv;
+}
+
+/*
+ * v -= Qh over the first k columns of Q, returns |v|² of the result.
+ *
+ */
+inline double Subtract (const double * __restrict Q,
+						int ldq,
+						int k,
+						const double * __restrict h,
+						double * __restrict v,
+						int n)
+{
+	int blocks = (n + __KERNEL_BLOCK - 1) / __KERNEL_BLOCK;
+	double vv = 0;
+
+#pragma omp parallel for schedule(static) reduction(+:vv) if(n >= __KERNEL_PARALLEL)
+	for (int b = 0; b < blocks; ++b)
+	{
+		int lo = b * __KERNEL_BLOCK;
+		int hi = (lo + __KERNEL_BLOCK < n ? lo + __KERNEL_BLOCK : n);
+
+		for (int j = 0; j < k; ++j)
+		{
+			const double * __restrict q = Q + (int64_t) j * ldq;
+			double hj = h[j];
+
+			for (int i = lo; i < hi; ++i)
+				v[i] -= hj * q[i];
+		}
+
+		for (int i = lo; i < hi; ++i)
+			vv += v[i] * v[i];
+	}
+
+	return vv;
+}
+
+/*
+ * H = QᵀW for the first k columns of Q and p columns of W, H is k x p
+ * with leading dimension k.  Each block of a column of Q is read once
+ * for all p columns of W, the block analogue of Project.
+ *
+ */
+inline void ProjectBlock (const double * __restrict Q,
+							int ldq,
+							int k,
+							const double * __restrict W,
+							int ldw,
+							int p,
+							double * __restrict H,
+							int n)
+{
+	int blocks = (n + __KERNEL_BLOCK - 1) / __KERNEL_BLOCK;
+	int kp = k * p;
+
+	for (int j = 0; j < kp; ++j)
+		H[j] = 0;
+
+#pragma omp parallel for schedule(static) reduction(+:H[:kp]) if(n >= __KERNEL_PARALLEL)
+	for (int b = 0; b < blocks; ++b)
+	{
+		int lo = b * __KERNEL_BLOCK;
+		int hi = (lo + __KERNEL_BLOCK < n ? lo + __KERNEL_BLOCK : n);
+
+		for (int j = 0; j < k; ++j)
+		{
+			const double * __restrict q = Q + (int64_t) j * ldq;
+			int l = 0;
+
+			// four columns of W at a time, four independent sums
+			for (; l + 4 <= p; l += 4)
+			{
+				const double * __restrict w0 = W + (int64_t) l * ldw;
+				const double * __restrict w1 = w0 + ldw;
+				const double * __restrict w2 = w1 + ldw;
+				const double * __restrict w3 = w2 + ldw;
+				double s0 = 0;
+				double s1 = 0;
+				double s2 = 0;
+				double s3 = 0;
+
+				for (int i = lo; i < hi; ++i)
+				{
+					s0 += q[i] * w0[i];
+					s1 += q[i] * w1[i];
+					s2 += q[i] * w2[i];
+					s3 += q[i] * w3[i];
+				}
+
+				H[l * k + j] += s0;
+				H[(l + 1) * k + j] += s1;
+				H[(l + 2) * k + j] += s2;
+				H[(l + 3) * k + j] += s3;
+			}
+
+			for (; l < p; ++l)
+			{
+				const double * __restrict w = W + (int64_t) l * ldw;
+				double sum = 0;
+
+				for (int i = lo; i < hi; ++i)
+					sum += q[i] * w[i];
+
+				H[l * k + j] += sum;
+			}
+		}
+	}
+}
+
+/*
+ * W -= QH, H as ProjectBlock leaves it.
+ *
+ */
+inline void SubtractBlock (const double * __restrict Q,
+							int ldq,
+							int k,
+							const double * __restrict H,
+							double * __restrict W,
+							int ldw,
+							int p,
+							int n)
+{
+	int blocks = (n + __KERNEL_BLOCK - 1) / __KERNEL_BLOCK;
+
+#pragma omp parallel for schedule(static) if(n >= __KERNEL_PARALLEL)
+	for (int b = 0; b < blocks; ++b)
+	{
+		int lo = b * __KERNEL_BLOCK;
+		int hi = (lo + __KERNEL_BLOCK < n ? lo + __KERNEL_BLOCK : n);
+
+		int j = 0;
+
+		// four columns of Q at a time, a quarter of the traffic on W
+		for (; j + 4 <= k; j += 4)
+		{
+			const double * __restrict q0 = Q + (int64_t) j * ldq;
+			const double * __restrict q1 = q0 + ldq;
+			const double * __restrict q2 = q1 + ldq;
+			const double * __restrict q3 = q2 + ldq;
+
+			for (int l = 0; l < p; ++l)
+			{
+				double * __restrict w = W + (int64_t) l * ldw;
+				double h0 = H[l * k + j];
+				double h1 = H[l * k + j + 1];
+				double h2 = H[l * k + j + 2];
+				double h3 = H[l * k + j + 3];
+
+				for (int i = lo; i < hi; ++i)
+					w[i] -= h0 * q0[i] + h1 * q1[i] + h2 * q2[i] + h3 * q3[i];
+			}
+		}
+
+		for (; j < k; ++j)
+		{
+			const double * __restrict q = Q + (int64_t) j * ldq;
+
+			for (int l = 0; l < p; ++l)
+			{
+				double * __restrict w = W + (int64_t) l * ldw;
+				double hj = H[l * k + j];
+
+				for (int i = lo; i < hi; ++i)
+					w[i] -= hj * q[i];
+			}
+		}
+	}
+}
+
+} // namespace Kernels
+
+#endif // header inclusion
@@ -28,11 +28,59 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef __DJS_ARNOLDI__H__
 #define __DJS_ARNOLDI__H__
 
+#include <time.h>
+#include <functional>
+
 #include <matrix.h>
-#include <SparseMatrix.h>
+#include <CSRMatrix.h>
+#include <MatrixFree.h>
+#include <Preconditioner.h>
+#include <Kernels.h>
 
 typedef Matrix_t<double> Md_t;
-typedef SparseMatrix::SparseMatrix_t Ms_t;
+typedef SparseMatrix::CSRMatrix_t Ms_t;
+typedef SparseMatrix::SparseOperator_t Mo_t;	// any storage format
+typedef SparseMatrix::Preconditioner_t Mp_t;
+/*
+ * A flexible preconditioner, z = M(r).  It may differ from call to call
+ * and must write z in place (raw () or pipe ()), z is a view of the basis.
+ *
+ */
+typedef std::function<void (Md_t &, Md_t &)> Mf_t;
+
+/*
+ * What a solve cost.  The preconditioner is timed on its own, when it
+ * is an inner solver it can dwarf the products with A.
+ *
+ */
+struct SolverStats_t
+{
+	int			ss_iterations;	// restarts, or outer iterations
+	int			ss_steps;		// Krylov steps
+	int			ss_matvecs;		// products with A
+	int			ss_applies;		// preconditioner applications
+	double		ss_precondition;	// seconds in the preconditioner
+	double		ss_total;		// seconds in the solver
+
+	SolverStats_t (void) :
+		ss_iterations (0),
+		ss_steps (0),
+		ss_matvecs (0),
+		ss_applies (0),
+		ss_precondition (0),
+		ss_total (0)
+	{
+	}
+
+	static double Now (void)
+	{
+		struct timespec ts;
+
+		clock_gettime (CLOCK_MONOTONIC, &ts);
+
+		return ts.tv_sec + ts.tv_nsec * 1e-9;
+	}
+};
 
 /*
  * Computes a Krylov subspace, Kn = { b, An, ..., A^(n-1)b }, with
@@ -43,11 +91,40 @@ typedef SparseMatrix::SparseMatrix_t Ms_t;
  * It is a struct as to be useful it needs to be inherited by a class
  * that uses it (e.g. GMRES or IRAM).
  *
+ * With a preconditioner M the subspace is built from M⁻¹A (left) or
+ * AM⁻¹ (right) instead of A.  Left preconditioning changes the residual
+ * being minimised to M⁻¹r, right leaves it alone but the solution is
+ * M⁻¹ of the one found in the subspace.
+ *
+ * A flexible preconditioner (FGMRES, Saad 1993) is any callable and may
+ * change from one step to the next, an inner Krylov solve or a multigrid
+ * cycle.  AM⁻¹ is then no longer one operator, so zj = Mj(qj) is kept
+ * in Z and the solution is found in its span, AZm = Vm+1Hm.
+ *
+ * The basis is orthogonalised with classical Gram-Schmidt, twice if
+ * need be (CGS2).  A single pass of CGS loses orthogonality when v is
+ * nearly in the span of the basis, which shows as a large cancellation
+ * in |v|.  Selective only repeats the pass when |v| drops below η of
+ * its length before projection (Daniel, Gragg, Kaufman and Stewart,
+ * 1976), twice is enough.
+ *
  */
 
 struct Krylov_t 
 {
-	Ms_t		&k_A;
+	enum side_t {
+		Left,
+		Right,
+		Flexible
+	};
+
+	enum reorth_t {
+		Always,
+		Selective,
+		Never
+	};
+
+	Mo_t		&k_A;
 	Md_t		k_b;
 	Md_t		k_x0;
 	Md_t		k_e1;
@@ -58,9 +135,25 @@ struct Krylov_t
 	int			k_n;			// maximum number of iterations
 	int			k_i;			// iterations so far
 
-	Krylov_t (Ms_t &A, Md_t &b, int n) :
+	Mp_t		*k_M;			// preconditioner, or NULL
+	side_t		k_side;
+	Md_t		k_z;			// scratch for M⁻¹
+	Mf_t		k_F;			// flexible preconditioner
+	Md_t		k_Z;			// zj = Mj(qj) when flexible
+
+	reorth_t	k_reorth;
+	Md_t		k_c;			// second pass corrections
+	int			k_passes;		// second passes so far
+
+	SolverStats_t	k_stats;
+
+	Krylov_t (Mo_t &A, Md_t &b, int n) :
 		k_A (A),
-		k_b (b)
+		k_b (b),
+		k_M (0),
+		k_side (Right),
+		k_reorth (Selective),
+		k_passes (0)
 	{
 		Restart (b, n);
 	}
@@ -77,12 +170,17 @@ struct Krylov_t
 		Md_t H (k_n + 1, k_n, 0.0, true);
 		Md_t Q (k_A.rows (), k_n + 1);
 		Md_t e1 (H.rows (), 1, 0.0);
+		Md_t c (k_n + 1, 1);
 
 		k_e1 = e1;
+		k_c = c;
 
 		k_H = H;
 		k_Q = Q;
 
+		if (k_side == Flexible && k_Z.columns () < k_n)
+			k_Z = Md_t (k_A.rows (), k_n);
+
 		Md_t v = k_Q.vec_view (0);
 		v.pipe (x0);
 		double bnorm = x0.vec_magnitude ();
@@ -106,71 +204,152 @@ struct Krylov_t
 		return I.equal_eps (_I, 1e-10);
 	}
 
+	/*
+	 * z = M⁻¹r, timed.
+	 *
+	 */
+	void Apply (Md_t &r, Md_t &z)
+	{
+		double start = SolverStats_t::Now ();
+
+		if (k_side == Flexible)
+			k_F (r, z);
+		else
+			k_M->Apply (r, z);
+
+		k_stats.ss_precondition += SolverStats_t::Now () - start;
+		++k_stats.ss_applies;
+	}
+
+	/*
+	 * M (which must outlive this) is applied from now on.  A left
+	 * preconditioner changes the starting vector to M⁻¹b.
+	 *
+	 */
+	void Precondition (Mp_t *M, side_t side)
+	{
+		if (side == Flexible)
+			throw ("Krylov: a flexible preconditioner is a callable");
+
+		k_M = M;
+		k_side = side;
+		k_z = Md_t (k_A.rows (), 1);
+
+		if (M && side == Left)
+		{
+			Apply (k_b, k_z);
+			Restart (k_z, k_n);
+		}
+		else
+			Restart (k_b, k_n);
+	}
+
+	void Precondition (Mf_t F)
+	{
+		k_M = 0;
+		k_F = F;
+		k_side = Flexible;
+		k_Z = Md_t (k_A.rows (), k_n);
+
+		Restart (k_b, k_n);
+	}
+
+	bool Preconditioned (void) const
+	{
+		return (k_M || k_side == Flexible);
+	}
+
+	/*
+	 * v = Aq, M⁻¹Aq, AM⁻¹q or AMi(q).
+	 *
+	 * This matrix vector product is critical to performance.  It is the
+	 * most expensive operation in the procedure.
+	 *
+	 */
+	void Operator (Md_t &q, Md_t &v)
+	{
+		++k_stats.ss_matvecs;
+
+		if (k_side == Flexible)
+		{
+			Md_t z = k_Z.vec_view (k_i);
+
+			Apply (q, z);
+			MatrixVectorProduct (k_A, z, v);
+		}
+		else if (!k_M)
+			MatrixVectorProduct (k_A, q, v);
+		else if (k_side == Right)
+		{
+			Apply (q, k_z);
+			MatrixVectorProduct (k_A, k_z, v);
+		}
+		else
+		{
+			MatrixVectorProduct (k_A, q, k_z);
+			Apply (k_z, v);
+		}
+	}
+
+	void Reorthogonalise (reorth_t reorth)
+	{
+		k_reorth = reorth;
+	}
+
 	int RunArnoldi (int runs);
 };
 
 int Krylov_t::RunArnoldi (int runs)
 {
-	Md_t v;
-	Md_t qi;
-	Md_t hi;
-	Md_t __x;
-	Md_t r;
-	Md_t r0;
+	const double eta2 = 0.5;	// η = 1/√2
 	int rows = k_Q.rows ();
+	int ldq = k_Q.stride ();
+	const double *Q = k_Q.raw ();
+	double *c = k_c.raw ();
 
 	if (k_i + runs > k_n)
 		runs = k_n - k_i;
 
 	for (int i = 0; i < runs; ++i, ++k_i)
 	{
-		v = k_Q.vec_view (k_i + 1);
-		qi = k_Q.vec_view (k_i);
-		/*
-		 * This matrix vector product is critical to performance.  It is
-		 * the most expensive operation in the procedure.
-		 *
-		 */
-		v.pipe (k_A * qi);
+		Md_t v = k_Q.vec_view (k_i + 1);
+		Md_t qi = k_Q.vec_view (k_i);
 
-		hi = k_H.vec_view (k_i);
+		Operator (qi, v);
 
 		/*
-		 * Compute the projections for the Hessenberg in column i
+		 * Only the k_i + 1 vectors of the basis found so far take part,
+		 * the projections land directly in column i of the Hessenberg.
 		 *
 		 */
+		int k = k_i + 1;
+		double *h = k_H.raw () + (int64_t) k_i * k_H.stride ();
+		double *vptr = v.raw ();
 
-		hi.pipe (transpose (k_Q) * v);
+		double before = Kernels::Project (Q, ldq, k, vptr, h, rows);
+		double after = Kernels::Subtract (Q, ldq, k, h, vptr, rows);
 
-		/*
-		 * vi -= ∑ Hj * qj
-		 *
-		 * Modified Gram-Schmidt process
-		 *
-		 */
-
-		double *Qptr = k_Q.raw ();
-		double *vptr;
-		double alpha;
-
-		for (int j = 0; j <= k_i; ++j)
+		if (k_reorth == Always || (k_reorth == Selective && after < eta2 * before))
 		{
-			vptr = v.raw ();
-			alpha = k_H (j, k_i);
+			Kernels::Project (Q, ldq, k, vptr, c, rows);
+			after = Kernels::Subtract (Q, ldq, k, c, vptr, rows);
+
+			for (int j = 0; j < k; ++j)
+				h[j] += c[j];
 
-			for (int k = 0; k < rows; ++k)
-				*vptr++ -= alpha * *Qptr++;
+			++k_passes;
 		}
 
-		k_H (k_i + 1, k_i) = v.vec_magnitude ();
-		if (k_H (k_i + 1, k_i) == 0)
+		double beta = sqrt (after);
+
+		k_H (k_i + 1, k_i) = beta;
+		if (beta == 0)
 			return k_i;
 
-		v /= k_H (k_i + 1, k_i);
+		v /= beta;
 	}
 
 	return k_i;
 }
 
 #endif // header inclusion
-
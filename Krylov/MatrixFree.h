@@ -0,0 +1,269 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_MATRIX_FREE__H__
+#define __DJS_MATRIX_FREE__H__
+
+#include <functional>
+#include <vector>
+
+#include <SparseOperator.h>
+
+namespace SparseMatrix
+{
+
+/*
+ * Operators that are not stored in a sparse format.  They implement
+ * SparseOperator_t, so every solver that takes one (Krylov_t, GMRES_t,
+ * BlockGMRES_t, IRAM_t, PCG_t, PipelinedCG_t, BiCGSTAB_t, IDR_t) runs on
+ * them unchanged.
+ *
+ */
+
+/*
+ * A dense matrix, shared copy-on-write with the caller.  The product
+ * sweeps the columns over one block of rows at a time, so A is read with
+ * unit stride and the block of y stays in cache.
+ *
+ */
+
+class DenseOperator_t : public SparseOperator_t
+{
+	Md_t			do_A;
+
+public:
+
+	DenseOperator_t (Md_t &A) :
+		do_A (A)
+	{
+	}
+
+	~DenseOperator_t (void)
+	{
+	}
+
+	int rows (void)
+	{
+		return do_A.rows ();
+	}
+
+	int columns (void)
+	{
+		return do_A.columns ();
+	}
+
+	int64_t nnz (void)
+	{
+		return (int64_t) do_A.rows () * do_A.columns ();
+	}
+
+	const char *Format (void)
+	{
+		return "dense";
+	}
+
+	void Multiply (double alpha, const double *x, double beta, double *y)
+	{
+		int rows = do_A.rows ();
+		int columns = do_A.columns ();
+		int lda = do_A.stride ();
+		const double * __restrict A = do_A.raw ();
+		int blocks = (rows + __KERNEL_BLOCK - 1) / __KERNEL_BLOCK;
+
+		// one region per product, each block of y swept by every column
+#pragma omp parallel for schedule(static) if((int64_t) rows * columns >= __KERNEL_PARALLEL)
+		for (int b = 0; b < blocks; ++b)
+		{
+			int lo = b * __KERNEL_BLOCK;
+			int hi = (lo + __KERNEL_BLOCK < rows ? lo + __KERNEL_BLOCK : rows);
+
+			for (int i = lo; i < hi; ++i)
+				y[i] = (beta == 0 ? 0 : beta * y[i]);
+
+			for (int j = 0; j < columns; ++j)
+			{
+				const double * __restrict a = A + (int64_t) j * lda;
+				double xj = alpha * x[j];
+
+				for (int i = lo; i < hi; ++i)
+					y[i] += xj * a[i];
+			}
+		}
+	}
+
+	// a column of A is a row of Aᵀ, one dot product each
+	void MultiplyTranspose (double alpha, const double *x, double beta, double *y)
+	{
+		int rows = do_A.rows ();
+		int columns = do_A.columns ();
+		int lda = do_A.stride ();
+		double *A = do_A.raw ();
+
+#pragma omp parallel for schedule(static) if((int64_t) rows * columns >= __KERNEL_PARALLEL)
+		for (int j = 0; j < columns; ++j)
+		{
+			double sum = 0;
+
+			for (int i = 0; i < rows; ++i)
+				sum += A[(int64_t) j * lda + i] * x[i];
+
+			y[j] = alpha * sum + (beta == 0 ? 0 : beta * y[j]);
+		}
+	}
+};
+
+/*
+ * A matrix free operator: apply (x, y) computes y = Ax, and transpose,
+ * if given, y = Aᵀx, both with x and y raw vectors of the dimensions.
+ *
+ * They are template parameters, so a stencil written as a functor (or a
+ * lambda) is inlined into Multiply.  The only indirection left is the
+ * one virtual call per product of SparseOperator_t.  std::function
+ * works too when the operator must be chosen at run time, at the cost of
+ * a second call.
+ *
+ * y = αAx + βy with α ≠ 1 or β ≠ 0 goes through a scratch vector, apply
+ * only ever overwrites.
+ *
+ */
+
+template <class F, class T = F>
+class MatrixFree_t : public SparseOperator_t
+{
+	int					mf_rows;
+	int					mf_columns;
+	F					mf_apply;
+	T					mf_transpose;
+	bool				mf_transposed;	// was given a transpose
+	std::vector<double>	mf_scratch;
+
+	// y = αs + βy, s holds the product
+	void Combine (double alpha, double beta, double *y, int n)
+	{
+		double *s = mf_scratch.data ();
+
+		if (beta == 0)
+		{
+			Kernels::Copy (s, y, n);
+			Kernels::Scale (alpha, y, n);
+		}
+		else
+		{
+			Kernels::Scale (beta, y, n);
+			Kernels::Axpy (alpha, s, y, n);
+		}
+	}
+
+public:
+
+	MatrixFree_t (int rows, int columns, F apply) :
+		mf_rows (rows),
+		mf_columns (columns),
+		mf_apply (apply),
+		mf_transpose (apply),
+		mf_transposed (false)
+	{
+		if (rows < 1 || columns < 1)
+			throw ("MatrixFree: illegal dimension");
+	}
+
+	MatrixFree_t (int rows, int columns, F apply, T transpose) :
+		mf_rows (rows),
+		mf_columns (columns),
+		mf_apply (apply),
+		mf_transpose (transpose),
+		mf_transposed (true)
+	{
+		if (rows < 1 || columns < 1)
+			throw ("MatrixFree: illegal dimension");
+	}
+
+	~MatrixFree_t (void)
+	{
+	}
+
+	int rows (void)
+	{
+		return mf_rows;
+	}
+
+	int columns (void)
+	{
+		return mf_columns;
+	}
+
+	// nothing is stored
+	int64_t nnz (void)
+	{
+		return 0;
+	}
+
+	const char *Format (void)
+	{
+		return "matrix free";
+	}
+
+	void Multiply (double alpha, const double *x, double beta, double *y)
+	{
+		if (alpha == 1 && beta == 0)
+		{
+			mf_apply (x, y);
+			return;
+		}
+
+		mf_scratch.resize (mf_rows);
+		mf_apply (x, mf_scratch.data ());
+
+		Combine (alpha, beta, y, mf_rows);
+	}
+
+	void MultiplyTranspose (double alpha, const double *x, double beta, double *y)
+	{
+		if (!mf_transposed)
+			throw ("MatrixFree: no transpose given");
+
+		if (alpha == 1 && beta == 0)
+		{
+			mf_transpose (x, y);
+			return;
+		}
+
+		mf_scratch.resize (mf_columns);
+		mf_transpose (x, mf_scratch.data ());
+
+		Combine (alpha, beta, y, mf_columns);
+	}
+};
+
+// the type erased form, for operators picked at run time
+typedef std::function<void (const double *, double *)> Apply_t;
+typedef MatrixFree_t<Apply_t> FunctionOperator_t;
+
+} // namespace SparseMatrix
+
+#endif // header inclusion
+
@@ -0,0 +1,69 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_PRECONDITIONER__H__
+#define __DJS_PRECONDITIONER__H__
+
+#include <assert.h>
+
+#include <SparseOperator.h>
+
+namespace SparseMatrix
+{
+
+/*
+ * M ≈ A with M⁻¹ cheap to apply.  A Krylov method run on M⁻¹A (left) or
+ * AM⁻¹ (right) sees a better conditioned, more clustered, spectrum and
+ * needs far fewer iterations.  Derived classes implement z = M⁻¹r.
+ *
+ */
+
+class Preconditioner_t
+{
+public:
+
+	virtual ~Preconditioner_t (void)
+	{
+	}
+
+	virtual int rows (void) = 0;
+
+	// z = M⁻¹r, r and z do not alias
+	virtual void Apply (const double *r, double *z) = 0;
+
+	void Apply (Md_t &r, Md_t &z)
+	{
+		assert (r.columns () == 1 && z.columns () == 1);
+		assert (r.rows () == rows () && z.rows () == rows ());
+
+		Apply (r.raw (), z.raw ());
+	}
+};
+
+} // namespace SparseMatrix
+
+#endif // header inclusion
@@ -0,0 +1,169 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_RELAXATION__H__
+#define __DJS_RELAXATION__H__
+
+#include <ILU.h>	// Triangle_t
+
+namespace SparseMatrix
+{
+
+/*
+ * Jacobi (diagonal) preconditioning, M = diag (A).  Next to free, and
+ * all that is needed when the trouble is badly scaled rows.
+ *
+ */
+
+class Jacobi_t : public Preconditioner_t
+{
+	std::vector<double>		jc_inverse;
+
+public:
+
+	Jacobi_t (CSRMatrix_t &A)
+	{
+		Refactor (A);
+	}
+
+	int rows (void)
+	{
+		return (int) jc_inverse.size ();
+	}
+
+	void Refactor (CSRMatrix_t &A)
+	{
+		jc_inverse.resize (A.rows ());
+
+		for (int i = 0; i < A.rows (); ++i)
+		{
+			double d = A.get (i, i);
+
+			if (d == 0)
+				throw ("Jacobi: zero on the diagonal");
+
+			jc_inverse[i] = 1.0 / d;
+		}
+	}
+
+	void Apply (const double *r, double *z)
+	{
+		const double * __restrict inverse = jc_inverse.data ();
+		int n = rows ();
+
+#pragma omp parallel for schedule(static) if(n >= __CSR_PARALLEL)
+		for (int i = 0; i < n; ++i)
+			z[i] = r[i] * inverse[i];
+	}
+
+	using Preconditioner_t::Apply;
+};
+
+/*
+ * Symmetric SOR.  With A = D + L + U,
+ *
+ * M = ω / (2 - ω) (D / ω + L) (D / ω)⁻¹ (D / ω + U)
+ *
+ * symmetric positive definite when A is and 0 < ω < 2, so it can be
+ * used with CG.  Applying it is a forward and a backward sweep, level
+ * scheduled as the ILU solves are.
+ *
+ */
+
+class SSOR_t : public Preconditioner_t
+{
+	int						ss_n;
+	double					ss_omega;
+	Triangle_t				ss_L;		// D / ω + L
+	Triangle_t				ss_U;		// D / ω + U
+	std::vector<double>		ss_scale;	// (2 - ω) / ω D / ω
+
+public:
+
+	SSOR_t (CSRMatrix_t &A, double omega = 1.0) :
+		ss_n (A.rows ()),
+		ss_omega (omega)
+	{
+		if (A.rows () != A.columns ())
+			throw ("SSOR: matrix not square");
+
+		if (omega <= 0 || omega >= 2)
+			throw ("SSOR: ω must be in (0, 2)");
+
+		// the structure and the level schedules, once
+		ss_L.Strict (A, true);
+		ss_U.Strict (A, false);
+
+		Refactor (A);
+	}
+
+	int rows (void)
+	{
+		return ss_n;
+	}
+
+	// new values of A, same structure
+	void Refactor (CSRMatrix_t &A)
+	{
+		ss_L.Refresh (A);
+		ss_U.Refresh (A);
+
+		ss_L.tr_inverse.resize (ss_n);
+		ss_scale.resize (ss_n);
+
+		for (int i = 0; i < ss_n; ++i)
+		{
+			double d = A.get (i, i);
+
+			if (d == 0)
+				throw ("SSOR: zero on the diagonal");
+
+			ss_L.tr_inverse[i] = ss_omega / d;
+			ss_scale[i] = (2 - ss_omega) / ss_omega * d / ss_omega;
+		}
+
+		ss_U.tr_inverse = ss_L.tr_inverse;
+	}
+
+	void Apply (const double *r, double *z)
+	{
+		memcpy (z, r, ss_n * sizeof (double));
+
+		ss_L.Solve (z);
+
+		for (int i = 0; i < ss_n; ++i)
+			z[i] *= ss_scale[i];
+
+		ss_U.Solve (z);
+	}
+
+	using Preconditioner_t::Apply;
+};
+
+} // namespace SparseMatrix
+
+#endif // header inclusion
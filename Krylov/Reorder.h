@@ -0,0 +1,569 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_REORDER__H__
+#define __DJS_REORDER__H__
+
+#include <stdlib.h>
+
+#include <CSRMatrix.h>
+
+/*
+ * Subgraphs with this many vertices, or fewer, are not dissected further.
+ *
+ */
+#define __REORDER_LEAF	64
+
+namespace SparseMatrix
+{
+
+/*
+ * The adjacency graph of the structure of A + Aᵀ, without self loops.
+ * Reorderings are symmetric so only the pattern of the symmetric part
+ * matters, and an unsymmetric A gets the same treatment as its
+ * symmetrised pattern.
+ *
+ * Breadth first searches are restricted to the vertices carrying a label
+ * (a subgraph); visits are stamped rather than cleared so a search costs
+ * only the vertices it reaches.
+ *
+ */
+
+class Graph_t
+{
+	int						gr_n;
+	std::vector<int64_t>	gr_ptr;
+	std::vector<int>		gr_adj;
+	std::vector<int>		gr_mark;
+	int						gr_stamp;
+
+public:
+
+	Graph_t (CSRMatrix_t &A) :
+		gr_n (A.rows ()),
+		gr_ptr (A.rows () + 1, 0),
+		gr_mark (A.rows (), 0),
+		gr_stamp (0)
+	{
+		if (A.rows () != A.columns ())
+			throw ("reorder: matrix not square");
+
+		int64_t *rowPtr = A.RowPtr ();
+		int *colIdx = A.ColIdx ();
+
+		// upper bound on the degrees: row i of A and column i of A
+		std::vector<int64_t> count (gr_n + 1, 0);
+
+		for (int i = 0; i < gr_n; ++i)
+			for (int64_t k = rowPtr[i]; k < rowPtr[i + 1]; ++k)
+				if (colIdx[k] != i)
+				{
+					++count[i + 1];
+					++count[colIdx[k] + 1];
+				}
+
+		for (int i = 0; i < gr_n; ++i)
+			count[i + 1] += count[i];
+
+		std::vector<int> both (count[gr_n]);
+		std::vector<int64_t> next (count.begin (), count.end () - 1);
+
+		for (int i = 0; i < gr_n; ++i)
+			for (int64_t k = rowPtr[i]; k < rowPtr[i + 1]; ++k)
+				if (colIdx[k] != i)
+				{
+					both[next[i]++] = colIdx[k];
+					both[next[colIdx[k]]++] = i;
+				}
+
+		// sort and drop the duplicates, a_ij and a_ji both present
+#pragma omp parallel for schedule(dynamic, 1024) if(A.nnz () >= __CSR_PARALLEL)
+		for (int i = 0; i < gr_n; ++i)
+		{
+			int *first = both.data () + count[i];
+			int *last = both.data () + count[i + 1];
+
+			std::sort (first, last);
+			gr_ptr[i + 1] = std::unique (first, last) - first;
+		}
+
+		for (int i = 0; i < gr_n; ++i)
+			gr_ptr[i + 1] += gr_ptr[i];
+
+		gr_adj.resize (gr_ptr[gr_n]);
+
+		for (int i = 0; i < gr_n; ++i)
+			std::copy (both.begin () + count[i],
+						both.begin () + count[i] + (gr_ptr[i + 1] - gr_ptr[i]),
+						gr_adj.begin () + gr_ptr[i]);
+	}
+
+	int vertices (void)
+	{
+		return gr_n;
+	}
+
+	int degree (int v)
+	{
+		return (int) (gr_ptr[v + 1] - gr_ptr[v]);
+	}
+
+	const int *neighbours (int v)
+	{
+		return gr_adj.data () + gr_ptr[v];
+	}
+
+	/*
+	 * The level structure rooted at root of the vertices v with
+	 * label[v] == id (all of them if label is NULL).  order receives the
+	 * vertices level by level, level l is [levels[l], levels[l + 1]).
+	 * The children of a vertex are appended by increasing degree, the
+	 * Cuthill-McKee rule.
+	 *
+	 * Returns the number of levels.
+	 *
+	 */
+	int BreadthFirst (int root,
+					const int *label,
+					int id,
+					std::vector<int> &order,
+					std::vector<int> &levels)
+	{
+		int stamp = ++gr_stamp;
+
+		order.clear ();
+		levels.clear ();
+
+		order.push_back (root);
+		gr_mark[root] = stamp;
+
+		size_t head = 0;
+
+		while (head < order.size ())
+		{
+			size_t tail = order.size ();
+
+			levels.push_back ((int) head);
+
+			for (; head < tail; ++head)
+			{
+				int v = order[head];
+				size_t children = order.size ();
+
+				for (int64_t k = gr_ptr[v]; k < gr_ptr[v + 1]; ++k)
+				{
+					int w = gr_adj[k];
+
+					if (gr_mark[w] == stamp || (label && label[w] != id))
+						continue;
+
+					gr_mark[w] = stamp;
+					order.push_back (w);
+				}
+
+				std::sort (order.begin () + children,
+							order.end (),
+							[this] (int a, int b) {
+								return degree (a) < degree (b);
+							});
+			}
+		}
+
+		levels.push_back ((int) order.size ());
+
+		return (int) levels.size () - 1;
+	}
+
+	/*
+	 * George and Liu: repeatedly restart the search from a vertex of
+	 * least degree in the last level while that deepens the structure.
+	 * The result is a vertex of (nearly) maximal eccentricity, a long
+	 * thin level structure and so a narrow band.
+	 *
+	 * The level structure of the returned root is left in order, levels.
+	 *
+	 */
+	int PseudoPeripheral (int root,
+						const int *label,
+						int id,
+						std::vector<int> &order,
+						std::vector<int> &levels)
+	{
+		int depth = BreadthFirst (root, label, id, order, levels);
+
+		while (true)
+		{
+			int candidate = order[levels[depth - 1]];
+
+			for (int k = levels[depth - 1]; k < levels[depth]; ++k)
+				if (degree (order[k]) < degree (candidate))
+					candidate = order[k];
+
+			std::vector<int> o, l;
+			int d = BreadthFirst (candidate, label, id, o, l);
+
+			if (d <= depth)
+				break;
+
+			root = candidate;
+			depth = d;
+			order.swap (o);
+			levels.swap (l);
+		}
+
+		return root;
+	}
+};
+
+/*
+ * Reverse Cuthill-McKee.  Each connected component is numbered breadth
+ * first from a pseudo-peripheral vertex, then the whole order reversed
+ * (which leaves the bandwidth alone but reduces the profile, and so the
+ * fill of a band or skyline factorisation).
+ *
+ * Returns perm with perm[new] = old.
+ *
+ */
+inline std::vector<int> ReverseCuthillMcKee (CSRMatrix_t &A)
+{
+	Graph_t G (A);
+	int n = G.vertices ();
+	std::vector<int> perm;
+	std::vector<char> numbered (n, 0);
+	std::vector<int> order, levels;
+
+	perm.reserve (n);
+
+	for (int v = 0; v < n; ++v)
+	{
+		if (numbered[v])
+			continue;
+
+		G.PseudoPeripheral (v, 0, 0, order, levels);
+
+		for (int w : order)
+		{
+			numbered[w] = 1;
+			perm.push_back (w);
+		}
+	}
+
+	std::reverse (perm.begin (), perm.end ());
+
+	return perm;
+}
+
+/*
+ * Nested dissection by level structures.  A subgraph is split by the
+ * middle level of a pseudo-peripheral level structure, trimmed to the
+ * vertices that touch the next level (the rest join the first half).
+ * The halves are numbered first, recursively, and the separator last,
+ * so eliminating one half never fills the other.
+ *
+ */
+class Dissection_t
+{
+	Graph_t				nd_G;
+	std::vector<int>	nd_label;
+	std::vector<int>	nd_perm;
+	int					nd_ids;
+	int					nd_leaf;
+
+	/*
+	 * Label every connected component of nodes in one sweep, then split
+	 * each in turn.  A graph of many components (a diagonal block, a
+	 * mesh of separate parts) costs one pass rather than a recursion on
+	 * the remainder per component.
+	 *
+	 */
+	void Dissect (std::vector<int> &nodes)
+	{
+		if ((int) nodes.size () <= nd_leaf)
+		{
+			nd_perm.insert (nd_perm.end (), nodes.begin (), nodes.end ());
+			return;
+		}
+
+		int id = ++nd_ids;
+
+		for (int v : nodes)
+			nd_label[v] = id;
+
+		// components[starts[c], starts[c + 1]) is component c
+		std::vector<int> components, starts, order, levels;
+
+		components.reserve (nodes.size ());
+
+		for (int v : nodes)
+		{
+			if (nd_label[v] != id)
+				continue;
+
+			nd_G.BreadthFirst (v, nd_label.data (), id, order, levels);
+
+			int part = ++nd_ids;
+
+			for (int w : order)
+				nd_label[w] = part;
+
+			starts.push_back ((int) components.size ());
+			components.insert (components.end (), order.begin (), order.end ());
+		}
+
+		starts.push_back ((int) components.size ());
+
+		for (size_t c = 0; c + 1 < starts.size (); ++c)
+		{
+			std::vector<int> part (components.begin () + starts[c],
+									components.begin () + starts[c + 1]);
+
+			if ((int) part.size () <= nd_leaf)
+				nd_perm.insert (nd_perm.end (), part.begin (), part.end ());
+			else
+				Split (part, nd_label[part[0]]);
+		}
+	}
+
+	// nodes is connected and carries label id
+	void Split (std::vector<int> &nodes, int id)
+	{
+		std::vector<int> order, levels;
+
+		nd_G.PseudoPeripheral (nodes[0], nd_label.data (), id, order, levels);
+
+		int depth = (int) levels.size () - 1;
+
+		// too shallow to have a separator worth the name
+		if (depth < 3)
+		{
+			nd_perm.insert (nd_perm.end (), order.begin (), order.end ());
+			return;
+		}
+
+		int half = (int) nodes.size () / 2;
+		int m = 1;
+
+		while (m < depth - 2 && levels[m + 1] < half)
+			++m;
+
+		int second = ++nd_ids;
+
+		for (int k = levels[m + 1]; k < levels[depth]; ++k)
+			nd_label[order[k]] = second;
+
+		std::vector<int> first (order.begin (), order.begin () + levels[m]);
+		std::vector<int> after (order.begin () + levels[m + 1], order.end ());
+		std::vector<int> separator;
+
+		for (int k = levels[m]; k < levels[m + 1]; ++k)
+		{
+			int v = order[k];
+			const int *adj = nd_G.neighbours (v);
+			bool touches = false;
+
+			for (int e = 0; e < nd_G.degree (v) && !touches; ++e)
+				touches = (nd_label[adj[e]] == second);
+
+			if (touches)
+				separator.push_back (v);
+			else
+				first.push_back (v);
+		}
+
+		order.clear ();
+		levels.clear ();
+
+		Dissect (first);
+		Dissect (after);
+
+		nd_perm.insert (nd_perm.end (), separator.begin (), separator.end ());
+	}
+
+public:
+
+	Dissection_t (CSRMatrix_t &A, int leaf) :
+		nd_G (A),
+		nd_label (A.rows (), 0),
+		nd_ids (0),
+		nd_leaf (std::max (leaf, 1))
+	{
+		std::vector<int> all (A.rows ());
+
+		for (int v = 0; v < A.rows (); ++v)
+			all[v] = v;
+
+		nd_perm.reserve (A.rows ());
+
+		if (A.rows ())
+			Dissect (all);
+	}
+
+	std::vector<int> &Permutation (void)
+	{
+		return nd_perm;
+	}
+};
+
+/*
+ * Returns perm with perm[new] = old.
+ *
+ */
+inline std::vector<int> NestedDissection (CSRMatrix_t &A, int leaf = __REORDER_LEAF)
+{
+	Dissection_t D (A, leaf);
+
+	return D.Permutation ();
+}
+
+// inverse[old] = new
+inline std::vector<int> Inverse (const std::vector<int> &perm)
+{
+	std::vector<int> inverse (perm.size ());
+
+	for (size_t i = 0; i < perm.size (); ++i)
+		inverse[perm[i]] = (int) i;
+
+	return inverse;
+}
+
+/*
+ * Returns a new matrix, PAPᵀ (the caller deletes it), where row i of the
+ * result is row perm[i] of A.  Rows are independent so they are copied,
+ * renumbered and sorted in parallel.
+ *
+ */
+inline CSRMatrix_t *Permute (CSRMatrix_t &A, const std::vector<int> &perm)
+{
+	int n = A.rows ();
+
+	if (n != A.columns () || (int) perm.size () != n)
+		throw ("reorder: permutation does not fit");
+
+	std::vector<int> inverse = Inverse (perm);
+	int64_t *rowPtr = A.RowPtr ();
+	int *colIdx = A.ColIdx ();
+	double *values = A.Values ();
+	CSRMatrix_t *B = new CSRMatrix_t (n, n, A.nnz ());
+	int64_t *bPtr = B->RowPtr ();
+	int *bIdx = B->ColIdx ();
+	double *bValues = B->Values ();
+
+	for (int i = 0; i < n; ++i)
+		bPtr[i + 1] = bPtr[i] + (rowPtr[perm[i] + 1] - rowPtr[perm[i]]);
+
+#pragma omp parallel if(A.nnz () >= __CSR_PARALLEL)
+	{
+		std::vector<std::pair<int, double> > row;
+
+#pragma omp for schedule(dynamic, 256)
+		for (int i = 0; i < n; ++i)
+		{
+			int old = perm[i];
+
+			row.clear ();
+
+			for (int64_t k = rowPtr[old]; k < rowPtr[old + 1]; ++k)
+				row.push_back (std::make_pair (inverse[colIdx[k]], values[k]));
+
+			std::sort (row.begin (), row.end (),
+						[] (const std::pair<int, double> &a,
+							const std::pair<int, double> &b) {
+							return a.first < b.first;
+						});
+
+			for (size_t k = 0; k < row.size (); ++k)
+			{
+				bIdx[bPtr[i] + k] = row[k].first;
+				bValues[bPtr[i] + k] = row[k].second;
+			}
+		}
+	}
+
+	return B;
+}
+
+/*
+ * Pv, element i of the result is element perm[i] of v (every column).
+ *
+ */
+inline Md_t Permute (Md_t &v, const std::vector<int> &perm)
+{
+	assert ((int) perm.size () == v.rows ());
+
+	Md_t u (v.rows (), v.columns ());
+
+	for (int c = 0; c < v.columns (); ++c)
+	{
+		const double *from = v.raw () + (int64_t) c * v.stride ();
+		double *to = u.raw () + (int64_t) c * u.stride ();
+
+		for (int i = 0; i < v.rows (); ++i)
+			to[i] = from[perm[i]];
+	}
+
+	return u;
+}
+
+/*
+ * Pᵀv, undoes Permute: a solution in the new numbering back in the old.
+ *
+ */
+inline Md_t Unpermute (Md_t &v, const std::vector<int> &perm)
+{
+	assert ((int) perm.size () == v.rows ());
+
+	Md_t u (v.rows (), v.columns ());
+
+	for (int c = 0; c < v.columns (); ++c)
+	{
+		const double *from = v.raw () + (int64_t) c * v.stride ();
+		double *to = u.raw () + (int64_t) c * u.stride ();
+
+		for (int i = 0; i < v.rows (); ++i)
+			to[perm[i]] = from[i];
+	}
+
+	return u;
+}
+
+// max |i - j| over the non-zeros
+inline int Bandwidth (CSRMatrix_t &A)
+{
+	int64_t *rowPtr = A.RowPtr ();
+	int *colIdx = A.ColIdx ();
+	int band = 0;
+
+	for (int i = 0; i < A.rows (); ++i)
+		for (int64_t k = rowPtr[i]; k < rowPtr[i + 1]; ++k)
+			band = std::max (band, std::abs (colIdx[k] - i));
+
+	return band;
+}
+
+} // namespace SparseMatrix
+
+#endif // header inclusion
@@ -0,0 +1,339 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_SELL_MATRIX__H__
+#define __DJS_SELL_MATRIX__H__
+
+#include <CSRMatrix.h>
+
+/*
+ * Slice height, the number of doubles in a SIMD register, and the window
+ * (in rows) within which rows are sorted by length.
+ *
+ */
+#ifdef __AVX512F__
+#define __SELL_C		8
+#else
+#define __SELL_C		4
+#endif
+
+#define __SELL_SIGMA	(32 * __SELL_C)
+
+namespace SparseMatrix
+{
+
+/*
+ * Sliced ELLPACK, SELL-C-σ (Kreutzer, Hager, Wellein, Fehske and Bishop).
+ *
+ * The rows are cut into slices of C.  A slice is stored as a dense
+ * C x width block, column by column, where width is its longest row and
+ * shorter rows are padded with zeros.  Element j of the C rows of a
+ * slice are adjacent, so SpMV processes C rows at once, one per SIMD
+ * lane, however short and irregular the rows are.
+ *
+ * To limit padding, the rows are sorted by length within windows of σ
+ * rows (σ a multiple of C); the permutation is local so x and y keep
+ * most of their locality.  sl_perm maps a stored row to its row in A.
+ *
+ */
+
+class SELLMatrix_t : public SparseOperator_t
+{
+	int			sl_rows;
+	int			sl_columns;
+	int64_t		sl_nnz;
+	int			sl_slices;
+	int64_t		*sl_slicePtr;	// slice s is [sl_slicePtr[s], sl_slicePtr[s + 1])
+	int			*sl_colIdx;
+	double		*sl_values;
+	int			*sl_perm;		// -1 for the padding rows of the last slice
+
+	// not copyable, share by reference
+	SELLMatrix_t (const SELLMatrix_t &);
+	SELLMatrix_t &operator= (const SELLMatrix_t &);
+
+	/*
+	 * The permutation: rows sorted by decreasing length within each window
+	 * of sigma rows.
+	 *
+	 */
+	static void Sort (CSRMatrix_t &A, int sigma, int *perm)
+	{
+		int rows = A.rows ();
+		int64_t *rowPtr = A.RowPtr ();
+
+		for (int i = 0; i < rows; ++i)
+			perm[i] = i;
+
+#pragma omp parallel for schedule(static)
+		for (int w = 0; w < rows; w += sigma)
+		{
+			int end = (w + sigma < rows ? w + sigma : rows);
+
+			std::stable_sort (perm + w, perm + end, [rowPtr] (int a, int b) {
+				return rowPtr[a + 1] - rowPtr[a] > rowPtr[b + 1] - rowPtr[b];
+			});
+		}
+	}
+
+	// A's rows into the slices, the values and, if structure, the columns
+	void Gather (CSRMatrix_t &A, bool structure)
+	{
+		const int C = __SELL_C;
+		int64_t *rowPtr = A.RowPtr ();
+		int *colIdx = A.ColIdx ();
+		double *values = A.Values ();
+
+#pragma omp parallel for schedule(static)
+		for (int s = 0; s < sl_slices; ++s)
+		{
+			int64_t base = sl_slicePtr[s];
+			int64_t width = (sl_slicePtr[s + 1] - base) / C;
+
+			for (int r = 0; r < C; ++r)
+			{
+				int row = sl_perm[s * C + r];
+				int64_t first = (row < 0 ? 0 : rowPtr[row]);
+				int64_t len = (row < 0 ? 0 : rowPtr[row + 1] - first);
+
+				// padding repeats a column already in use, x stays cached
+				for (int64_t j = 0; j < width; ++j)
+				{
+					bool real = (j < len);
+
+					if (structure)
+						sl_colIdx[base + j * C + r] =
+							(real ? colIdx[first + j] : (len ? colIdx[first + len - 1] : 0));
+
+					sl_values[base + j * C + r] = (real ? values[first + j] : 0.0);
+				}
+			}
+		}
+	}
+
+public:
+
+	SELLMatrix_t (CSRMatrix_t &A, int sigma = __SELL_SIGMA) :
+		sl_rows (A.rows ()),
+		sl_columns (A.columns ()),
+		sl_nnz (A.nnz ())
+	{
+		const int C = __SELL_C;
+		int64_t *rowPtr = A.RowPtr ();
+		int *order = new int [sl_rows];
+
+		if (sigma < C || sigma % C)
+			throw ("SELL: sigma must be a multiple of C");
+
+		Sort (A, sigma, order);
+
+		sl_slices = (sl_rows + C - 1) / C;
+		sl_slicePtr = new int64_t [sl_slices + 1];
+		sl_perm = new int [sl_slices * C];
+
+		sl_slicePtr[0] = 0;
+		for (int s = 0; s < sl_slices; ++s)
+		{
+			int64_t width = 0;
+
+			for (int r = 0; r < C; ++r)
+			{
+				int i = s * C + r;
+
+				sl_perm[i] = (i < sl_rows ? order[i] : -1);
+
+				if (i < sl_rows)
+					width = std::max (width, rowPtr[order[i] + 1] - rowPtr[order[i]]);
+			}
+
+			sl_slicePtr[s + 1] = sl_slicePtr[s] + width * C;
+		}
+
+		delete [] order;
+
+		sl_colIdx = new int [sl_slicePtr[sl_slices]];
+		sl_values = new double [sl_slicePtr[sl_slices]];
+
+		Gather (A, true);
+	}
+
+	~SELLMatrix_t (void)
+	{
+		delete [] sl_slicePtr;
+		delete [] sl_colIdx;
+		delete [] sl_values;
+		delete [] sl_perm;
+	}
+
+	int rows (void)
+	{
+		return sl_rows;
+	}
+
+	int columns (void)
+	{
+		return sl_columns;
+	}
+
+	int64_t nnz (void)
+	{
+		return sl_nnz;
+	}
+
+	const char *Format (void)
+	{
+		return "SELL-C-sigma";
+	}
+
+	/*
+	 * New values from A, which has the structure this was built from
+	 * (see CSRMatrix_t::SetValues).  The slices are reused.
+	 *
+	 */
+	void Update (CSRMatrix_t &A)
+	{
+		if (A.rows () != sl_rows || A.nnz () != sl_nnz)
+			throw ("SELL: structure changed");
+
+		Gather (A, false);
+	}
+
+	// stored entries (with padding) per non-zero
+	double Fill (void)
+	{
+		return (sl_nnz ? (double) sl_slicePtr[sl_slices] / sl_nnz : 1.0);
+	}
+
+	/*
+	 * Fill () of the SELL form of A, without building it.
+	 *
+	 */
+	static double Fill (CSRMatrix_t &A, int sigma = __SELL_SIGMA)
+	{
+		const int C = __SELL_C;
+		int rows = A.rows ();
+		int64_t *rowPtr = A.RowPtr ();
+		int *order = new int [rows];
+		int64_t stored = 0;
+
+		Sort (A, sigma, order);
+
+		for (int s = 0; s < rows; s += C)
+		{
+			int64_t width = 0;
+
+			for (int i = s; i < s + C && i < rows; ++i)
+				width = std::max (width, rowPtr[order[i] + 1] - rowPtr[order[i]]);
+
+			stored += width * C;
+		}
+
+		delete [] order;
+
+		return (A.nnz () ? (double) stored / A.nnz () : 1.0);
+	}
+
+	void Multiply (double alpha, const double *x, double beta, double *y)
+	{
+		const int C = __SELL_C;
+		const int64_t * __restrict slicePtr = sl_slicePtr;
+		const int * __restrict colIdx = sl_colIdx;
+		const double * __restrict values = sl_values;
+		const int * __restrict perm = sl_perm;
+
+#pragma omp parallel for schedule(static) if(sl_nnz >= __CSR_PARALLEL)
+		for (int s = 0; s < sl_slices; ++s)
+		{
+			double sum[C];
+			int64_t end = slicePtr[s + 1];
+			int64_t k = slicePtr[s];
+
+#if defined(__AVX2__) && __SELL_C == 4
+			__m256d acc = _mm256_setzero_pd ();
+			__m256d all = _mm256_castsi256_pd (_mm256_set1_epi64x (-1));
+
+			for (; k < end; k += C)
+			{
+				__m128i index = _mm_loadu_si128 ((const __m128i *) (colIdx + k));
+				__m256d gathered = _mm256_mask_i32gather_pd (acc, x, index, all, 8);
+				__m256d a = _mm256_loadu_pd (values + k);
+
+#ifdef __FMA__
+				acc = _mm256_fmadd_pd (a, gathered, acc);
+#else
+				acc = _mm256_add_pd (acc, _mm256_mul_pd (a, gathered));
+#endif
+			}
+
+			_mm256_storeu_pd (sum, acc);
+#else
+			for (int r = 0; r < C; ++r)
+				sum[r] = 0;
+
+			for (; k < end; k += C)
+				for (int r = 0; r < C; ++r)
+					sum[r] += values[k + r] * x[colIdx[k + r]];
+#endif
+
+			for (int r = 0; r < C; ++r)
+			{
+				int row = perm[s * C + r];
+
+				if (row < 0)
+					continue;
+
+				if (beta == 0)
+					y[row] = alpha * sum[r];
+				else
+					y[row] = alpha * sum[r] + beta * y[row];
+			}
+		}
+	}
+
+	void MultiplyTranspose (double alpha, const double *x, double beta, double *y)
+	{
+		const int C = __SELL_C;
+
+		for (int j = 0; j < sl_columns; ++j)
+			y[j] = (beta == 0 ? 0 : beta * y[j]);
+
+		// padding has value zero, it scatters nothing
+		for (int s = 0; s < sl_slices; ++s)
+			for (int64_t k = sl_slicePtr[s]; k < sl_slicePtr[s + 1]; k += C)
+				for (int r = 0; r < C; ++r)
+				{
+					int row = sl_perm[s * C + r];
+
+					if (row >= 0)
+						y[sl_colIdx[k + r]] += alpha * sl_values[k + r] * x[row];
+				}
+	}
+};
+
+};
+
+#endif // header inclusion
@@ -0,0 +1,304 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_SPGEMM__H__
+#define __DJS_SPGEMM__H__
+
+#include <CSRMatrix.h>
+
+namespace SparseMatrix
+{
+
+/*
+ * Returns a new matrix, Aᵀ (the caller deletes it).
+ *
+ * The rows of A are split into one contiguous range per thread.  Each
+ * thread counts the columns of its range, so the position of every
+ * element in Aᵀ is known before any are moved, and the threads scatter
+ * without synchronisation.  As the ranges are in row order the rows of
+ * Aᵀ come out sorted by column.
+ *
+ */
+inline CSRMatrix_t *Transpose (CSRMatrix_t &A)
+{
+	int rows = A.rows ();
+	int columns = A.columns ();
+	int64_t *rowPtr = A.RowPtr ();
+	int *colIdx = A.ColIdx ();
+	double *values = A.Values ();
+	CSRMatrix_t *At = new CSRMatrix_t (columns, rows, A.nnz ());
+	int64_t *tPtr = At->RowPtr ();
+	int *tIdx = At->ColIdx ();
+	double *tValues = At->Values ();
+	int parts = 1;
+
+#ifdef _OPENMP
+	if (A.nnz () >= __CSR_PARALLEL)
+		parts = omp_get_max_threads ();
+#endif
+
+	// count[p * columns + j]: entries of column j in range p, then its offset
+	std::vector<int64_t> count ((size_t) parts * columns, 0);
+
+#pragma omp parallel for schedule(static, 1) if(parts > 1)
+	for (int p = 0; p < parts; ++p)
+	{
+		int64_t *mine = count.data () + (size_t) p * columns;
+		int first = (int) ((int64_t) rows * p / parts);
+		int last = (int) ((int64_t) rows * (p + 1) / parts);
+
+		for (int64_t k = rowPtr[first]; k < rowPtr[last]; ++k)
+			++mine[colIdx[k]];
+	}
+
+	tPtr[0] = 0;
+	for (int j = 0; j < columns; ++j)
+	{
+		int64_t offset = tPtr[j];
+
+		for (int p = 0; p < parts; ++p)
+		{
+			int64_t n = count[(size_t) p * columns + j];
+
+			count[(size_t) p * columns + j] = offset;
+			offset += n;
+		}
+
+		tPtr[j + 1] = offset;
+	}
+
+#pragma omp parallel for schedule(static, 1) if(parts > 1)
+	for (int p = 0; p < parts; ++p)
+	{
+		int64_t *next = count.data () + (size_t) p * columns;
+		int first = (int) ((int64_t) rows * p / parts);
+		int last = (int) ((int64_t) rows * (p + 1) / parts);
+
+		for (int i = first; i < last; ++i)
+			for (int64_t k = rowPtr[i]; k < rowPtr[i + 1]; ++k)
+			{
+				int64_t slot = next[colIdx[k]]++;
+
+				tIdx[slot] = i;
+				tValues[slot] = values[k];
+			}
+	}
+
+	return At;
+}
+
+/*
+ * C = AB for sparse A and B (Gustavson's row by row algorithm).
+ *
+ * Symbolic phase (the constructor): the structure of C.  Each thread
+ * owns a dense marker over the columns of B, row i of C is the union of
+ * the rows of B selected by row i of A.  The rows are counted, the row
+ * offsets scanned, then the columns are filled and sorted.
+ *
+ * Numeric phase: the values of C, accumulated in a dense array per
+ * thread (a sparse accumulator, SPA) and gathered in C's column order.
+ *
+ * The structure depends only on the structures of A and B, so when only
+ * their values change (a new time step, a new Newton iterate) Numeric
+ * is called again and the symbolic work is not repeated.
+ *
+ * A and B are referenced, not copied, and must outlive the plan.
+ *
+ */
+
+class SpGEMM_t
+{
+	CSRMatrix_t		&sg_A;
+	CSRMatrix_t		&sg_B;
+	CSRMatrix_t		*sg_C;
+
+	// not copyable
+	SpGEMM_t (const SpGEMM_t &);
+	SpGEMM_t &operator= (const SpGEMM_t &);
+
+public:
+
+	SpGEMM_t (CSRMatrix_t &A, CSRMatrix_t &B) :
+		sg_A (A),
+		sg_B (B),
+		sg_C (0)
+	{
+		if (A.columns () != B.rows ())
+			throw ("SpGEMM: dimension mismatch");
+
+		int rows = A.rows ();
+		int columns = B.columns ();
+		int64_t *aPtr = A.RowPtr ();
+		int *aIdx = A.ColIdx ();
+		int64_t *bPtr = B.RowPtr ();
+		int *bIdx = B.ColIdx ();
+		int64_t *cPtr = new int64_t [rows + 1];
+
+		cPtr[0] = 0;
+
+#pragma omp parallel
+		{
+			std::vector<int> mark (columns, -1);
+
+#pragma omp for schedule(dynamic, 64)
+			for (int i = 0; i < rows; ++i)
+			{
+				int64_t count = 0;
+
+				for (int64_t k = aPtr[i]; k < aPtr[i + 1]; ++k)
+				{
+					int row = aIdx[k];
+
+					for (int64_t l = bPtr[row]; l < bPtr[row + 1]; ++l)
+						if (mark[bIdx[l]] != i)
+						{
+							mark[bIdx[l]] = i;
+							++count;
+						}
+				}
+
+				cPtr[i + 1] = count;
+			}
+		}
+
+		for (int i = 0; i < rows; ++i)
+			cPtr[i + 1] += cPtr[i];
+
+		sg_C = new CSRMatrix_t (rows, columns, cPtr[rows]);
+		memcpy (sg_C->RowPtr (), cPtr, (rows + 1) * sizeof (int64_t));
+		delete [] cPtr;
+
+		cPtr = sg_C->RowPtr ();
+		int *cIdx = sg_C->ColIdx ();
+
+#pragma omp parallel
+		{
+			std::vector<int> mark (columns, -1);
+
+#pragma omp for schedule(dynamic, 64)
+			for (int i = 0; i < rows; ++i)
+			{
+				int64_t n = cPtr[i];
+
+				for (int64_t k = aPtr[i]; k < aPtr[i + 1]; ++k)
+				{
+					int row = aIdx[k];
+
+					for (int64_t l = bPtr[row]; l < bPtr[row + 1]; ++l)
+						if (mark[bIdx[l]] != i)
+						{
+							mark[bIdx[l]] = i;
+							cIdx[n++] = bIdx[l];
+						}
+				}
+
+				std::sort (cIdx + cPtr[i], cIdx + n);
+			}
+		}
+	}
+
+	~SpGEMM_t (void)
+	{
+		delete sg_C;
+	}
+
+	// C's values from the current values of A and B
+	void Numeric (void)
+	{
+		if (!sg_C)
+			throw ("SpGEMM: product already released");
+
+		int rows = sg_A.rows ();
+		int64_t *aPtr = sg_A.RowPtr ();
+		int *aIdx = sg_A.ColIdx ();
+		double *aValues = sg_A.Values ();
+		int64_t *bPtr = sg_B.RowPtr ();
+		int *bIdx = sg_B.ColIdx ();
+		double *bValues = sg_B.Values ();
+		int64_t *cPtr = sg_C->RowPtr ();
+		int *cIdx = sg_C->ColIdx ();
+		double *cValues = sg_C->Values ();
+
+#pragma omp parallel
+		{
+			std::vector<double> spa (sg_C->columns (), 0.0);
+
+#pragma omp for schedule(dynamic, 64)
+			for (int i = 0; i < rows; ++i)
+			{
+				for (int64_t k = aPtr[i]; k < aPtr[i + 1]; ++k)
+				{
+					int row = aIdx[k];
+					double a = aValues[k];
+
+					for (int64_t l = bPtr[row]; l < bPtr[row + 1]; ++l)
+						spa[bIdx[l]] += a * bValues[l];
+				}
+
+				// gather and leave the accumulator zeroed for the next row
+				for (int64_t k = cPtr[i]; k < cPtr[i + 1]; ++k)
+				{
+					cValues[k] = spa[cIdx[k]];
+					spa[cIdx[k]] = 0;
+				}
+			}
+		}
+	}
+
+	// the product (valid after Numeric)
+	CSRMatrix_t &C (void)
+	{
+		return *sg_C;
+	}
+
+	// hand the product to the caller, the plan can no longer be used
+	CSRMatrix_t *Release (void)
+	{
+		CSRMatrix_t *C = sg_C;
+
+		sg_C = 0;
+
+		return C;
+	}
+};
+
+/*
+ * Returns a new matrix, AB (the caller deletes it).
+ *
+ */
+inline CSRMatrix_t *Product (CSRMatrix_t &A, CSRMatrix_t &B)
+{
+	SpGEMM_t plan (A, B);
+
+	plan.Numeric ();
+
+	return plan.Release ();
+}
+
+};
+
+#endif // header inclusion
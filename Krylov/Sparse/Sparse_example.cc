@@ -0,0 +1,790 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include <assert.h>
+#include <float.h>
+
+#include <SparseIO.h> // defines typedef Matrix_t<double> Md_t
+#include <SparseFormat.h>
+#include <SpGEMM.h>
+#include <Reorder.h>
+#include <ILU.h>
+#include <Relaxation.h>
+
+using namespace SparseMatrix;
+
+void assemble (void);
+void product (void);
+void io (void);
+void formats (void);
+void spgemm (void);
+void spmm (void);
+void reorder (void);
+void update (void);
+
+Triplets_t Random (int rows, int columns, int perRow)
+{
+	Triplets_t T (rows, columns);
+
+	for (int i = 0; i < rows; ++i)
+		for (int k = 0; k < perRow; ++k)
+			T.Add (i, rand () % columns, rand () % 20 - 10);
+
+	return T;
+}
+
+bool Same (CSRMatrix_t &A, CSRMatrix_t &B)
+{
+	if (A.rows () != B.rows () ||
+		A.columns () != B.columns () ||
+		A.nnz () != B.nnz ())
+		return false;
+
+	return (!memcmp (A.RowPtr (), B.RowPtr (), (A.rows () + 1) * sizeof (int64_t)) &&
+			!memcmp (A.ColIdx (), B.ColIdx (), A.nnz () * sizeof (int)) &&
+			!memcmp (A.Values (), B.Values (), A.nnz () * sizeof (double)));
+}
+
+int main (int argc, char *argv[])
+{
+	long seed = time (0);
+	char opt;
+
+	while (true)
+	{
+		opt = getopt (argc, argv, "s:");
+		if (opt == -1)
+			break;
+
+		switch (opt)
+		{
+		case 's':
+
+			seed = atol (optarg);
+			break;
+
+		default:
+
+			printf ("usage: %s [-s seed]\n", argv[0]);
+			exit (-1);
+		}
+	}
+
+	printf ("Using seed %ld\n", seed);
+
+	srand (seed);
+
+	assemble ();
+	product ();
+	io ();
+	formats ();
+	spgemm ();
+	spmm ();
+	reorder ();
+	update ();
+
+	return 0;
+}
+
+/*
+ * Triplets in random order with duplicates must compress to the same
+ * matrix as summing them into a dense one.
+ *
+ */
+void assemble (void)
+{
+	int rows = 60;
+	int columns = 45;
+	Triplets_t T (rows, columns);
+	Md_t D (rows, columns, 0.0);
+
+	for (int k = 0; k < 1000; ++k)
+	{
+		int i = rand () % rows;
+		int j = rand () % columns;
+		double datum = rand () % 100 - 50;
+
+		T.Add (i, j, datum);
+		D (i, j) += datum;
+	}
+
+	CSRMatrix_t A (T);
+	Md_t C = A.Copy ();
+
+	assert (C == D);
+
+	for (int i = 0; i < rows; ++i)
+		for (int64_t k = A.RowPtr ()[i] + 1; k < A.RowPtr ()[i + 1]; ++k)
+			assert (A.ColIdx ()[k - 1] < A.ColIdx ()[k]);
+
+	/*
+	 * Inexact values with many duplicates, enough triplets for every
+	 * thread.  The duplicates are summed in triplet order, so the result
+	 * is that of the serial sum, bit for bit, whatever the scheduling.
+	 *
+	 */
+	Triplets_t U (rows, columns);
+	Md_t E (rows, columns, 0.0);
+
+	for (int k = 0; k < 400000; ++k)
+	{
+		int i = rand () % rows;
+		int j = rand () % columns;
+		double datum = (double) rand () / RAND_MAX - 0.5;
+
+		U.Add (i, j, datum);
+		E (i, j) += datum;
+	}
+
+	for (int run = 0; run < 4; ++run)
+	{
+		CSRMatrix_t B (U);
+		Md_t F = B.Copy ();
+
+		assert (F == E);
+	}
+
+	printf ("Triplets to CSR:\t%d x %d, %ld triplets, %ld non-zeros\n",
+		rows,
+		columns,
+		(long) T.size (),
+		(long) A.nnz ());
+}
+
+/*
+ * A matrix with very uneven rows (a few dense ones) so a row count split
+ * would be badly balanced.  The products are checked against a plain
+ * loop.
+ *
+ */
+void product (void)
+{
+	int n = 100000;
+	Triplets_t T (n, n);
+
+	for (int i = 0; i < n; ++i)
+	{
+		int len = (i % 1000 == 0 ? 2000 : 1 + rand () % 10);
+
+		for (int k = 0; k < len; ++k)
+			T.Add (i, rand () % n, (double) (rand () % 100) / 10);
+	}
+
+	CSRMatrix_t A (T);
+	Md_t x (n, 1);
+	Md_t y (n, 1);
+
+	x.randomly_fill (1.0);
+	y.randomly_fill (1.0);
+
+	Md_t ref (n, 1);
+	Md_t fused = y;
+	fused.copy ();
+
+	for (int i = 0; i < n; ++i)
+	{
+		double sum = 0;
+
+		for (int64_t k = A.RowPtr ()[i]; k < A.RowPtr ()[i + 1]; ++k)
+			sum += A.Values ()[k] * x (A.ColIdx ()[k], 0);
+
+		ref (i, 0) = sum;
+	}
+
+	int runs = 100;
+	clock_t start = clock ();
+	Md_t u;
+
+	for (int r = 0; r < runs; ++r)
+		u = A * x;
+
+	double elapsed = (double) (clock () - start) / CLOCKS_PER_SEC;
+
+	assert (u.equal_eps (ref, 1e-10));
+
+	// fused = 2Ax - 0.5 fused
+	MatrixVectorProduct (A, x, fused, 2.0, -0.5);
+
+	Md_t check = 2.0 * ref - 0.5 * y;
+	assert (fused.equal_eps (check, 1e-10));
+
+	printf ("SpMV:\t\t\t%d rows, %ld non-zeros, %.2f GFlop/s (cpu)\n",
+		n,
+		(long) A.nnz (),
+		2.0 * A.nnz () * runs / elapsed / 1e9);
+}
+
+/*
+ * Round trips through Matrix Market and the binary format, plus a small
+ * symmetric Matrix Market file.
+ *
+ */
+void io (void)
+{
+	char mtx[] = "/tmp/sparseXXXXXX";
+	char bin[] = "/tmp/sparseXXXXXX";
+	int n = 200000;
+	Triplets_t T (n, n);
+
+	close (mkstemp (mtx));
+	close (mkstemp (bin));
+
+	for (int i = 0; i < n; ++i)
+		for (int k = 0; k < 5; ++k)
+			T.Add (i, rand () % n, (double) rand () / RAND_MAX - 0.5);
+
+	CSRMatrix_t A (T);
+
+	WriteMatrixMarket (A, mtx);
+	WriteBinary (A, bin);
+
+	clock_t start = clock ();
+	CSRMatrix_t *B = ReadMatrixMarket (mtx);
+	clock_t middle = clock ();
+	CSRMatrix_t *C = MapBinary (bin);
+	clock_t end = clock ();
+
+	assert (Same (A, *B));
+	assert (Same (A, *C));
+
+	Md_t x (n, 1);
+	x.randomly_fill (1.0);
+
+	Md_t u = A * x;
+	Md_t v = *C * x;
+	assert (u == v);
+
+	printf ("Sparse IO:\t\t%ld non-zeros, Matrix Market %.3f s, "
+			"binary map %.6f s (cpu)\n",
+		(long) A.nnz (),
+		(double) (middle - start) / CLOCKS_PER_SEC,
+		(double) (end - middle) / CLOCKS_PER_SEC);
+
+	// a mapped matrix takes value updates, the file does not see them
+	int64_t *rowPtr = C->RowPtr ();
+	int column = C->ColIdx ()[rowPtr[0]];
+	double old = C->get (0, column);
+
+	C->SetValue (0, column, old + 5.0);
+	C->AddValue (0, column, 1.0);
+	assert (C->get (0, column) == old + 6.0);
+
+	CSRMatrix_t *again = MapBinary (bin);
+
+	assert (again->get (0, column) == old);
+	assert (Same (A, *again));
+
+	delete B;
+	delete C;
+	delete again;
+
+	// lower triangle of a symmetric matrix, and a skew one
+	FILE *fp = fopen (mtx, "w");
+	fprintf (fp, "%%%%MatrixMarket matrix coordinate real symmetric\n"
+				"%% a comment\n"
+				"3 3 4\n"
+				"1 1 2.0\n"
+				"2 1 -1.0\n"
+				"3 2 -1.0\n"
+				"3 3 2.0\n");
+	fclose (fp);
+
+	double expect[] = {2, -1, 0, -1, 0, -1, 0, -1, 2};
+	Md_t E (3, 3, expect);
+
+	B = ReadMatrixMarket (mtx);
+	Md_t D = B->Copy ();
+	assert (D == E);
+	delete B;
+
+	fp = fopen (mtx, "w");
+	fprintf (fp, "%%%%MatrixMarket matrix coordinate pattern skew-symmetric\n"
+				"2 2 1\n"
+				"2 1\n");
+	fclose (fp);
+
+	B = ReadMatrixMarket (mtx);
+	assert (B->get (1, 0) == 1 && B->get (0, 1) == -1 && B->nnz () == 2);
+	delete B;
+
+	unlink (mtx);
+	unlink (bin);
+}
+
+/*
+ * Compress must pick BSR for a matrix of dense 3 x 3 blocks, SELL-C-σ
+ * for short irregular rows and CSR for long rows.  Each must compute the
+ * same (fused) product as CSR.
+ *
+ */
+void formats (void)
+{
+	int n = 60000;
+	const char *expect[] = {"BSR", "SELL-C-sigma", "CSR"};
+
+	for (int shape = 0; shape < 3; ++shape)
+	{
+		Triplets_t T (n, n);
+
+		for (int i = 0; i < n; ++i)
+		{
+			if (shape == 0)
+			{
+				// node i / 3 couples with 7 nodes, 3 unknowns each
+				if (i % 3)
+					continue;
+
+				for (int k = 0; k < 7; ++k)
+				{
+					int node = (k ? rand () % (n / 3) : i / 3);
+					double datum = rand () % 100 + 1;
+
+					for (int r = 0; r < 3; ++r)
+						for (int c = 0; c < 3; ++c)
+							T.Add (i + r, node * 3 + c, datum + r - c);
+				}
+			}
+			else
+			{
+				int len = (shape == 1 ? 1 + rand () % 10 : 64);
+
+				for (int k = 0; k < len; ++k)
+					T.Add (i, rand () % n, (double) (rand () % 100) / 10);
+			}
+		}
+
+		CSRMatrix_t A (T);
+		SparseOperator_t *M = Compress (T);
+		Md_t x (n, 1);
+		Md_t y (n, 1);
+
+		assert (!strcmp (M->Format (), expect[shape]));
+		assert (M->nnz () == A.nnz ());
+
+		x.randomly_fill (1.0);
+		y.randomly_fill (1.0);
+
+		Md_t u = A * x;
+		Md_t v = *M * x;
+		assert (u.equal_eps (v, 1e-10));
+
+		Md_t w = y;
+		w.copy ();
+		MatrixVectorProduct (A, x, y, 3.0, 0.5);
+		MatrixVectorProduct (*M, x, w, 3.0, 0.5);
+		assert (y.equal_eps (w, 1e-10));
+
+		int runs = 50;
+		clock_t start = clock ();
+
+		for (int r = 0; r < runs; ++r)
+			MatrixVectorProduct (A, x, u);
+
+		clock_t middle = clock ();
+
+		for (int r = 0; r < runs; ++r)
+			MatrixVectorProduct (*M, x, v);
+
+		clock_t end = clock ();
+
+		printf ("Format %s:\t%ld non-zeros, %.2f GFlop/s (CSR %.2f)\n",
+			M->Format (),
+			(long) A.nnz (),
+			2.0 * A.nnz () * runs / ((double) (end - middle) / CLOCKS_PER_SEC) / 1e9,
+			2.0 * A.nnz () * runs / ((double) (middle - start) / CLOCKS_PER_SEC) / 1e9);
+
+		delete M;
+	}
+}
+
+/*
+ * Sparse products and transposes against their dense equivalents, and
+ * the numeric phase rerun after the values of B change.
+ *
+ */
+void spgemm (void)
+{
+	Triplets_t TA = Random (300, 200, 6);
+	Triplets_t TB = Random (200, 250, 4);
+	CSRMatrix_t A (TA);
+	CSRMatrix_t B (TB);
+
+	CSRMatrix_t *At = Transpose (A);
+	Md_t D = A.Copy ();
+	Md_t Dt = At->Copy ();
+	Md_t T = D.transpose ();
+	assert (Dt == T);
+
+	SpGEMM_t plan (A, B);
+	plan.Numeric ();
+
+	Md_t C = plan.C ().Copy ();
+	Md_t E = A.Copy () * B.Copy ();
+	assert (C.equal_eps (E, 1e-10));
+
+	for (int64_t k = 0; k < B.nnz (); ++k)
+		B.Values ()[k] *= -2;
+
+	plan.Numeric ();
+
+	C = plan.C ().Copy ();
+	E = A.Copy () * B.Copy ();
+	assert (C.equal_eps (E, 1e-10));
+
+	// normal equations on something bigger, only the dimensions checked
+	Triplets_t TL = Random (200000, 100000, 8);
+	CSRMatrix_t L (TL);
+
+	clock_t start = clock ();
+	CSRMatrix_t *Lt = Transpose (L);
+	clock_t middle = clock ();
+	CSRMatrix_t *N = Product (*Lt, L);
+	clock_t end = clock ();
+
+	assert (N->rows () == L.columns () && N->columns () == L.columns ());
+
+	printf ("SpGEMM:\t\t\tAᵀA with %ld non-zeros, transpose %.3f s, "
+			"product %.3f s (cpu)\n",
+		(long) N->nnz (),
+		(double) (middle - start) / CLOCKS_PER_SEC,
+		(double) (end - middle) / CLOCKS_PER_SEC);
+
+	delete At;
+	delete Lt;
+	delete N;
+}
+
+/*
+ * Aᵀx against the explicit transpose for every format, and a block of
+ * vectors against one product per column.
+ *
+ */
+void spmm (void)
+{
+	int n = 60000;
+	Triplets_t T (n, n);
+
+	// a band, as a mesh numbered with some locality would be
+	for (int i = 0; i < n; ++i)
+		for (int k = 0; k < 12; ++k)
+			T.Add (i, std::min (n - 1, std::max (0, i + rand () % 401 - 200)), rand () % 20 - 10);
+
+	CSRMatrix_t A (T);
+	CSRMatrix_t *At = Transpose (A);
+	Md_t x (n, 1);
+	Md_t y (n, 1);
+
+	x.randomly_fill (1.0);
+	y.randomly_fill (1.0);
+
+	Md_t u = *At * x;
+	Md_t v (n, 1);
+	TransposeVectorProduct (A, x, v);
+	assert (u.equal_eps (v, 1e-10));
+
+	Md_t w = y;
+	w.copy ();
+	MatrixVectorProduct (*At, x, y, 3.0, 0.5);
+	TransposeVectorProduct (A, x, w, 3.0, 0.5);
+	assert (y.equal_eps (w, 1e-10));
+
+	SELLMatrix_t S (A);
+	BSRMatrix_t<2, 2> B (A);
+
+	TransposeVectorProduct (S, x, v);
+	assert (u.equal_eps (v, 1e-10));
+
+	TransposeVectorProduct (B, x, v);
+	assert (u.equal_eps (v, 1e-10));
+
+	int k = 8;
+	Md_t X (n, k);
+	Md_t Y (n, k);
+	Md_t Z (n, k);
+
+	X.randomly_fill (1.0);
+	Y.randomly_fill (1.0);
+	Z = Y;
+	Z.copy ();
+
+	A.Product (2.0, X, -1.0, Y);
+
+	for (int c = 0; c < k; ++c)
+		A.Multiply (2.0, X.raw () + (int64_t) c * X.stride (), -1.0, Z.raw () + (int64_t) c * Z.stride ());
+
+	assert (Y.equal_eps (Z, 1e-10));
+
+	int runs = 20;
+	clock_t start = clock ();
+
+	for (int r = 0; r < runs; ++r)
+		for (int c = 0; c < k; ++c)
+			A.Multiply (1.0, X.raw () + (int64_t) c * X.stride (), 0.0, Z.raw () + (int64_t) c * Z.stride ());
+
+	clock_t middle = clock ();
+
+	for (int r = 0; r < runs; ++r)
+		MatrixVectorProduct (A, X, Y);
+
+	clock_t end = clock ();
+
+	printf ("SpMM:			%d vectors %.2f GFlop/s (%d SpMV %.2f)\n",
+		k,
+		2.0 * A.nnz () * k * runs / ((double) (end - middle) / CLOCKS_PER_SEC) / 1e9,
+		k,
+		2.0 * A.nnz () * k * runs / ((double) (middle - start) / CLOCKS_PER_SEC) / 1e9);
+
+	delete At;
+}
+
+/*
+ * A 5 point Laplacian on a grid, numbered at random as an unstructured
+ * mesh generator might.  RCM must recover a narrow band, both orderings
+ * must be permutations and PAPᵀ(Px) = P(Ax).
+ *
+ */
+void reorder (void)
+{
+	int side = 300;
+	int n = side * side;
+	std::vector<int> shuffle (n);
+
+	for (int i = 0; i < n; ++i)
+		shuffle[i] = i;
+
+	for (int i = n - 1; i > 0; --i)
+		std::swap (shuffle[i], shuffle[rand () % (i + 1)]);
+
+	Triplets_t T (n, n);
+
+	for (int r = 0; r < side; ++r)
+		for (int c = 0; c < side; ++c)
+		{
+			int i = shuffle[r * side + c];
+
+			T.Add (i, i, 4);
+
+			if (r > 0)
+				T.Add (i, shuffle[(r - 1) * side + c], -1);
+			if (r < side - 1)
+				T.Add (i, shuffle[(r + 1) * side + c], -1);
+			if (c > 0)
+				T.Add (i, shuffle[r * side + c - 1], -1);
+			if (c < side - 1)
+				T.Add (i, shuffle[r * side + c + 1], -1);
+		}
+
+	CSRMatrix_t A (T);
+
+	std::vector<int> rcm = ReverseCuthillMcKee (A);
+	std::vector<int> nd = NestedDissection (A);
+
+	for (std::vector<int> *perm : {&rcm, &nd})
+	{
+		std::vector<int> sorted (*perm);
+
+		std::sort (sorted.begin (), sorted.end ());
+		for (int i = 0; i < n; ++i)
+			assert (sorted[i] == i);
+	}
+
+	CSRMatrix_t *B = Permute (A, rcm);
+	CSRMatrix_t *D = Permute (A, nd);
+
+	// a grid's band is its side, RCM should find about that
+	assert (Bandwidth (*B) <= 2 * side);
+	assert (B->nnz () == A.nnz () && D->nnz () == A.nnz ());
+
+	Md_t x (n, 1);
+	x.randomly_fill (1.0);
+
+	Md_t y = A * x;
+	Md_t px = Permute (x, rcm);
+	Md_t z = *B * px;
+	Md_t back = Unpermute (z, rcm);
+	assert (back.equal_eps (y, 1e-12));
+
+	Md_t qx = Permute (x, nd);
+	z = *D * qx;
+	back = Unpermute (z, nd);
+	assert (back.equal_eps (y, 1e-12));
+
+	int runs = 200;
+	clock_t start = clock ();
+
+	for (int r = 0; r < runs; ++r)
+		MatrixVectorProduct (A, x, y);
+
+	clock_t middle = clock ();
+
+	for (int r = 0; r < runs; ++r)
+		MatrixVectorProduct (*B, px, z);
+
+	clock_t end = clock ();
+
+	printf ("Reordering:\t\tbandwidth %d, RCM %d, SpMV %.2f GFlop/s (random %.2f)\n",
+		Bandwidth (A),
+		Bandwidth (*B),
+		2.0 * A.nnz () * runs / ((double) (end - middle) / CLOCKS_PER_SEC) / 1e9,
+		2.0 * A.nnz () * runs / ((double) (middle - start) / CLOCKS_PER_SEC) / 1e9);
+
+	delete B;
+	delete D;
+
+	// every vertex its own component: one sweep, not a recursion each
+	int m = 100000;
+	Triplets_t I (m, m);
+
+	for (int i = 0; i < m; ++i)
+		I.Add (i, i, 1);
+
+	CSRMatrix_t Id (I);
+	std::vector<int> diagonal = NestedDissection (Id);
+
+	std::sort (diagonal.begin (), diagonal.end ());
+	for (int i = 0; i < m; ++i)
+		assert (diagonal[i] == i);
+}
+
+/*
+ * New values on an old structure: in bulk from triplets, one at a time
+ * and carried into the SELL/BSR copies and an ILU(0).
+ *
+ */
+void update (void)
+{
+	int n = 20000;
+	Triplets_t T (n, n);
+
+	for (int i = 0; i < n; ++i)
+	{
+		T.Add (i, i, 50);
+
+		for (int k = 0; k < 6; ++k)
+			T.Add (i, (i + rand () % 41 - 20 + n) % n, rand () % 10 - 5);
+	}
+
+	CSRMatrix_t A (T);
+	SELLMatrix_t S (A);
+	BSRMatrix_t<2, 2> B (A);
+	ILU_t M (A);
+	SSOR_t R (A, 1.2);
+	Md_t x (n, 1);
+	Md_t y (n, 1);
+
+	x.randomly_fill (1.0);
+	MatrixVectorProduct (A, x, y);	// the partition is cached here
+
+	// same positions, new values (and the duplicates summed again)
+	Triplets_t U (n, n);
+
+	for (size_t t = 0; t < T.tr_row.size (); ++t)
+		U.Add (T.tr_row[t], T.tr_column[t], T.tr_datum[t] * 3 + 1);
+
+	CSRMatrix_t E (U);
+
+	A.SetValues (U);
+	assert (Same (A, E));
+
+	S.Update (A);
+	B.Update (A);
+
+	Md_t u = E * x;
+	Md_t v = A * x;
+	assert (u.equal_eps (v, 1e-10));
+	v = S * x;
+	assert (u.equal_eps (v, 1e-10));
+	v = B * x;
+	assert (u.equal_eps (v, 1e-10));
+
+	ILU_t F (E);
+	Md_t z (n, 1);
+	Md_t w (n, 1);
+
+	M.Refactor (A);
+	M.Apply (x, z);
+	F.Apply (x, w);
+	assert (z.equal_eps (w, 1e-12));
+
+	SSOR_t G (E, 1.2);
+
+	R.Refactor (A);
+	R.Apply (x, z);
+	G.Apply (x, w);
+	assert (z.equal_eps (w, 1e-12));
+
+	A.SetValue (7, 7, -1);
+	A.AddValue (7, 7, 3);
+	assert (A.get (7, 7) == 2);
+
+	bool thrown = false;
+
+	try
+	{
+		int j = 0;
+
+		while (A.Find (3, j) >= 0)
+			++j;
+
+		A.SetValue (3, j, 1.0);
+	}
+	catch (const char *)
+	{
+		thrown = true;
+	}
+
+	assert (thrown);
+
+	A.SetValues (E.Values ());
+	assert (Same (A, E));
+
+	int runs = 20;
+	std::vector<int64_t> slots;
+	clock_t start = clock ();
+
+	for (int r = 0; r < runs; ++r)
+		A.SetValues (U, slots);
+
+	assert (Same (A, E));
+
+	clock_t middle = clock ();
+
+	for (int r = 0; r < runs; ++r)
+	{
+		CSRMatrix_t C (U);
+	}
+
+	clock_t end = clock ();
+
+	printf ("Value update:\t\t%ld triplets, %.4f s (assembly %.4f s) (cpu)\n",
+		(long) U.tr_row.size (),
+		(double) (middle - start) / CLOCKS_PER_SEC / runs,
+		(double) (end - middle) / CLOCKS_PER_SEC / runs);
+}
@@ -0,0 +1,85 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_SPARSE_FORMAT__H__
+#define __DJS_SPARSE_FORMAT__H__
+
+#include <CSRMatrix.h>
+#include <SELLMatrix.h>
+#include <BSRMatrix.h>
+
+/*
+ * Selection thresholds, see Compress.
+ *
+ */
+#define __BSR_MAX_FILL		1.25	// stored / non-zeros
+#define __SELL_MAX_FILL		1.30
+#define __SELL_MAX_ROW		32		// mean non-zeros per row
+
+namespace SparseMatrix
+{
+
+/*
+ * Builds the matrix in the storage format its structure suits best.
+ *
+ * (i) BSR, largest of 4x4, 3x3 and 2x2, if the non-zeros form blocks
+ *     that are nearly full.
+ * (ii) SELL-C-σ if the rows are short (CSR cannot fill SIMD lanes) and
+ *      sorting leaves little padding.
+ * (iii) otherwise CSR, whose row loop vectorises well on long rows.
+ *
+ * The caller deletes the result.
+ *
+ */
+inline SparseOperator_t *Compress (Triplets_t &T)
+{
+	CSRMatrix_t *A = new CSRMatrix_t (T);
+	SparseOperator_t *M = A;
+	int64_t nnz = A->nnz ();
+
+	if (nnz == 0)
+		return A;
+
+	if (CountBlocks (*A, 4, 4) * 16 <= __BSR_MAX_FILL * nnz)
+		M = new BSRMatrix_t<4, 4> (*A);
+	else if (CountBlocks (*A, 3, 3) * 9 <= __BSR_MAX_FILL * nnz)
+		M = new BSRMatrix_t<3, 3> (*A);
+	else if (CountBlocks (*A, 2, 2) * 4 <= __BSR_MAX_FILL * nnz)
+		M = new BSRMatrix_t<2, 2> (*A);
+	else if (nnz < (int64_t) __SELL_MAX_ROW * A->rows () &&
+			SELLMatrix_t::Fill (*A) <= __SELL_MAX_FILL)
+		M = new SELLMatrix_t (*A);
+
+	if (M != A)
+		delete A;
+
+	return M;
+}
+
+};
+
+#endif // header inclusion
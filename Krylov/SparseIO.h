@@ -0,0 +1,488 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_SPARSE_IO__H__
+#define __DJS_SPARSE_IO__H__
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <CSRMatrix.h>
+
+namespace SparseMatrix
+{
+
+/*
+ * A private mapping of a whole file.  It is writable so a mapped matrix
+ * can take value updates, the pages written are copied and the file is
+ * never changed.
+ *
+ */
+struct Mapping_t
+{
+	void		*mp_base;
+	size_t		mp_length;
+
+	Mapping_t (const char *path) :
+		mp_base (MAP_FAILED),
+		mp_length (0)
+	{
+		struct stat st;
+		int fd = open (path, O_RDONLY);
+
+		if (fd < 0)
+			throw ("SparseIO: cannot open file");
+
+		if (fstat (fd, &st) < 0 || st.st_size == 0)
+		{
+			close (fd);
+			throw ("SparseIO: cannot stat file (or empty)");
+		}
+
+		mp_length = st.st_size;
+		mp_base = mmap (0, mp_length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+		close (fd);
+
+		if (mp_base == MAP_FAILED)
+			throw ("SparseIO: mmap failed");
+	}
+
+	~Mapping_t (void)
+	{
+		if (mp_base != MAP_FAILED)
+			munmap (mp_base, mp_length);
+	}
+
+	const char *begin (void)
+	{
+		return (const char *) mp_base;
+	}
+
+	const char *end (void)
+	{
+		return (const char *) mp_base + mp_length;
+	}
+};
+
+/**********************************************************
+ *
+ * Matrix Market (coordinate format)
+ *
+ * %%MatrixMarket matrix coordinate real|integer|pattern general|symmetric|skew-symmetric
+ * % comments
+ * rows columns entries
+ * i j [value]					(1 based)
+ *
+ * The file is mapped and the entries cut into one chunk per thread at
+ * line boundaries.  Each thread parses its chunk into its own triplets,
+ * which are then compressed (in parallel) to CSR.
+ *
+ **********************************************************/
+
+/*
+ * Parse the entries in [p, end) into I, J, V, counting them in lines.
+ * Returns false on a malformed line or an index out of range.
+ *
+ */
+static inline bool ParseEntries (const char *p,
+								const char *end,
+								bool pattern,
+								int symmetry,	// 0 general, 1 symmetric, -1 skew
+								int rows,
+								int columns,
+								std::vector<int> &I,
+								std::vector<int> &J,
+								std::vector<double> &V,
+								long &lines)
+{
+	char buffer[128];
+
+	lines = 0;
+
+	while (p < end)
+	{
+		const char *eol = (const char *) memchr (p, '\n', end - p);
+		const char *next;
+		size_t len;
+
+		if (!eol)
+			eol = end;
+
+		next = eol + 1;
+		len = eol - p;
+
+		while (len && isspace (*p))
+		{
+			++p;
+			--len;
+		}
+
+		if (len == 0 || *p == '%')
+		{
+			p = next;
+			continue;
+		}
+
+		// strtol/strtod need a terminator the mapping does not have
+		if (len >= sizeof (buffer))
+			return false;
+
+		memcpy (buffer, p, len);
+		buffer[len] = 0;
+
+		char *cursor;
+		long i = strtol (buffer, &cursor, 10);
+		long j = strtol (cursor, &cursor, 10);
+		double datum = 1.0;
+
+		if (!pattern)
+		{
+			char *after;
+
+			datum = strtod (cursor, &after);
+			if (after == cursor)
+				return false;
+		}
+
+		if (i < 1 || i > rows || j < 1 || j > columns)
+			return false;
+
+		I.push_back (i - 1);
+		J.push_back (j - 1);
+		V.push_back (datum);
+		++lines;
+
+		if (symmetry && i != j)
+		{
+			I.push_back (j - 1);
+			J.push_back (i - 1);
+			V.push_back (symmetry * datum);
+		}
+
+		p = next;
+	}
+
+	return true;
+}
+
+/*
+ * Returns a new matrix, the caller deletes it.
+ *
+ */
+inline CSRMatrix_t *ReadMatrixMarket (const char *path)
+{
+	Mapping_t file (path);
+	const char *p = file.begin ();
+	const char *end = file.end ();
+	char line[1024];
+	char object[64];
+	char format[64];
+	char field[64];
+	char symmetry[64];
+	int rows;
+	int columns;
+	long entries;
+
+	auto next_line = [&] (void) -> bool {
+
+		const char *eol = (const char *) memchr (p, '\n', end - p);
+		size_t len;
+
+		if (!eol)
+			eol = end;
+
+		len = eol - p;
+		if (len >= sizeof (line))
+			len = sizeof (line) - 1;
+
+		memcpy (line, p, len);
+		line[len] = 0;
+		p = (eol < end ? eol + 1 : end);
+
+		return (len > 0 || p < end);
+	};
+
+	if (!next_line () ||
+		sscanf (line, "%%%%MatrixMarket %63s %63s %63s %63s",
+				object, format, field, symmetry) != 4)
+		throw ("MatrixMarket: missing banner");
+
+	if (strcasecmp (object, "matrix") || strcasecmp (format, "coordinate"))
+		throw ("MatrixMarket: only coordinate matrices are supported");
+
+	if (!strcasecmp (field, "complex"))
+		throw ("MatrixMarket: complex matrices are not supported");
+
+	bool pattern = !strcasecmp (field, "pattern");
+	int sym = 0;
+
+	if (!strcasecmp (symmetry, "symmetric"))
+		sym = 1;
+	else if (!strcasecmp (symmetry, "skew-symmetric"))
+		sym = -1;
+	else if (strcasecmp (symmetry, "general"))
+		throw ("MatrixMarket: unsupported symmetry");
+
+	do {
+
+		if (!next_line ())
+			throw ("MatrixMarket: missing size line");
+
+	} while (line[0] == '%' || line[strspn (line, " \t\r")] == 0);
+
+	if (sscanf (line, "%d %d %ld", &rows, &columns, &entries) != 3 ||
+		rows < 0 || columns < 0 || entries < 0)
+		throw ("MatrixMarket: bad size line");
+
+	int chunks = 1;
+
+#ifdef _OPENMP
+	if (end - p > (1 << 20))
+		chunks = omp_get_max_threads ();
+#endif
+
+	std::vector<const char *> cut (chunks + 1);
+	std::vector< std::vector<int> > I (chunks);
+	std::vector< std::vector<int> > J (chunks);
+	std::vector< std::vector<double> > V (chunks);
+	std::vector<long> lines (chunks);
+	bool failed = false;
+
+	// chunk c starts on the line after its nominal start
+	cut[0] = p;
+	cut[chunks] = end;
+	for (int c = 1; c < chunks; ++c)
+	{
+		const char *q = p + (end - p) * c / chunks;
+		const char *eol;
+
+		if (q < cut[c - 1])
+			q = cut[c - 1];
+
+		eol = (const char *) memchr (q, '\n', end - q);
+		cut[c] = (eol ? eol + 1 : end);
+	}
+
+#pragma omp parallel for schedule(static, 1) reduction(||:failed)
+	for (int c = 0; c < chunks; ++c)
+	{
+		size_t guess = (cut[c + 1] - cut[c]) / 16 * (sym ? 2 : 1);
+
+		I[c].reserve (guess);
+		J[c].reserve (guess);
+		V[c].reserve (guess);
+
+		if (!ParseEntries (cut[c],
+							cut[c + 1],
+							pattern,
+							sym,
+							rows,
+							columns,
+							I[c],
+							J[c],
+							V[c],
+							lines[c]))
+			failed = true;
+	}
+
+	if (failed)
+		throw ("MatrixMarket: malformed entry");
+
+	for (int c = 0; c < chunks; ++c)
+		entries -= lines[c];
+
+	if (entries)
+		throw ("MatrixMarket: wrong number of entries");
+
+	Triplets_t T (rows, columns);
+	int64_t total = 0;
+
+	for (int c = 0; c < chunks; ++c)
+		total += V[c].size ();
+
+	T.tr_row.reserve (total);
+	T.tr_column.reserve (total);
+	T.tr_datum.reserve (total);
+
+	for (int c = 0; c < chunks; ++c)
+	{
+		T.tr_row.insert (T.tr_row.end (), I[c].begin (), I[c].end ());
+		T.tr_column.insert (T.tr_column.end (), J[c].begin (), J[c].end ());
+		T.tr_datum.insert (T.tr_datum.end (), V[c].begin (), V[c].end ());
+
+		std::vector<int> ().swap (I[c]);
+		std::vector<int> ().swap (J[c]);
+		std::vector<double> ().swap (V[c]);
+	}
+
+	return new CSRMatrix_t (T);
+}
+
+inline void WriteMatrixMarket (CSRMatrix_t &A, const char *path)
+{
+	FILE *fp = fopen (path, "w");
+
+	if (!fp)
+		throw ("MatrixMarket: cannot create file");
+
+	fprintf (fp, "%%%%MatrixMarket matrix coordinate real general\n");
+	fprintf (fp, "%d %d %ld\n", A.rows (), A.columns (), (long) A.nnz ());
+
+	for (int i = 0; i < A.rows (); ++i)
+		for (int64_t k = A.RowPtr ()[i]; k < A.RowPtr ()[i + 1]; ++k)
+			fprintf (fp, "%d %d %.17g\n",
+				i + 1,
+				A.ColIdx ()[k] + 1,
+				A.Values ()[k]);
+
+	if (fclose (fp))
+		throw ("MatrixMarket: write failed");
+}
+
+/**********************************************************
+ *
+ * Native binary CSR.  The arrays are stored exactly as CSRMatrix_t
+ * holds them, each 64 byte aligned in the file, so a mapping of the
+ * file is used as the matrix directly: no parsing and no copying, pages
+ * are faulted in as the first products touch them.
+ *
+ * header | rowPtr (rows + 1 int64_t) | colIdx (nnz int) | values (nnz double)
+ *
+ * Native byte order.
+ *
+ **********************************************************/
+
+#define __CSR_MAGIC		"DJSCSR01"
+#define __CSR_ALIGN		64
+
+struct BinaryHeader_t
+{
+	char		bh_magic[8];
+	int32_t		bh_rows;
+	int32_t		bh_columns;
+	int64_t		bh_nnz;
+	int64_t		bh_rowPtr;		// file offsets of the arrays
+	int64_t		bh_colIdx;
+	int64_t		bh_values;
+	int64_t		bh_length;		// of the whole file
+
+	void Layout (int rows, int columns, int64_t nnz)
+	{
+		auto align = [] (int64_t offset) {
+			return (offset + __CSR_ALIGN - 1) / __CSR_ALIGN * __CSR_ALIGN;
+		};
+
+		memcpy (bh_magic, __CSR_MAGIC, sizeof (bh_magic));
+		bh_rows = rows;
+		bh_columns = columns;
+		bh_nnz = nnz;
+		bh_rowPtr = align (sizeof (BinaryHeader_t));
+		bh_colIdx = align (bh_rowPtr + (rows + 1) * sizeof (int64_t));
+		bh_values = align (bh_colIdx + nnz * sizeof (int));
+		bh_length = bh_values + nnz * sizeof (double);
+	}
+};
+
+inline void WriteBinary (CSRMatrix_t &A, const char *path)
+{
+	BinaryHeader_t header;
+	FILE *fp = fopen (path, "w");
+	bool ok;
+
+	if (!fp)
+		throw ("SparseIO: cannot create file");
+
+	memset (&header, 0, sizeof (header));
+	header.Layout (A.rows (), A.columns (), A.nnz ());
+
+	auto put = [fp] (int64_t offset, const void *p, int64_t len) {
+
+		return (fseek (fp, offset, SEEK_SET) == 0 &&
+				fwrite (p, 1, len, fp) == (size_t) len);
+	};
+
+	ok = put (0, &header, sizeof (header)) &&
+			put (header.bh_rowPtr,
+				A.RowPtr (),
+				(A.rows () + 1) * sizeof (int64_t)) &&
+			put (header.bh_colIdx, A.ColIdx (), A.nnz () * sizeof (int)) &&
+			put (header.bh_values, A.Values (), A.nnz () * sizeof (double));
+
+	if (fclose (fp) || !ok)
+		throw ("SparseIO: write failed");
+}
+
+/*
+ * Map a file written by WriteBinary.  The returned matrix refers to the
+ * mapping (kept until the matrix is deleted).  Its values can be updated
+ * (SetValue and friends), the file is unchanged.  The caller deletes it.
+ *
+ */
+inline CSRMatrix_t *MapBinary (const char *path)
+{
+	std::shared_ptr<Mapping_t> file = std::make_shared<Mapping_t> (path);
+	const BinaryHeader_t *stored = (const BinaryHeader_t *) file->begin ();
+	BinaryHeader_t expect;
+
+	if (file->mp_length < sizeof (BinaryHeader_t) ||
+		memcmp (stored->bh_magic, __CSR_MAGIC, sizeof (expect.bh_magic)))
+		throw ("SparseIO: not a binary CSR file");
+
+	expect.Layout (stored->bh_rows, stored->bh_columns, stored->bh_nnz);
+
+	if (stored->bh_rows < 0 || stored->bh_columns < 0 || stored->bh_nnz < 0 ||
+		stored->bh_rowPtr != expect.bh_rowPtr ||
+		stored->bh_colIdx != expect.bh_colIdx ||
+		stored->bh_values != expect.bh_values ||
+		(int64_t) file->mp_length < expect.bh_length)
+		throw ("SparseIO: corrupt binary CSR file");
+
+	char *base = (char *) file->mp_base;
+	int64_t *rowPtr = (int64_t *) (base + stored->bh_rowPtr);
+
+	if (rowPtr[0] != 0 || rowPtr[stored->bh_rows] != stored->bh_nnz)
+		throw ("SparseIO: corrupt binary CSR file");
+
+	return new CSRMatrix_t (stored->bh_rows,
+							stored->bh_columns,
+							rowPtr,
+							(int *) (base + stored->bh_colIdx),
+							(double *) (base + stored->bh_values),
+							file);
+}
+
+};
+
+#endif // header inclusion
@@ -0,0 +1,178 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_SPARSE_OPERATOR__H__
+#define __DJS_SPARSE_OPERATOR__H__
+
+#include <assert.h>
+
+#include <matrix.h>
+#include <Kernels.h>
+typedef Matrix_t<double> Md_t;
+
+namespace SparseMatrix
+{
+
+/*
+ * What a Krylov method needs of its matrix: the dimensions, y = αAx + βy
+ * and its transposed and multi-vector forms.  The storage formats (CSR,
+ * SELL-C-σ, BSR) derive from it so the solvers run on any of them
+ * unchanged.  One virtual call per product is noise next to the product
+ * itself.
+ *
+ */
+
+class SparseOperator_t
+{
+public:
+
+	virtual ~SparseOperator_t (void)
+	{
+	}
+
+	virtual int rows (void) = 0;
+	virtual int columns (void) = 0;
+	virtual int64_t nnz (void) = 0;
+	virtual const char *Format (void) = 0;
+
+	/*
+	 * y = αAx + βy.  When β is zero y is not read (it may hold NaNs).
+	 *
+	 */
+	virtual void Multiply (double alpha,
+							const double *x,
+							double beta,
+							double *y) = 0;
+
+	/*
+	 * y = αAᵀx + βy.  Formats that cannot do better scatter serially.
+	 *
+	 */
+	virtual void MultiplyTranspose (double alpha,
+									const double *x,
+									double beta,
+									double *y) = 0;
+
+	/*
+	 * Y = αAX + βY for k vectors, X and Y are column major with leading
+	 * dimensions ldx and ldy (those of Md_t).  The default is k products,
+	 * formats override it to read the matrix once for all k.
+	 *
+	 */
+	virtual void MultiplyBlock (double alpha,
+								const double *X,
+								int ldx,
+								double beta,
+								double *Y,
+								int ldy,
+								int k)
+	{
+		for (int c = 0; c < k; ++c)
+			Multiply (alpha, X + (int64_t) c * ldx, beta, Y + (int64_t) c * ldy);
+	}
+
+	/*
+	 * y = Ax returning x·y (A square), the product and the dot product
+	 * CG needs after it in one pass.
+	 *
+	 */
+	virtual double MultiplyDot (const double *x, double *y)
+	{
+		Multiply (1.0, x, 0.0, y);
+
+		return Kernels::Dot (x, y, rows ());
+	}
+
+	// u = αAv + βu for any number of columns
+	void Product (double alpha, Md_t &v, double beta, Md_t &u)
+	{
+		assert (v.rows () == columns () && u.rows () == rows ());
+		assert (v.columns () == u.columns ());
+
+		if (v.columns () == 1)
+			Multiply (alpha, v.raw (), beta, u.raw ());
+		else
+			MultiplyBlock (alpha,
+							v.raw (),
+							v.stride (),
+							beta,
+							u.raw (),
+							u.stride (),
+							v.columns ());
+	}
+
+	friend Md_t operator* (SparseOperator_t &A, Md_t &v)
+	{
+		Md_t u (A.rows (), v.columns ());
+
+		A.Product (1.0, v, 0.0, u);
+
+		return u;
+	}
+
+	/*
+	 * Computes u = Av (v may have several columns)
+	 *
+	 */
+	friend void MatrixVectorProduct (SparseOperator_t &A, Md_t &v, Md_t &u)
+	{
+		A.Product (1.0, v, 0.0, u);
+	}
+
+	/*
+	 * Computes u = αAv + βu, without a temporary for Av
+	 *
+	 */
+	friend void MatrixVectorProduct (SparseOperator_t &A,
+									Md_t &v,
+									Md_t &u,
+									double alpha,
+									double beta)
+	{
+		A.Product (alpha, v, beta, u);
+	}
+
+	/*
+	 * Computes u = αAᵀv + βu
+	 *
+	 */
+	friend void TransposeVectorProduct (SparseOperator_t &A,
+										Md_t &v,
+										Md_t &u,
+										double alpha = 1.0,
+										double beta = 0.0)
+	{
+		assert (v.columns () == 1 && u.columns () == 1);
+		assert (v.rows () == A.rows () && u.rows () == A.columns ());
+
+		A.MultiplyTranspose (alpha, v.raw (), beta, u.raw ());
+	}
+};
+
+};
+
+#endif // header inclusion
@@ -0,0 +1,316 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include <batch.h>
+
+/*
+ * Per thread state.  The n x n matrix is write-in-place so the Francis
+ * iteration works directly on it rather than on a CoW copy.
+ *
+ */
+
+struct EigenBatch_t::workspace_t {
+
+	int				ws_n;
+	Md_t			ws_A;
+	EigenFrancis_t	ws_F;
+
+	// interleaved storage: element (r, c) of lane l is at (c * n + r) * L + l
+	double			*ws_lanes;
+	double			*ws_v;
+	double			*ws_w;
+
+	workspace_t (int n) :
+		ws_n (n),
+		ws_A (n, n),
+		ws_lanes (0),
+		ws_v (0),
+		ws_w (0)
+	{
+		ws_A.set_WiP ();
+
+		if (n > __BATCH_INTERLEAVE)
+			return;
+
+		ws_lanes = new double [n * n * __BATCH_LANES];
+		ws_v = new double [n * __BATCH_LANES];
+		ws_w = new double [n * __BATCH_LANES];
+	}
+
+	~workspace_t (void)
+	{
+		if (ws_lanes)
+			delete [] ws_lanes;
+
+		if (ws_v)
+			delete [] ws_v;
+
+		if (ws_w)
+			delete [] ws_w;
+	}
+
+	/*
+	 * Harvest the result of running Francis on ws_A.
+	 *
+	 */
+	int Finish (conj_t *eigen, int *found)
+	{
+		int count = 0;
+
+		ws_A.viewOriginal (); // deflation shrinks the shared view
+
+		for (int i = 0; i < ws_F.ef_N; ++i)
+		{
+			eigen[i] = ws_F.ef_EigenValues[i];
+			count += (eigen[i].imag ? 2 : 1);
+		}
+
+		*found = ws_F.ef_N;
+
+		return (count == ws_n ? 1 : 0);
+	}
+};
+
+/*
+ * Householder reduction to Hessenberg form of __BATCH_LANES matrices at
+ * once.  This is HessenbergSimilarity with every scalar replaced by a
+ * vector of lanes, the lane loop is innermost and contiguous so the
+ * compiler maps it onto SIMD registers.
+ *
+ */
+
+static void HessenbergLanes (double * __restrict A,
+							int n,
+							double * __restrict v,
+							double * __restrict w)
+{
+	const int L = __BATCH_LANES;
+	double beta[L];
+	double dot[L];
+	double s[L];
+
+#define LANE(r, c) (A + ((c) * n + (r)) * L)
+
+	for (int col = 0; col < n - 2; ++col)
+	{
+		int k = col + 1;
+
+		for (int l = 0; l < L; ++l)
+			dot[l] = 0;
+
+		for (int i = k; i < n; ++i)
+		{
+			double *a = LANE (i, col);
+
+			for (int l = 0; l < L; ++l)
+			{
+				v[i * L + l] = a[l];
+				dot[l] += a[l] * a[l];
+			}
+		}
+
+		// v = x + sign (x (1)) |x| e1
+		for (int l = 0; l < L; ++l)
+		{
+			double x0 = v[k * L + l];
+			double alpha = sqrt (dot[l]);
+			double vk = x0 + (x0 >= 0 ? alpha : -alpha);
+			double vTv = dot[l] - x0 * x0 + vk * vk;
+
+			v[k * L + l] = vk;
+			beta[l] = (vTv > 0 ? 2 / vTv : 0);
+		}
+
+		// A = A - v (beta vT A)
+		for (int j = col; j < n; ++j)
+		{
+			for (int l = 0; l < L; ++l)
+				s[l] = 0;
+
+			for (int i = k; i < n; ++i)
+			{
+				double *a = LANE (i, j);
+
+				for (int l = 0; l < L; ++l)
+					s[l] += v[i * L + l] * a[l];
+			}
+
+			for (int l = 0; l < L; ++l)
+				s[l] *= beta[l];
+
+			for (int i = k; i < n; ++i)
+			{
+				double *a = LANE (i, j);
+
+				for (int l = 0; l < L; ++l)
+					a[l] -= v[i * L + l] * s[l];
+			}
+		}
+
+		// A = A - (beta A v) vT
+		for (int r = 0; r < n; ++r)
+		{
+			for (int l = 0; l < L; ++l)
+				w[r * L + l] = 0;
+
+			for (int c = k; c < n; ++c)
+			{
+				double *a = LANE (r, c);
+
+				for (int l = 0; l < L; ++l)
+					w[r * L + l] += a[l] * v[c * L + l];
+			}
+
+			for (int l = 0; l < L; ++l)
+				w[r * L + l] *= beta[l];
+		}
+
+		for (int c = k; c < n; ++c)
+			for (int r = 0; r < n; ++r)
+			{
+				double *a = LANE (r, c);
+
+				for (int l = 0; l < L; ++l)
+					a[l] -= w[r * L + l] * v[c * L + l];
+			}
+	}
+
+#undef LANE
+}
+
+int EigenBatch_t::Solve (workspace_t &ws,
+						double *A,
+						int lda,
+						conj_t *eigen,
+						int *found)
+{
+	int n = eb_n;
+	double *to = ws.ws_A.raw ();
+
+	for (int c = 0; c < n; ++c)
+		memcpy (to + c * n, A + (ssize_t) c * lda, n * sizeof (double));
+
+	ws.ws_F.CalcEigenValuesGeneral (ws.ws_A);
+
+	return ws.Finish (eigen, found);
+}
+
+/*
+ * A[l] is lane l's matrix, or NULL if the batch ran out.
+ *
+ */
+
+int EigenBatch_t::SolveInterleaved (workspace_t &ws,
+									double *A[],
+									int lda,
+									conj_t *eigen,
+									int *found)
+{
+	const int L = __BATCH_LANES;
+	int n = eb_n;
+	double *lanes = ws.ws_lanes;
+	int converged = 0;
+
+	for (int l = 0; l < L; ++l)
+		for (int c = 0; c < n; ++c)
+			for (int r = 0; r < n; ++r)
+				lanes[(c * n + r) * L + l] =
+					(A[l] ? A[l][(ssize_t) c * lda + r] : 0.0);
+
+	HessenbergLanes (lanes, n, ws.ws_v, ws.ws_w);
+
+	for (int l = 0; l < L && A[l]; ++l)
+	{
+		double *to = ws.ws_A.raw ();
+
+		for (int c = 0; c < n; ++c)
+			for (int r = 0; r < n; ++r)
+				to[c * n + r] = lanes[(c * n + r) * L + l];
+
+		ws.ws_F.CalcEigenValuesHessenberg (ws.ws_A);
+		converged += ws.Finish (eigen + l * n, found + l);
+	}
+
+	return converged;
+}
+
+int EigenBatch_t::CalcEigenValues (double *A,
+									int count,
+									ssize_t stride,
+									int lda,
+									conj_t *eigen,
+									int *found)
+{
+	bool interleave = (eb_n > 2 && eb_n <= __BATCH_INTERLEAVE);
+	int group = (interleave ? __BATCH_LANES : 1);
+	int groups = (count + group - 1) / group;
+	int converged = 0;
+
+	if (lda < eb_n)
+		throw ("batch: illegal leading dimension");
+
+#pragma omp parallel reduction(+:converged)
+	{
+		workspace_t ws (eb_n);
+
+#pragma omp for schedule(dynamic)
+		for (int g = 0; g < groups; ++g)
+		{
+			int first = g * group;
+
+			if (!interleave)
+			{
+				converged += Solve (ws,
+									A + first * stride,
+									lda,
+									eigen + (ssize_t) first * eb_n,
+									found + first);
+
+				continue;
+			}
+
+			double *lanes[__BATCH_LANES];
+
+			for (int l = 0; l < __BATCH_LANES; ++l)
+				lanes[l] = (first + l < count ? A + (first + l) * stride : 0);
+
+			converged += SolveInterleaved (ws,
+											lanes,
+											lda,
+											eigen + (ssize_t) first * eb_n,
+											found + first);
+		}
+	}
+
+	eb_converged = converged;
+
+	return converged;
+}
+
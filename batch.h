@@ -0,0 +1,115 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_BATCH__H__
+#define __DJS_BATCH__H__
+
+#include <francis.h>
+
+/*
+ * Matrices of this dimension, or smaller, are reduced to Hessenberg form
+ * __BATCH_LANES at a time, interleaved so that the lanes map onto SIMD
+ * registers.
+ *
+ */
+#define __BATCH_INTERLEAVE	16
+#define __BATCH_LANES		4
+
+/*
+ * Computes the eigenvalues of many independent, same sized, matrices.
+ *
+ * The matrices are distributed dynamically over the available threads
+ * (OpenMP) so that a thread finishing early picks up the remaining work.
+ * Each thread owns a workspace (an n x n matrix and an EigenFrancis_t)
+ * that is reused for every matrix it processes.
+ *
+ * Matrices too large to interleave are balanced first, as in
+ * EigenFrancis_t::CalcEigenValuesGeneral.
+ *
+ */
+
+class EigenBatch_t {
+
+	int				eb_n;			// dimension of each matrix
+	int				eb_converged;	// matrices with a full spectrum
+
+	struct workspace_t;
+
+	int Solve (workspace_t &, double *, int, conj_t *, int *);
+	int SolveInterleaved (workspace_t &, double *[], int, conj_t *, int *);
+
+public:
+
+	EigenBatch_t (int n) :
+		eb_n (n),
+		eb_converged (0)
+	{
+		if (n < 1)
+			throw ("batch: illegal dimension");
+	}
+
+	~EigenBatch_t (void)
+	{
+	}
+
+	int Converged (void) const
+	{
+		return eb_converged;
+	}
+
+	/*
+	 * A holds count matrices, each n x n in column order (the layout of
+	 * Md_t) with leading dimension lda.  Matrix i starts at A + i * stride.
+	 * A is not modified.
+	 *
+	 * The eigenvalues of matrix i are placed in eigen[i * n ...], found[i]
+	 * holds their number (complex conjugate pairs occupy one entry, as in
+	 * EigenFrancis_t).
+	 *
+	 * Returns the number of matrices whose iteration converged.
+	 *
+	 */
+	int CalcEigenValues (double *A,
+						int count,
+						ssize_t stride,
+						int lda,
+						conj_t *eigen,
+						int *found);
+
+	int CalcEigenValues (double *A, int count, conj_t *eigen, int *found)
+	{
+		return CalcEigenValues (A,
+								count,
+								(ssize_t) eb_n * eb_n,
+								eb_n,
+								eigen,
+								found);
+	}
+};
+
+#endif // header inclusion
+
@@ -36,12 +36,15 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <float.h>
 
 #include <utility>
+#include <vector>
 
 #include <francis.h>
 
 #define __DIM 1000
 
 void run (void);
+void balance (void);
+void packed (void);
 
 int main (int argc, char *argv[])
 {
@@ -54,6 +57,8 @@ int main (int argc, char *argv[])
 
 	srand (seed);
 
+	balance ();
+	packed ();
 	run ();
 }
 
@@ -111,3 +116,222 @@ void run (void)
 	printf ("Finished processing %d eigenvalues, %d are real\n", N, real);
 }
 
+
+/*
+ * Every eigenvalue of a (conjugate pairs once, as EigenFrancis_t holds
+ * them) is within tolerance of a different one of b.
+ *
+ */
+static bool SameSpectrum (EigenFrancis_t &a, EigenFrancis_t &b, double tolerance)
+{
+	std::vector<bool> used (b.ef_N, false);
+
+	if (a.ef_N != b.ef_N)
+		return false;
+
+	for (int i = 0; i < a.ef_N; ++i)
+	{
+		int best = -1;
+		double distance = DBL_MAX;
+
+		for (int j = 0; j < b.ef_N; ++j)
+		{
+			double dr = a.ef_EigenValues[i].real - b.ef_EigenValues[j].real;
+			double di = fabs (a.ef_EigenValues[i].imag) - fabs (b.ef_EigenValues[j].imag);
+			double d = sqrt (dr * dr + di * di);
+
+			if (!used[j] && d < distance)
+			{
+				best = j;
+				distance = d;
+			}
+		}
+
+		if (best < 0 || distance > tolerance)
+			return false;
+
+		used[best] = true;
+	}
+
+	return true;
+}
+
+/*
+ * A badly scaled matrix, DAD^-1, with and without balancing.  Balanced,
+ * its spectrum must be that of A (the similarity changes nothing).
+ *
+ */
+void balance (void)
+{
+	int n = 100;
+	Md_t A (n, n);
+	Md_t S (n, n);
+	double *D = new double [n];
+
+	for (int i = 0; i < n; ++i)
+		D[i] = ldexp (1.0, rand () % 40 - 20);
+
+	for (int i = 0; i < n; ++i)
+		for (int j = 0; j < n; ++j )
+		{
+			A(i, j) = rand () % n;
+			S(i, j) = D[i] * A(i, j) / D[j];
+		}
+
+	delete [] D;
+
+	EigenFrancis_t reference;
+	Md_t R = A;
+	R.copy ();
+
+	reference.SetBalance (false);
+	reference.CalcEigenValuesGeneral (R);
+
+	double tolerance = 1e-8 * A.norm_inf ();
+
+	for (int balance = 0; balance < 2; ++balance)
+	{
+		Md_t _A = S;
+		_A.copy ();
+
+		EigenFrancis_t FR;
+		FR.SetBalance (balance);
+
+		int N = FR.CalcEigenValuesGeneral (_A);
+		int count = 0;
+
+		for (int i = 0; i < N; ++i)
+			count += (FR.ef_EigenValues[i].imag ? 2 : 1);
+
+		printf ("Balancing %s:\t%d iterations, %d of %d eigenvalues "
+				"(block [%d, %d])\n",
+			(balance ? "on" : "off"),
+			FR.N_Iterations (),
+			count,
+			n,
+			FR.ef_ilo,
+			FR.ef_ihi);
+
+		if (balance)
+		{
+			assert (count == n);
+			assert (SameSpectrum (FR, reference, tolerance));
+		}
+	}
+
+	/*
+	 * A row and a column with nothing off the diagonal: their diagonal
+	 * entries are eigenvalues, which the permutation isolates, and the
+	 * iteration only runs on [ilo, ihi].
+	 *
+	 */
+	Md_t B = A;
+	B.copy ();
+
+	for (int j = 0; j < n; ++j)
+		if (j != 3)
+			B(3, j) = 0;
+
+	for (int i = 0; i < n; ++i)
+		if (i != 7)
+			B(i, 7) = 0;
+
+	B(3, 3) = -17;
+	B(7, 7) = -29;
+
+	Md_t _B = B;
+	_B.copy ();
+
+	EigenFrancis_t isolated;
+	EigenFrancis_t plain;
+
+	isolated.CalcEigenValuesGeneral (B);
+
+	plain.SetBalance (false);
+	plain.CalcEigenValuesGeneral (_B);
+
+	printf ("Isolated:\t%d eigenvalues, block [%d, %d]\n",
+		isolated.ef_N,
+		isolated.ef_ilo,
+		isolated.ef_ihi);
+
+	assert (isolated.ef_ilo > 0 && isolated.ef_ihi < n - 1);
+	assert (SameSpectrum (isolated, plain, tolerance));
+
+	bool found[2] = {false, false};
+
+	for (int i = 0; i < isolated.ef_N; ++i)
+	{
+		found[0] |= (isolated.ef_EigenValues[i].real == -17 && isolated.ef_EigenValues[i].imag == 0);
+		found[1] |= (isolated.ef_EigenValues[i].real == -29 && isolated.ef_EigenValues[i].imag == 0);
+	}
+
+	assert (found[0] && found[1]);
+}
+
+/*
+ * The same Hessenberg matrix in dense and packed storage must produce
+ * the same spectrum.
+ *
+ */
+void packed (void)
+{
+	int n = 200;
+	Md_t A (n, n);
+
+	for (int i = 0; i < n; ++i)
+		for (int j = 0; j < n; ++j )
+			A(i, j) = rand () % n;
+
+	A.HessenbergSimilarity ();
+
+	Hd_t H (A);
+	Md_t x (n, 1);
+
+	x.randomly_fill (1.0);
+
+	Md_t d = A * x - H * x;
+	assert (d.vec_magnitude () < 1e-10 * A.norm_inf ());
+	assert (fabs (H.norm_inf () - A.norm_inf ()) < 1e-10 * A.norm_inf ());
+
+	EigenFrancis_t dense;
+	EigenFrancis_t band;
+	double tolerance = 1e-8 * A.norm_inf ();
+	clock_t start = clock ();
+
+	dense.CalcEigenValuesHessenberg (A);
+
+	clock_t middle = clock ();
+
+	band.CalcEigenValuesHessenberg (H);
+
+	clock_t end = clock ();
+
+	printf ("Packed Hessenberg:\t%d/%d eigenvalues in %d/%d iterations, "
+			"%.3f/%.3f seconds (dense/packed)\n",
+		dense.ef_N,
+		band.ef_N,
+		dense.N_Iterations (),
+		band.N_Iterations (),
+		(double) (middle - start) / CLOCKS_PER_SEC,
+		(double) (end - middle) / CLOCKS_PER_SEC);
+
+	assert (dense.ef_N == band.ef_N);
+
+	for (int i = 0; i < band.ef_N; ++i)
+	{
+		conj_t &e = band.ef_EigenValues[i];
+		double best = DBL_MAX;
+
+		for (int j = 0; j < dense.ef_N; ++j)
+		{
+			conj_t &f = dense.ef_EigenValues[j];
+			double dist = hypot (e.real - f.real, e.imag - f.imag);
+
+			if (dist < best)
+				best = dist;
+		}
+
+		assert (best < tolerance);
+	}
+}
@@ -0,0 +1,143 @@
+/*
+
+Copyright (c) 2020, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, is permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#include <time.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include <batch.h>
+
+#define __COUNT 2000
+
+void run (int);
+double elapsed (struct timespec &, struct timespec &);
+
+int main (int argc, char *argv[])
+{
+	unsigned seed = time (0);
+
+	if (argc == 2)
+		seed = atoi (argv[1]);
+
+	printf ("Using seed %d\n", seed);
+
+	srand (seed);
+
+	run (8);	// interleaved
+	run (16);	// interleaved
+	run (48);	// one at a time
+}
+
+/*
+ * Compute the spectra of __COUNT random n x n matrices with EigenBatch_t
+ * and verify them against EigenFrancis_t run on each matrix separately.
+ *
+ */
+void run (int n)
+{
+	double *A = new double [__COUNT * n * n];
+	conj_t *eigen = new conj_t [__COUNT * n];
+	int *found = new int [__COUNT];
+	struct timespec start, batched, single;
+	int mismatch = 0;
+
+	for (int i = 0; i < __COUNT * n * n; ++i)
+		A[i] = rand () % 100;
+
+	clock_gettime (CLOCK_MONOTONIC, &start);
+
+	EigenBatch_t B (n);
+	int converged = B.CalcEigenValues (A, __COUNT, eigen, found);
+
+	clock_gettime (CLOCK_MONOTONIC, &batched);
+
+	EigenFrancis_t FR;
+
+	for (int m = 0; m < __COUNT; ++m)
+	{
+		Md_t M (n, n);
+
+		for (int j = 0; j < n; ++j)
+			for (int i = 0; i < n; ++i)
+				M(i, j) = A[m * n * n + j * n + i];
+
+		int N = FR.CalcEigenValuesGeneral (M);
+
+		if (N != found[m])
+		{
+			++mismatch;
+			continue;
+		}
+
+		/*
+		 * The order in which eigenvalues deflate can differ, so match
+		 * each of ours with one from the reference.
+		 *
+		 */
+		conj_t *mine = eigen + m * n;
+
+		for (int i = 0; i < N; ++i)
+		{
+			double scale = 1 + mine[i].modulus ();
+			bool match = false;
+
+			for (int j = 0; j < N && !match; ++j)
+				if (fabs (mine[i].real - FR.ef_EigenValues[j].real) <= 1e-8 * scale &&
+					fabs (mine[i].imag - FR.ef_EigenValues[j].imag) <= 1e-8 * scale)
+					match = true;
+
+			if (!match)
+			{
+				++mismatch;
+				break;
+			}
+		}
+	}
+
+	clock_gettime (CLOCK_MONOTONIC, &single);
+
+	printf ("%d x %d:\t%d/%d converged\tbatch %.3fs\tsingle %.3fs\t%d mismatches\n",
+		n,
+		n,
+		converged,
+		__COUNT,
+		elapsed (start, batched),
+		elapsed (batched, single),
+		mismatch);
+
+	assert (mismatch == 0);
+
+	delete [] A;
+	delete [] eigen;
+	delete [] found;
+}
+
+double elapsed (struct timespec &from, struct timespec &to)
+{
+	return (to.tv_sec - from.tv_sec) + (to.tv_nsec - from.tv_nsec) * 1e-9;
+}
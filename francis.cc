@@ -33,7 +33,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <francis.h>
 
 /*
- * Accepts an arbitrary matrix, it will be put into Hessenberg form.
+ * Accepts an arbitrary matrix, it will be balanced and put into
+ * Hessenberg form.
  *
  * This will destroy the argument, A.
  *
@@ -41,9 +42,42 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 int EigenFrancis_t::CalcEigenValuesGeneral (Md_t &A)
 {
-	A.HessenbergSimilarity ();
+	int rows = A.rows ();
+
+	ef_ilo = 0;
+	ef_ihi = rows - 1;
 
-	return CalcEigenValuesHessenberg (A);
+	if (!ef_balance)
+	{
+		A.HessenbergSimilarity ();
+
+		return CalcEigenValuesHessenberg (A);
+	}
+
+	A.Balance (ef_ilo, ef_ihi, ef_scale);
+
+	ef_totalIterations = 0;
+	ef_N = 0;
+
+	Reserve (rows);
+
+	// isolated eigenvalues
+	for (int i = 0; i < rows; ++i)
+	{
+		if (i >= ef_ilo && i <= ef_ihi)
+			continue;
+
+		ef_EigenValues[ef_N].real = A(i, i);
+		ef_EigenValues[ef_N].imag = 0;
+		++ef_N;
+	}
+
+	int m = ef_ihi - ef_ilo + 1;
+	Md_t B = A.view (ef_ilo, ef_ilo, m, m);
+
+	B.HessenbergSimilarity ();
+
+	return CalcEigenValues (B);
 }
 
 /*
@@ -58,13 +92,56 @@ int EigenFrancis_t::CalcEigenValuesGeneral (Md_t &A)
 int EigenFrancis_t::CalcEigenValuesHessenberg (Md_t &A)
 {
 	ef_totalIterations = 0;
+	ef_N = 0;
+
+	Reserve (A.rows ());
+
+	return CalcEigenValues (A);
+}
+
+/*
+ * As above, for a matrix held in packed Hessenberg storage.  The
+ * iteration only touches the stored band and upper triangle.
+ *
+ * This will destroy the argument, H.
+ *
+ */
+
+int EigenFrancis_t::CalcEigenValuesHessenberg (Hd_t &H)
+{
+	ef_totalIterations = 0;
+	ef_N = 0;
+
+	Reserve (H.rows ());
+
+	return CalcEigenValues (H, 0, H.rows () - 1);
+}
+
+/*
+ * Ensure the eigenvalue array and the bulge chasing scratch space can
+ * accommodate an n x n matrix.  Only grows, so repeated calls with
+ * matrices of the same size do not allocate.
+ *
+ */
+
+void EigenFrancis_t::Reserve (int n)
+{
+	if (n <= ef_capacity)
+		return;
+
 	if (ef_EigenValues)
 		delete [] ef_EigenValues;
 
-	ef_EigenValues = new conj_t [A.rows ()];
-	ef_N = 0;
+	if (ef_w)
+		delete [] ef_w;
 
-	return CalcEigenValues (A);
+	if (ef_Aprodw)
+		delete [] ef_Aprodw;
+
+	ef_EigenValues = new conj_t [n];
+	ef_w = new double [n];
+	ef_Aprodw = new double [n];
+	ef_capacity = n;
 }
 
 int EigenFrancis_t::CalcEigenValues (Md_t &A)
@@ -98,7 +175,7 @@ int EigenFrancis_t::CalcEigenValues (Md_t &A)
 	return ef_N;
 }
 
-void ComplexEigen (Md_t &A, int row, conj_t &conj)
+static void ComplexEigen (double a, double b, double c, double d, conj_t &conj)
 {
 	/*
 	 * use quadratic equation to solve sub-block 
@@ -106,12 +183,46 @@ void ComplexEigen (Md_t &A, int row, conj_t &conj)
 	 *
 	 */
 
-	double b = -(A(row + 1, row + 1) + A(row, row));
-	double c = A(row + 1, row + 1) * A(row, row) -
-					A(row, row + 1) * A(row + 1, row);
+	double trace = -(d + a);
+	double det = d * a - b * c;
 
-	conj.real = -b / 2; // real
-	conj.imag = sqrt (fabs (b * b - 4 * c)) / 2; // imag (+/-)
+	conj.real = -trace / 2; // real
+	conj.imag = sqrt (fabs (trace * trace - 4 * det)) / 2; // imag (+/-)
+}
+
+/*
+ * Eigenvalues of the 2 x 2 block | a b |
+ *                                | c d |
+ *
+ */
+static int SchurBlock (double a, double b, double c, double d, conj_t EigenValues[])
+{
+	double tmp = a - d;
+	double p = 0.5 * tmp;
+	double bcmax = fmax (fabs(b), fabs(c));
+	double bcmis = fmin (fabs(b), fabs(c)) * SIGN(b) * SIGN(c);
+	double scale = fmax (fabs(p), bcmax);
+	double z = (p / scale) * p + (bcmax / scale) * bcmis;
+
+	if (z >= 4.0 * MACH_EPS) {
+
+		/* real eigenvalues, compute a and d */
+		z = p + SIGN(p) * fabs(sqrt(scale) * sqrt(z));
+		a = d + z;
+		d -= (bcmax / z) * bcmis;
+
+		EigenValues[0].real = d;
+		EigenValues[1].real = a;
+		EigenValues[0].imag = EigenValues[1].imag = 0;
+
+		return 2;
+
+	} else {
+
+		ComplexEigen (a, b, c, d, EigenValues[0]);
+
+		return 1;
+	}
 }
 
 int EigenFrancis_t::DetectConvergence (Md_t &H)
@@ -137,16 +248,16 @@ int EigenFrancis_t::DetectConvergence (Md_t &H)
 
 void EigenFrancis_t::FrancisStep (Md_t &A, double shift)
 {
-	Md_t e1 (A.rows (), 1, 0.0);
+	double e1[3];
 	int last = A.rows () - 1;
 	double s = A(last - 1, last - 1) + A(last, last);
 	double t = A(last - 1, last - 1) * A(last, last) -
 				A(last - 1, last) * A(last, last - 1);
 
 	// From GVL4
-	e1(0, 0) = A(0, 0) * A(0, 0) + A(0, 1) * A(1, 0) - s * A(0, 0) + t;
-	e1(1, 0) = A(1, 0) * (A(0, 0) + A(1, 1) - s);
-	e1(2, 0) = A(2, 1) * A(1, 0);
+	e1[0] = A(0, 0) * A(0, 0) + A(0, 1) * A(1, 0) - s * A(0, 0) + t;
+	e1[1] = A(1, 0) * (A(0, 0) + A(1, 1) - s);
+	e1[2] = A(2, 1) * A(1, 0);
 
 	ApplyBulge (A, e1);
 	ChaseBulge (A);
@@ -157,40 +268,11 @@ void EigenFrancis_t::FrancisStep (Md_t &A, double shift)
 int EigenFrancis_t::SchurSubMatrix (Md_t &A, int index, conj_t EigenValues[])
 {
 	// Matrix_t<>::CoW is expensive => cache values
-	double a = A(index, index);
-	double b = A(index, index + 1);
-	double c = A(index + 1, index);
-	double d = A(index + 1, index + 1);
-	double tmp = a - d;
-	double p = 0.5 * tmp;
-	double bcmax = fmax (fabs(b), fabs(c));
-	double bcmis = fmin (fabs(b), fabs(c)) * SIGN(b) * SIGN(c);
-	double scale = fmax (fabs(p), bcmax);
-	double z = (p / scale) * p + (bcmax / scale) * bcmis;
-
-	if (z >= 4.0 * MACH_EPS) {
-
-		/* real eigenvalues, compute a and d */
-		z = p + SIGN(p) * fabs(sqrt(scale) * sqrt(z));
-		a = d + z;
-		d -= (bcmax / z) * bcmis;
-
-		/* compute b and the rotation matrix */
-		b -= c;
-		c = 0.0;
-
-		EigenValues[0].real = d;
-		EigenValues[1].real = a;
-		EigenValues[0].imag = EigenValues[1].imag = 0;
-
-		return 2;
-
-	} else {
-
-		ComplexEigen (A, index, EigenValues[0]);
-
-		return 1;
-	}
+	return SchurBlock (A(index, index),
+						A(index, index + 1),
+						A(index + 1, index),
+						A(index + 1, index + 1),
+						EigenValues);
 }
 
 int EigenFrancis_t::IterateAndShift (Md_t &A)
@@ -381,8 +463,8 @@ bool EigenFrancis_t::RawStep (Md_t &A, int step)
 	double beta;
 	int halt = (start + 3 < rows ? start + 3 : rows);
 	double * __restrict _A = A.raw ();
-	double * __restrict w = new double [rows];
-	double * __restrict Aprodw = new double [rows];
+	double * __restrict w = ef_w;
+	double * __restrict Aprodw = ef_Aprodw;
 	int prows = A.prows ();
 
 	beta = alpha = A(start, step) * A(start, step);
@@ -433,22 +515,18 @@ bool EigenFrancis_t::RawStep (Md_t &A, int step)
 		for (int c = start, k = c * prows + r; c < halt; ++c, k += prows)
 			_A[r + c * prows] -= Aprodw[r] * w[c];
 
-	delete [] Aprodw;
-	delete [] w;
-
 	return true;
 }
 
-bool EigenFrancis_t::ApplyBulge (Md_t &A, Md_t &x)
+bool EigenFrancis_t::ApplyBulge (Md_t &A, double p[])
 {
 	int rows = A.rows ();
 	double alpha;
 	double beta;
 	int halt = (3 < rows ? 3 : rows);
 	double * __restrict _A = A.raw ();
-	double * __restrict w = new double [rows];
-	double * __restrict Aprodw = new double [rows];
-	double * __restrict p = x.raw ();
+	double * __restrict w = ef_w;
+	double * __restrict Aprodw = ef_Aprodw;
 
 	int prows = A.prows ();
 
@@ -502,12 +580,196 @@ bool EigenFrancis_t::ApplyBulge (Md_t &A, Md_t &x)
 		for (int c = 0, k = c * prows + r; c < halt; ++c, k += prows)
 			_A[r + c * prows] -= Aprodw[r] * w[c];
 
-	delete [] Aprodw;
-	delete [] w;
-
 	return true;
 }
 
+/*
+ * Francis iteration on packed Hessenberg storage.  Matrix_t shrinks a
+ * view as eigenvalues deflate; here the active block is the window
+ * [lo, hi] of H.  The algorithm, shifts and deflation criteria are
+ * those of the Md_t version above.
+ *
+ */
+
+int EigenFrancis_t::CalcEigenValues (Hd_t &H, int lo, int hi)
+{
+	while (lo <= hi)
+		if (IterateAndShift (H, lo, hi) < 0)
+			break;	// didn't converge - we're done
+
+	return ef_N;
+}
+
+int EigenFrancis_t::SchurSubMatrix (Hd_t &H, int index, conj_t EigenValues[])
+{
+	double *left = H.column (index);
+	double *right = H.column (index + 1);
+
+	return SchurBlock (left[index],
+						right[index],
+						left[index + 1],
+						right[index + 1],
+						EigenValues);
+}
+
+/*
+ * Returns the number of eigenvalues found and narrows the window, or -1
+ * if the iteration gave up.
+ *
+ */
+
+int EigenFrancis_t::IterateAndShift (Hd_t &H, int &lo, int &hi)
+{
+	int rows = hi - lo + 1;
+	int last = rows - 1;
+	int iterations = 0;
+	int pivot;
+	int found;
+
+	if (rows == 2) {
+
+		ef_N += SchurSubMatrix (H, lo, ef_EigenValues + ef_N);
+		hi = lo - 1;
+
+		return 2;
+
+	} else if (rows == 1) {
+
+		ef_EigenValues[ef_N].real = H(lo, lo);
+		ef_EigenValues[ef_N].imag = 0;
+		++ef_N;
+		hi = lo - 1;
+
+		return 1;
+	}
+
+	while (true)
+	{
+		++iterations;
+
+		// as arbitrary as the Md_t version
+		if (iterations == last + 30)
+			return -1;
+
+		pivot = H.Deflate (lo, hi);
+
+		if (pivot == -1) {
+
+			FrancisStep (H, lo, hi);
+
+		} else if (pivot == hi) {
+
+			ef_EigenValues[ef_N].real = H(hi, hi);
+			ef_EigenValues[ef_N].imag = 0;
+			++ef_N;
+			hi -= 1;
+
+			return 1;
+
+		} else if (pivot == hi - 1) {
+
+			ef_N += SchurSubMatrix (H, pivot, ef_EigenValues + ef_N);
+			hi -= 2;
+
+			return 2;
+
+		} else if (pivot == lo + 1) {
+
+			ef_EigenValues[ef_N].real = H(lo, lo);
+			ef_EigenValues[ef_N].imag = 0;
+			++ef_N;
+			lo += 1;
+
+			return 1;
+
+		} else if (pivot == lo + 2) {
+
+			ef_N += SchurSubMatrix (H, lo, ef_EigenValues + ef_N);
+			lo += 2;
+
+			return 2;
+
+		} else {
+
+			// de-couple
+			found = ef_N;
+
+			CalcEigenValues (H, pivot, hi);
+			CalcEigenValues (H, lo, pivot - 1);
+
+			hi = lo - 1;
+
+			return ef_N - found;
+		}
+	}
+}
+
+void EigenFrancis_t::FrancisStep (Hd_t &H, int lo, int hi)
+{
+	double e1[3];
+	double s = H(hi - 1, hi - 1) + H(hi, hi);
+	double t = H(hi - 1, hi - 1) * H(hi, hi) - H(hi - 1, hi) * H(hi, hi - 1);
+
+	// From GVL4
+	e1[0] = H(lo, lo) * H(lo, lo) + H(lo, lo + 1) * H(lo + 1, lo) -
+				s * H(lo, lo) + t;
+	e1[1] = H(lo + 1, lo) * (H(lo, lo) + H(lo + 1, lo + 1) - s);
+	e1[2] = H(lo + 2, lo + 1) * H(lo + 1, lo);
+
+	// introduce the bulge, then chase it off the bottom of the window
+	Reflect (H, lo, hi, lo, lo, e1);
+
+	for (int step = lo; step < hi - 1; ++step)
+	{
+		double *h = H.column (step);
+
+		Reflect (H, lo, hi, step + 1, step, h + step + 1);
+	}
+
+	++ef_totalIterations;
+}
+
+/*
+ * Householder reflector mapping x onto e1, applied to rows (and columns)
+ * start .. start + 2 of the window [lo, hi].  The left application
+ * covers columns from col onwards, the right one the rows down to just
+ * below the reflector.  See RawStep and ApplyBulge.
+ *
+ */
+
+void EigenFrancis_t::Reflect (Hd_t &H, int lo, int hi, int start, int col, double x[])
+{
+	int halt = (start + 3 <= hi + 1 ? start + 3 : hi + 1);
+	int bottom = (halt + 1 <= hi + 1 ? halt + 1 : hi + 1);
+	double * __restrict w = ef_w;
+	double alpha;
+	double beta;
+
+	alpha = 0;
+	for (int i = start; i < halt; ++i)
+	{
+		w[i] = x[i - start];
+		alpha += w[i] * w[i];
+	}
+
+	beta = alpha - w[start] * w[start];
+	alpha = sqrt (alpha);
+
+	if (w[start] > 0.0)
+		w[start] += alpha;
+	else
+		w[start] -= alpha;
+
+	beta += w[start] * w[start];
+	if (beta == 0)
+		return;
+
+	beta = 2 / beta;
+
+	H.ReflectLeft (w, beta, start, halt, col, hi + 1, ef_Aprodw);
+	H.ReflectRight (w, beta, start, halt, lo, bottom, ef_Aprodw);
+}
+
 /*
  * Routine to compute eigenvectors for real eigenvalues.  Implements 
  * inverse iteration (power method with a conditioned matrix).
@@ -565,3 +827,93 @@ bool EigenFrancis_t::FindEigenVectorReal (double lambda, Md_t &A, Md_t &u)
     return true;
 }
 
+/*
+ * Inverse iteration for a complex eigenvalue, λ = a + ib, of a real
+ * matrix.  The eigenvector is u + iv.  The complex system
+ * (A - λI)(u + iv) = r is solved as a real system of twice the order:
+ *
+ * | A - aI    bI   | |u|
+ * |  -bI    A - aI | |v|
+ *
+ */
+
+bool EigenFrancis_t::FindEigenVectorComplex (conj_t lambda,
+											Md_t &A,
+											Md_t &u,
+											Md_t &v)
+{
+	if (lambda.imag == 0)
+	{
+		u = Md_t (A.rows (), 1, 1.0, true);
+		u.vec_norm ();
+		v = Md_t (A.rows (), 1, 0.0, true);
+
+		return FindEigenVectorReal (lambda.real, A, u);
+	}
+
+	double halt = 10 * MACH_EPS * (A.norm_inf () + fabs (lambda.imag));
+	if (isnan (halt))
+		return false;
+
+	int rows = A.rows ();
+	int iterations = rows;
+	Md_t M (2 * rows, 2 * rows, 0.0);
+	Md_t scratch_M;
+	Md_t z (2 * rows, 1, 1.0, true);
+	Md_t x;
+	Md_t d;
+	double r_inf;
+	bool rc = true;
+
+	for (int i = 0; i < rows; ++i)
+	{
+		for (int j = 0; j < rows; ++j)
+		{
+			M(i, j) = A(i, j);
+			M(i + rows, j + rows) = A(i, j);
+		}
+
+		M(i, i) -= lambda.real;
+		M(i + rows, i + rows) -= lambda.real;
+		M(i, i + rows) = lambda.imag;
+		M(i + rows, i) = -lambda.imag;
+	}
+
+	z.vec_norm ();
+
+	while (true) {
+
+		scratch_M = M;
+		scratch_M.copy ();
+		x = scratch_M.solveQR (z);
+		z = x.vec_norm ();
+
+		d = M * z;
+
+		r_inf = DBL_MIN;
+		for (int i = 0; i < 2 * rows; ++i)
+			if (r_inf < fabs (d(i, 0)))
+				r_inf = fabs (d(i, 0));
+
+		if (r_inf <= halt)
+			break;
+
+		--iterations;
+		if (iterations < 0)
+		{
+			rc = false;
+			break;
+		}
+	}
+
+	u = Md_t (rows, 1);
+	v = Md_t (rows, 1);
+
+	for (int i = 0; i < rows; ++i)
+	{
+		u(i, 0) = z(i, 0);
+		v(i, 0) = z(i + rows, 0);
+	}
+
+	return rc;
+}
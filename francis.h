@@ -29,7 +29,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define __DJS_FRANCIS__H__
 
 #include <matrix.h>
+#include <hessenberg.h>
 typedef Matrix_t<double> Md_t;
+typedef Hessenberg_t<double> Hd_t;
 
 /*
  * Type used to represent Eigen values
@@ -87,15 +89,33 @@ class EigenFrancis_t {
 	int				ef_totalIterations;
 	Md_t			ef_A;
 
+	/*
+	 * Scratch space for the bulge chase, sized for the largest matrix
+	 * seen so far.  Reused across calls so that a single instance can
+	 * process many matrices without touching the heap.
+	 *
+	 */
+	int				ef_capacity;
+	double			*ef_w;
+	double			*ef_Aprodw;
+
 	int IterateAndShift (Md_t &);
 	int DetectConvergence (Md_t &);
 	void FrancisStep (Md_t &, double);
 	int SchurSubMatrix (Md_t &, int, conj_t []);
 	void ChaseBulge (Md_t &);
 	bool RawStep (Md_t &, int);
-	bool ApplyBulge (Md_t &, Md_t &);
+	bool ApplyBulge (Md_t &, double []);
 	int CalcEigenValues (Md_t &);
 
+	// the same iteration on packed storage, over the window [lo, hi]
+	int IterateAndShift (Hd_t &, int &, int &);
+	void FrancisStep (Hd_t &, int, int);
+	void Reflect (Hd_t &, int, int, int, int, double []);
+	int SchurSubMatrix (Hd_t &, int, conj_t []);
+	int CalcEigenValues (Hd_t &, int, int);
+
+	void Reserve (int);
 	void makeHeap (int, int);
 
 public:
@@ -103,8 +123,26 @@ public:
 	conj_t			*ef_EigenValues;
 	int				ef_N;
 
+	/*
+	 * Balancing (see Matrix_t::Balance) is applied by
+	 * CalcEigenValuesGeneral unless turned off.  The QR iteration only
+	 * runs on the irreducible block [ef_ilo, ef_ihi], the eigenvalues
+	 * outside of it are read off the diagonal.
+	 *
+	 */
+	bool			ef_balance;
+	int				ef_ilo;
+	int				ef_ihi;
+	Md_t			ef_scale;
+
 	EigenFrancis_t (void) :
-		ef_EigenValues (0)
+		ef_capacity (0),
+		ef_w (0),
+		ef_Aprodw (0),
+		ef_EigenValues (0),
+		ef_balance (true),
+		ef_ilo (0),
+		ef_ihi (-1)
 	{
 	}
 
@@ -112,6 +150,12 @@ public:
 
 		if (ef_EigenValues)
 			delete [] ef_EigenValues;
+
+		if (ef_w)
+			delete [] ef_w;
+
+		if (ef_Aprodw)
+			delete [] ef_Aprodw;
 	}
 
 	int N_Iterations (void) {
@@ -119,6 +163,11 @@ public:
 		return ef_totalIterations;
 	}
 
+	void SetBalance (bool balance) {
+
+		ef_balance = balance;
+	}
+
 	void display (const char *name = 0)
 	{
 		if (name)
@@ -130,6 +179,7 @@ public:
 	}
 
 	int CalcEigenValuesHessenberg (Md_t &); // general square matrix
+	int CalcEigenValuesHessenberg (Hd_t &); // packed Hessenberg storage
 	int CalcEigenValuesGeneral (Md_t &); // already in Hessenberg form
 
 	/*
@@ -137,6 +187,7 @@ public:
 	 *
 	 */
 	static bool FindEigenVectorReal (double, Md_t &, Md_t &);
+	static bool FindEigenVectorComplex (conj_t, Md_t &, Md_t &, Md_t &);
 
 	void SortEigenValues (void);
 };
@@ -0,0 +1,354 @@
+/*
+
+Copyright (c) 2015, Douglas Santry
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+*/
+
+#ifndef __DJS_HESSENBERG__H__
+#define __DJS_HESSENBERG__H__
+
+#include <matrix.h>
+
+/*
+ * Subdiagonals stored below the diagonal.  A Hessenberg matrix needs one,
+ * the Francis double shift bulge occupies two more while it is chased
+ * down the matrix.
+ *
+ */
+#define __HESSENBERG_BAND	3
+
+/**********************************************************
+ *
+ * Upper Hessenberg (and upper quasi-triangular) matrices.
+ *
+ * Only the upper triangle and __HESSENBERG_BAND subdiagonals are
+ * stored, column j holds rows 0 .. j + __HESSENBERG_BAND contiguously.
+ * That is about half of the n^2 entries of the equivalent Matrix_t,
+ * and the kernels below never visit the structurally zero region.
+ *
+ * Unlike Matrix_t there are no views and no CoW, a Hessenberg_t owns
+ * its storage and algorithms work on index windows [lo, hi] instead.
+ *
+ **********************************************************/
+
+template<typename T> class Hessenberg_t
+{
+	int				hs_n;
+	T				*hs_data;
+	ssize_t			*hs_col;		// offset of column j in hs_data
+
+	void Allocate (int n)
+	{
+		if (n < 1)
+			throw ("Hessenberg: illegal dimension");
+
+		hs_n = n;
+		hs_col = new ssize_t [n + 1];
+
+		hs_col[0] = 0;
+		for (int c = 0; c < n; ++c)
+			hs_col[c + 1] = hs_col[c] + extent (c);
+
+		hs_data = new T [hs_col[n]];
+	}
+
+public:
+
+	Hessenberg_t (int n)
+	{
+		Allocate (n);
+
+		memset (hs_data, 0, hs_col[n] * sizeof (T));
+	}
+
+	// The Hessenberg part of A, anything further below the diagonal is ignored
+	Hessenberg_t (Matrix_t<T> &A)
+	{
+		if (A.rows () != A.columns ())
+			throw ("Hessenberg: matrix not square");
+
+		Allocate (A.rows ());
+
+		T *from = A.raw ();
+		int prows = A.prows ();
+
+		for (int c = 0; c < hs_n; ++c)
+		{
+			T *to = column (c);
+			int last = (c + 1 < hs_n ? c + 1 : hs_n - 1);
+
+			for (int r = 0; r <= last; ++r)
+				to[r] = from[c * prows + r];
+
+			for (int r = last + 1; r < extent (c); ++r)
+				to[r] = 0;
+		}
+	}
+
+	Hessenberg_t (const Hessenberg_t &H)
+	{
+		Allocate (H.hs_n);
+
+		memcpy (hs_data, H.hs_data, hs_col[hs_n] * sizeof (T));
+	}
+
+	Hessenberg_t &operator= (const Hessenberg_t &H)
+	{
+		if (this == &H)
+			return *this;
+
+		if (hs_n != H.hs_n)
+		{
+			delete [] hs_data;
+			delete [] hs_col;
+
+			Allocate (H.hs_n);
+		}
+
+		memcpy (hs_data, H.hs_data, hs_col[hs_n] * sizeof (T));
+
+		return *this;
+	}
+
+	~Hessenberg_t (void)
+	{
+		delete [] hs_data;
+		delete [] hs_col;
+	}
+
+	int rows (void) const
+	{
+		return hs_n;
+	}
+
+	int columns (void) const
+	{
+		return hs_n;
+	}
+
+	// number of entries stored in column c
+	int extent (int c) const
+	{
+		int e = c + __HESSENBERG_BAND + 1;
+
+		return (e < hs_n ? e : hs_n);
+	}
+
+	// column c, rows 0 .. extent (c) - 1 are contiguous
+	T *column (int c)
+	{
+		return hs_data + hs_col[c];
+	}
+
+	T &operator() (int r, int c)
+	{
+		assert (r < extent (c));
+
+		return hs_data[hs_col[c] + r];
+	}
+
+	// value of any element, including the unstored zeros
+	T get (int r, int c) const
+	{
+		return (r < extent (c) ? hs_data[hs_col[c] + r] : 0);
+	}
+
+	Matrix_t<T> dense (void)
+	{
+		Matrix_t<T> A (hs_n, hs_n, 0.0);
+		T *to = A.raw ();
+		int prows = A.prows ();
+
+		for (int c = 0; c < hs_n; ++c)
+			memcpy (to + c * prows, column (c), extent (c) * sizeof (T));
+
+		return A;
+	}
+
+	/*
+	 * y = Hx, column oriented so each stored column is streamed once.
+	 *
+	 */
+	Matrix_t<T> operator* (Matrix_t<T> &x)
+	{
+		if (x.rows () != hs_n || x.columns () != 1)
+			throw ("Hessenberg: illegal vector");
+
+		Matrix_t<T> y (hs_n, 1, 0.0);
+		T * __restrict _y = y.raw ();
+		T * __restrict _x = x.raw ();
+
+		for (int c = 0; c < hs_n; ++c)
+		{
+			T * __restrict h = column (c);
+			T xc = _x[c];
+			int e = extent (c);
+
+			for (int r = 0; r < e; ++r)
+				_y[r] += h[r] * xc;
+		}
+
+		return y;
+	}
+
+	// The matrix infinite norm
+	double norm_inf (void)
+	{
+		double *sum = new double [hs_n];
+		double max = DBL_MIN;
+
+		for (int r = 0; r < hs_n; ++r)
+			sum[r] = 0;
+
+		for (int c = 0; c < hs_n; ++c)
+		{
+			T *h = column (c);
+			int e = extent (c);
+
+			for (int r = 0; r < e; ++r)
+				sum[r] += fabs (h[r]);
+		}
+
+		for (int r = 0; r < hs_n; ++r)
+			if (sum[r] > max)
+				max = sum[r];
+
+		delete [] sum;
+
+		return max;
+	}
+
+	double norm_frobenius (void)
+	{
+		double sum = 0;
+
+		for (ssize_t k = 0; k < hs_col[hs_n]; ++k)
+			sum += hs_data[k] * hs_data[k];
+
+		return sqrt (sum);
+	}
+
+	/*
+	 * H = (I - beta vvT)H for rows [r0, r1) and columns [c0, c1).  v is
+	 * indexed by row, scratch must hold c1 elements.  The rows must lie
+	 * within the band of column c0.
+	 *
+	 */
+	void ReflectLeft (const T *v,
+						T beta,
+						int r0,
+						int r1,
+						int c0,
+						int c1,
+						T *scratch)
+	{
+		assert (r1 <= extent (c0));
+
+		for (int c = c0; c < c1; ++c)
+		{
+			T * __restrict h = column (c);
+			T s = 0;
+
+			for (int r = r0; r < r1; ++r)
+				s += v[r] * h[r];
+
+			scratch[c] = beta * s;
+		}
+
+		for (int c = c0; c < c1; ++c)
+		{
+			T * __restrict h = column (c);
+			T s = scratch[c];
+
+			for (int r = r0; r < r1; ++r)
+				h[r] -= v[r] * s;
+		}
+	}
+
+	/*
+	 * H = H(I - beta vvT) for columns [c0, c1) and rows [r0, r1).  v is
+	 * indexed by column, scratch must hold r1 elements.  The rows must
+	 * lie within the band of column c0.
+	 *
+	 */
+	void ReflectRight (const T *v,
+						T beta,
+						int c0,
+						int c1,
+						int r0,
+						int r1,
+						T *scratch)
+	{
+		assert (r1 <= extent (c0));
+
+		for (int r = r0; r < r1; ++r)
+			scratch[r] = 0;
+
+		for (int c = c0; c < c1; ++c)
+		{
+			T * __restrict h = column (c);
+			T vc = v[c];
+
+			for (int r = r0; r < r1; ++r)
+				scratch[r] += h[r] * vc;
+		}
+
+		for (int c = c0; c < c1; ++c)
+		{
+			T * __restrict h = column (c);
+			T vc = beta * v[c];
+
+			for (int r = r0; r < r1; ++r)
+				h[r] -= scratch[r] * vc;
+		}
+	}
+
+	/*
+	 * Scan the subdiagonal of the window [lo, hi] from the bottom for a
+	 * negligible element (equation 7.5.4 in GVL4).  It is set to zero and
+	 * its row returned, or -1 if the window is unreduced.
+	 *
+	 */
+	int Deflate (int lo, int hi)
+	{
+		for (int i = hi; i > lo; --i)
+		{
+			T *h = column (i - 1);
+			T sub = h[i];
+			double diag = MACH_EPS * (fabs (column (i)[i]) + fabs (h[i - 1]));
+
+			if (sub == 0 || fabs (sub) <= diag)
+			{
+				h[i] = 0;
+
+				return i;
+			}
+		}
+
+		return -1;
+	}
+};
+
+#endif // header inclusion
+
@@ -39,8 +39,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <assert.h>
 
 #include <memory>
+#include <atomic>
+#include <algorithm>
 
-static int serialNo = 0;
+// views may be created concurrently by independent threads (see batch.h)
+static std::atomic<int> serialNo (0);
 
 #define MACH_EPS 2.2204460492503131e-16 // for IEEE double (64 bits)
 #define SIGN(X) (signbit (X) ? -1 : 1)
@@ -964,12 +967,18 @@ public:
 	Matrix_t<T> find_x (Matrix_t<T> &);
 	void QR (Matrix_t<T> &);
 	void HessenbergSimilarity (bool similar = true);
+	void Balance (int &, int &, Matrix_t<T> &);
 	void ApplyHouseholder (Matrix_t<T> &, bool similar = false);
 	void ImplicitQRStep (int, double [], Matrix_t &);
 	bool ComputeCholesky (Matrix_t<T> &);
 	void SolveLower (Matrix_t<T> &, Matrix_t<T> &);
 	void SolveUpper (Matrix_t<T> &);
 
+	// Singular value decomposition (one-sided Jacobi)
+	int JacobiSVD (Matrix_t<T> &, Matrix_t<T> *);
+	Matrix_t<T> SingularValues (void);
+	void SVD (Matrix_t<T> &, Matrix_t<T> &, Matrix_t<T> &);
+
 	/**********************************************************
 	 *
 	 * Miscellaneous matrix operations
@@ -1822,6 +1831,186 @@ template<typename T> void Matrix_t<T>::HessenbergSimilarity (bool similar)
 	delete [] w;
 }
 
+/*
+ * Balance the matrix, B = D'P'APD, preserves eigenvalues (Parlett and
+ * Reinsch, as in LAPACK's xGEBAL).
+ *
+ * (i) Permute rows and columns that isolate an eigenvalue to the bottom
+ *     and to the left.  On return the rows and columns outside of
+ *     [lo, hi] are already triangular, their diagonal elements are
+ *     eigenvalues.
+ * (ii) Scale the rows and columns of the block [lo, hi] by powers of 2
+ *      so that their norms are close.  No rounding error is introduced.
+ *
+ * scale(j) is the index swapped with j for j outside of [lo, hi] and
+ * the scaling factor of row/column j inside.
+ *
+ */
+
+template<typename T> void
+Matrix_t<T>::Balance (int &lo, int &hi, Matrix_t<T> &scale)
+{
+	CoW ();
+
+	int n = rows ();
+	int prows = INVOKE->prows ();
+	T * __restrict A = raw ();
+	T * __restrict d;
+	const T radix = 2;
+	int k = 0;
+	int l = n - 1;
+	bool found;
+
+	if (!scale.m_data.valid () || scale.rows () != n)
+		scale = Matrix_t<T> (n, 1);
+
+	d = scale.raw ();
+	for (int i = 0; i < n; ++i)
+		d[i] = 1;
+
+#define __A(r, c) A[(c) * prows + (r)]
+
+	// exchange row/column j with m
+	auto swap = [&] (int j, int m)
+	{
+		T tmp;
+
+		for (int i = 0; i < n; ++i)
+		{
+			tmp = __A (i, j);
+			__A (i, j) = __A (i, m);
+			__A (i, m) = tmp;
+		}
+
+		for (int i = 0; i < n; ++i)
+		{
+			tmp = __A (j, i);
+			__A (j, i) = __A (m, i);
+			__A (m, i) = tmp;
+		}
+	};
+
+	// (i) rows with a zero off diagonal (in the active block) go down
+	do {
+
+		found = false;
+
+		for (int j = l; j >= 0 && !found; --j)
+		{
+			bool zero = true;
+
+			for (int i = 0; i <= l && zero; ++i)
+				if (i != j && __A (j, i) != 0)
+					zero = false;
+
+			if (!zero)
+				continue;
+
+			d[l] = j;
+			if (j != l)
+				swap (j, l);
+
+			if (l == 0) // triangular, nothing left to do
+				break;
+
+			--l;
+			found = true;
+		}
+
+	} while (found);
+
+	// ...and columns with a zero off diagonal go left
+	do {
+
+		found = false;
+
+		if (k == l) // a 1 x 1 block is left
+			break;
+
+		for (int j = k; j <= l && !found; ++j)
+		{
+			bool zero = true;
+
+			for (int i = k; i <= l && zero; ++i)
+				if (i != j && __A (i, j) != 0)
+					zero = false;
+
+			if (!zero)
+				continue;
+
+			d[k] = j;
+			if (j != k)
+				swap (j, k);
+
+			++k;
+			found = true;
+		}
+
+	} while (found);
+
+	// (ii) iterate until the row and column norms stop improving
+	bool working = (k < l);
+
+	while (working)
+	{
+		working = false;
+
+		for (int i = k; i <= l; ++i)
+		{
+			T c = 0;
+			T r = 0;
+
+			for (int j = k; j <= l; ++j)
+			{
+				if (j == i)
+					continue;
+
+				c += fabs (__A (j, i));
+				r += fabs (__A (i, j));
+			}
+
+			if (c == 0 || r == 0)
+				continue;
+
+			T g = r / radix;
+			T f = 1;
+			T s = c + r;
+
+			while (c < g)
+			{
+				f *= radix;
+				c *= radix * radix;
+			}
+
+			g = r * radix;
+
+			while (c >= g)
+			{
+				f /= radix;
+				c /= radix * radix;
+			}
+
+			if ((c + r) / f >= 0.95 * s)
+				continue;
+
+			working = true;
+			d[i] *= f;
+			g = 1 / f;
+
+			for (int j = k; j < n; ++j)
+				__A (i, j) *= g;
+
+			for (int j = 0; j <= l; ++j)
+				__A (j, i) *= f;
+		}
+	}
+
+#undef __A
+
+	lo = k;
+	hi = l;
+}
+
 /*
  * Given a vector (axis of reflection), v, apply the resultant Householder
  * while maintaining similarity.
@@ -2201,6 +2390,273 @@ Matrix_t<T>::SolveUpper (Matrix_t<T> &b)
 	}
 }
 
+/*
+ * One-sided Jacobi SVD (Hestenes).  Plane rotations are applied to pairs
+ * of columns of A until all columns are mutually orthogonal, then
+ *
+ * AV = U diag (S)
+ *
+ * with S(j) the norm of column j and U(:, j) the normalised column.
+ * Unlike forming transpose (A) * A the condition number is not squared,
+ * small singular values are found to high relative accuracy.
+ *
+ * The columns are paired round robin (a tournament) so the rotations of
+ * a round touch disjoint columns and run in parallel (OpenMP).
+ *
+ * Requires rows >= columns.  On return A holds U diag (S), S the
+ * singular values (n x 1, descending) and V, if not NULL, the right
+ * singular vectors.  Returns the number of sweeps or -1 if the
+ * iteration did not converge.
+ *
+ */
+
+template<typename T> int
+Matrix_t<T>::JacobiSVD (Matrix_t<T> &S, Matrix_t<T> *V)
+{
+	int m = rows ();
+	int n = columns ();
+
+	if (m < n)
+		throw ("SVD: requires rows >= columns");
+
+	CoW ();
+
+	int prows = INVOKE->prows ();
+	int vrows = 0;
+	T * __restrict A = raw ();
+	T * __restrict v = 0;
+	int players = n + (n & 1);		// a bye when n is odd
+	int *slot = new int [players];
+	const T tolerance = MACH_EPS * m;
+	const int maxSweeps = 60;
+	int sweeps = 0;
+	bool working = true;
+	bool parallel = ((ssize_t) m * n >= 8192);
+
+	if (V)
+	{
+		*V = Matrix_t<T> (n, n, 0.0);
+		v = V->raw ();
+		vrows = V->stride ();
+
+		for (int i = 0; i < n; ++i)
+			v[i * vrows + i] = 1;
+	}
+
+	for (int i = 0; i < players; ++i)
+		slot[i] = i;
+
+	while (working && sweeps < maxSweeps)
+	{
+		int rotations = 0;
+
+		++sweeps;
+
+		for (int round = 0; round < players - 1; ++round)
+		{
+#pragma omp parallel for reduction(+:rotations) schedule(static) if(parallel)
+			for (int k = 0; k < players / 2; ++k)
+			{
+				int p = slot[k];
+				int q = slot[players - 1 - k];
+
+				if (p >= n || q >= n)
+					continue;
+
+				T * __restrict x = A + (ssize_t) p * prows;
+				T * __restrict y = A + (ssize_t) q * prows;
+				T alpha = 0;
+				T beta = 0;
+				T gamma = 0;
+
+				for (int i = 0; i < m; ++i)
+				{
+					alpha += x[i] * x[i];
+					beta += y[i] * y[i];
+					gamma += x[i] * y[i];
+				}
+
+				if (fabs (gamma) <= tolerance * sqrt (alpha * beta))
+					continue;
+
+				// rotation that zeroes the (p, q) entry of ATA
+				T zeta = (beta - alpha) / (2 * gamma);
+				T t = SIGN (zeta) / (fabs (zeta) + sqrt (1 + zeta * zeta));
+				T c = 1 / sqrt (1 + t * t);
+				T s = c * t;
+
+				for (int i = 0; i < m; ++i)
+				{
+					T xi = x[i];
+
+					x[i] = c * xi - s * y[i];
+					y[i] = s * xi + c * y[i];
+				}
+
+				if (v)
+				{
+					x = v + (ssize_t) p * vrows;
+					y = v + (ssize_t) q * vrows;
+
+					for (int i = 0; i < n; ++i)
+					{
+						T xi = x[i];
+
+						x[i] = c * xi - s * y[i];
+						y[i] = s * xi + c * y[i];
+					}
+				}
+
+				++rotations;
+			}
+
+			// slot 0 is fixed, everyone else moves round one place
+			int last = slot[players - 1];
+
+			for (int i = players - 1; i > 1; --i)
+				slot[i] = slot[i - 1];
+
+			slot[1] = last;
+		}
+
+		working = (rotations > 0);
+	}
+
+	delete [] slot;
+
+	// singular values, sorted largest first
+	int *order = new int [n];
+	T *norm = new T [n];
+
+	for (int j = 0; j < n; ++j)
+	{
+		T * __restrict x = A + (ssize_t) j * prows;
+		T sum = 0;
+
+		for (int i = 0; i < m; ++i)
+			sum += x[i] * x[i];
+
+		norm[j] = sqrt (sum);
+		order[j] = j;
+	}
+
+	std::stable_sort (order, order + n, [norm] (int a, int b) {
+		return norm[a] > norm[b];
+	});
+
+	S = Matrix_t<T> (n, 1);
+
+	for (int j = 0; j < n; ++j)
+		S(j, 0) = norm[order[j]];
+
+	// permute the columns of A and V to match
+	auto permute = [&] (T *X, int xrows, int len) {
+
+		T *tmp = new T [(ssize_t) len * n];
+
+		for (int j = 0; j < n; ++j)
+			memcpy (tmp + (ssize_t) j * len,
+					X + (ssize_t) order[j] * xrows,
+					len * sizeof (T));
+
+		for (int j = 0; j < n; ++j)
+			memcpy (X + (ssize_t) j * xrows,
+					tmp + (ssize_t) j * len,
+					len * sizeof (T));
+
+		delete [] tmp;
+	};
+
+	permute (A, prows, m);
+
+	if (v)
+		permute (v, vrows, n);
+
+	delete [] order;
+	delete [] norm;
+
+	return (working ? -1 : sweeps);
+}
+
+/*
+ * The singular values of A, descending, as a column vector.  A is not
+ * modified and no singular vectors are accumulated.
+ *
+ */
+
+template<typename T> Matrix_t<T>
+Matrix_t<T>::SingularValues (void)
+{
+	Matrix_t<T> W;
+	Matrix_t<T> S;
+
+	if (rows () >= columns ())
+	{
+		W = Matrix_t<T> (rows (), columns ());
+		W.copy (m_data);
+	}
+	else
+		W = transpose ();
+
+	if (W.JacobiSVD (S, 0) < 0)
+		throw ("SVD: no convergence");
+
+	return S;
+}
+
+/*
+ * Thin SVD, A = U diag (S) VT.  With k = min (rows, columns), U is
+ * rows x k, S is k x 1 (descending) and V is columns x k.  A is not
+ * modified.
+ *
+ */
+
+template<typename T> void
+Matrix_t<T>::SVD (Matrix_t<T> &U, Matrix_t<T> &S, Matrix_t<T> &V)
+{
+	bool wide = (rows () < columns ());
+	Matrix_t<T> W;
+	Matrix_t<T> R;
+
+	if (!wide)
+	{
+		W = Matrix_t<T> (rows (), columns ());
+		W.copy (m_data);
+	}
+	else
+		W = transpose ();
+
+	if (W.JacobiSVD (S, &R) < 0)
+		throw ("SVD: no convergence");
+
+	// W = U diag (S), normalise its columns
+	int m = W.rows ();
+	int k = W.columns ();
+	T *w = W.raw ();
+	int prows = W.stride ();
+
+	for (int j = 0; j < k; ++j)
+	{
+		T *u = w + (ssize_t) j * prows;
+		T sigma = S(j, 0);
+
+		for (int i = 0; i < m; ++i)
+			u[i] = (sigma > 0 ? u[i] / sigma : 0);
+	}
+
+	// AT = V S UT
+	if (wide)
+	{
+		U = R;
+		V = W;
+	}
+	else
+	{
+		U = W;
+		V = R;
+	}
+}
+
 #undef INVOKE
 
 #endif // header inclusion
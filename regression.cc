@@ -138,6 +138,7 @@ void VerifyMultiplication (void);
 void VerifyQR (void);
 void VerifySymetricSolution (void);
 void VerifyQRSolution (void);
+void VerifySVD (void);
 
 int main (void)
 {
@@ -147,6 +148,7 @@ int main (void)
 	VerifyQR ();
 	VerifySymetricSolution ();
 	VerifyQRSolution ();
+	VerifySVD ();
 
 	printf ("\nSUCCESS: All tests passed.\n");
 
@@ -255,3 +257,82 @@ void VerifyQRSolution (void)
 	printf ("QR Solve for x:\t\t\t\tPassed.\n");
 }
 
+
+/*
+ * A = U diag (S) VT for tall and wide matrices, and the singular values
+ * of a matrix with known spectrum and condition number 1e10.  Forming
+ * ATA squares that to beyond 1/MACH_EPS, losing the small ones.
+ *
+ */
+void VerifySVD (void)
+{
+	for (int wide = 0; wide < 2; ++wide)
+	{
+		int m = (wide ? 25 : 40);
+		int n = (wide ? 40 : 25);
+		int k = (m < n ? m : n);
+		Md_t A (m, n);
+		Md_t U;
+		Md_t S;
+		Md_t V;
+
+		for (int i = 0; i < m; ++i)
+			for (int j = 0; j < n; ++j)
+				A (i, j) = rand () % UNIVERSE;
+
+		A.SVD (U, S, V);
+
+		assert (U.rows () == m && U.columns () == k);
+		assert (V.rows () == n && V.columns () == k);
+
+		Md_t I (k, k, 1);
+		Md_t G = transpose (U) * U;
+		assert (G.equal_eps (I, 1e-10));
+
+		G = transpose (V) * V;
+		assert (G.equal_eps (I, 1e-10));
+
+		Md_t US = U;
+		US.copy ();
+		for (int j = 0; j < k; ++j)
+			for (int i = 0; i < m; ++i)
+				US (i, j) *= S (j, 0);
+
+		G = US * V.transpose ();
+		assert (G.equal_eps (A, 1e-8));
+
+		Md_t sigma = A.SingularValues ();
+		assert (sigma.equal_eps (S, 1e-8));
+
+		for (int j = 1; j < k; ++j)
+			assert (S (j - 1, 0) >= S (j, 0));
+	}
+
+	int n = 20;
+	Md_t X (n, n);
+	Md_t Y (n, n);
+	Md_t Q1 (n, n);
+	Md_t Q2 (n, n);
+	Md_t D (n, n, 0.0);
+
+	for (int i = 0; i < n; ++i)
+		for (int j = 0; j < n; ++j)
+		{
+			X (i, j) = rand () % UNIVERSE;
+			Y (i, j) = rand () % UNIVERSE;
+		}
+
+	X.QR (Q1);
+	Y.QR (Q2);
+
+	for (int i = 0; i < n; ++i)
+		D (i, i) = pow (10.0, -10.0 * i / (n - 1));
+
+	Md_t A = Q1 * D * Q2;
+	Md_t S = A.SingularValues ();
+
+	for (int i = 0; i < n; ++i)
+		assert (fabs (S (i, 0) - D (i, i)) < 1e-13);
+
+	printf ("SVD (one-sided Jacobi):\t\t\tPassed.\n");
+}